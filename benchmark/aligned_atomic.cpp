@@ -0,0 +1,84 @@
+#include <benchmark/benchmark.h>
+#include <jb/aligned_atomic.h>
+#include "perf_counters.h"
+#include "thread_sweep.h"
+#include <array>
+
+
+namespace jb
+{
+    namespace benchmark
+    {
+        static constexpr size_t max_thread_count = 1024;
+
+
+        /** All threads increment the same counter: the cache line ping-pongs between cores
+        */
+        static void aligned_atomic_shared_counter( ::benchmark::State& state )
+        {
+            static details::aligned_atomic< size_t > counter;
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                counter.fetch_add( 1, std::memory_order_relaxed );
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK( aligned_atomic_shared_counter )->Apply( thread_sweep );
+
+
+        /** Each thread increments its own counter, counters share cache lines (false sharing)
+        */
+        static void packed_atomic_own_counter( ::benchmark::State& state )
+        {
+            static std::array< std::atomic< size_t >, max_thread_count > counters;
+            auto& counter = counters[ state.thread_index() % max_thread_count ];
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                counter.fetch_add( 1, std::memory_order_relaxed );
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK( packed_atomic_own_counter )->Apply( thread_sweep );
+
+
+        /** Each thread increments its own counter, each counter has its own cache line
+        */
+        static void aligned_atomic_own_counter( ::benchmark::State& state )
+        {
+            static std::array< details::aligned_atomic< size_t >, max_thread_count > counters;
+            auto& counter = counters[ state.thread_index() % max_thread_count ];
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                counter.fetch_add( 1, std::memory_order_relaxed );
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK( aligned_atomic_own_counter )->Apply( thread_sweep );
+
+
+        /** All threads read the same counter, nobody modifies it
+        */
+        static void aligned_atomic_shared_load( ::benchmark::State& state )
+        {
+            static details::aligned_atomic< size_t > counter;
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                ::benchmark::DoNotOptimize( counter.load( std::memory_order_acquire ) );
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK( aligned_atomic_shared_load )->Apply( thread_sweep );
+    }
+}
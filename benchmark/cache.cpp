@@ -0,0 +1,91 @@
+#include <benchmark/benchmark.h>
+#include "temporary_file.h"
+#include "perf_counters.h"
+#include "thread_sweep.h"
+#include <random>
+#include <vector>
+
+
+namespace jb
+{
+    namespace benchmark
+    {
+        static constexpr size_t page_count = 256;
+
+
+        /** Takes a random page through the cache, state.range( 0 ) is the number of distinct pages
+        */
+        static void cache_get_page( ::benchmark::State& state )
+        {
+            static temporary_file file( "./benchmark_get_page.jb", page_count );
+
+            auto page_size = temporary_file::storage_file::page_size();
+            std::minstd_rand rand( static_cast< unsigned >( state.thread_index() + 1 ) );
+            std::uniform_int_distribution< size_t > dist( 0, static_cast< size_t >( state.range( 0 ) ) - 1 );
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                auto page = file->get_page( dist( rand ) * page_size );
+                ::benchmark::DoNotOptimize( page.get() );
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK( cache_get_page )->Arg( 1 )->Arg( 16 )->Arg( page_count )->Apply( thread_sweep );
+
+
+        /** Takes a random page through per-thread cache, state.range( 0 ) is the number of distinct pages
+        */
+        static void cache_get_cached_page( ::benchmark::State& state )
+        {
+            static temporary_file file( "./benchmark_get_cached_page.jb", page_count );
+
+            auto page_size = temporary_file::storage_file::page_size();
+            std::minstd_rand rand( static_cast< unsigned >( state.thread_index() + 1 ) );
+            std::uniform_int_distribution< size_t > dist( 0, static_cast< size_t >( state.range( 0 ) ) - 1 );
+
+            // keep the pages referred, so they stay cached and the thread cache hits
+            static auto pinned = [&] {
+                std::vector< temporary_file::storage_file::mapped_page_ptr > pages;
+                for ( size_t i = 0; i < page_count; ++i ) pages.push_back( file->get_page( i * page_size ) );
+                return pages;
+            }();
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                auto page = file->get_cached_page( dist( rand ) * page_size );
+                ::benchmark::DoNotOptimize( page.get() );
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK( cache_get_cached_page )->Arg( 1 )->Arg( 16 )->Arg( page_count )->Apply( thread_sweep );
+
+
+        /** Takes a random page, locks and unlocks it (i.e. gets it mapped), state.range( 0 ) is the number of
+            distinct pages
+        */
+        static void cache_lock_page( ::benchmark::State& state )
+        {
+            static temporary_file file( "./benchmark_lock_page.jb", page_count );
+
+            auto page_size = temporary_file::storage_file::page_size();
+            std::minstd_rand rand( static_cast< unsigned >( state.thread_index() + 1 ) );
+            std::uniform_int_distribution< size_t > dist( 0, static_cast< size_t >( state.range( 0 ) ) - 1 );
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                auto page = file->get_page( dist( rand ) * page_size );
+                page->lock();
+                ::benchmark::DoNotOptimize( page->data() );
+                page->unlock();
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK( cache_lock_page )->Arg( 1 )->Arg( 16 )->Arg( page_count )->Apply( thread_sweep );
+    }
+}
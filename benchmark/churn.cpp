@@ -0,0 +1,148 @@
+#include <benchmark/benchmark.h>
+#include "temporary_file.h"
+#include "perf_counters.h"
+#include "thread_sweep.h"
+#include "ycsb/generators.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <vector>
+
+
+/** Page cache churn: threads pin and unpin pages of a file much larger than the set of pinned pages
+
+Each thread keeps a window of the last churn_window pages it took, taking a page drops the oldest one, so nearly
+every iteration is a get_mapped_page() plus a try_release_mapped_page() racing with the other threads. Offsets
+come from a stream chosen by state.range( 0 ):
+
+    0 - uniform over the file,
+    1 - Zipfian (YCSB constant, popular pages scattered over the file),
+    2 - sequential, each thread scans its own part of the file.
+
+Reported counters:
+
+    items_per_second - pins per second, all threads together
+    fairness - Jain's index of per-thread pin rates: 1 when the threads progress equally, 1/threads when a single
+        thread does all the work
+    allocated_pages - page descriptors allocated by the cache when the run finished
+    growth_per_Mop - descriptors allocated during the run per million pins, must drop to zero on a long run
+        (e.g. --benchmark_min_time=10 --benchmark_repetitions=5), otherwise pages are not recycled
+    retained_pages - descriptors still bound to pages after all the threads unpinned theirs, must be zero
+*/
+namespace jb
+{
+    namespace benchmark
+    {
+        static constexpr size_t churn_file_pages = 1 << 15;
+        static constexpr size_t churn_window = 8;
+
+
+        /** Offset streams of the churn
+        */
+        enum class churn_stream
+        {
+            uniform,
+            zipfian,
+            sequential
+        };
+
+
+        /** Results of the threads of a run, reset by the first thread before the run starts
+        */
+        struct churn_results
+        {
+            std::vector< double > rates_;
+            std::atomic< size_t > finished_ = 0;
+            size_t allocated_ = 0;
+        };
+
+
+        /** Provides Jain's fairness index of a set of rates
+        */
+        static double jain_index( const std::vector< double >& rates ) noexcept
+        {
+            double sum = 0, square_sum = 0;
+            for ( auto rate : rates )
+            {
+                sum += rate;
+                square_sum += rate * rate;
+            }
+
+            return square_sum ? sum * sum / ( rates.size() * square_sum ) : 0;
+        }
+
+
+        static void cache_churn( ::benchmark::State& state )
+        {
+            static temporary_file file( "./benchmark_churn.jb", churn_file_pages );
+            static const ycsb::zipfian zipfian( churn_file_pages );
+            static churn_results results;
+
+            auto stream = static_cast< churn_stream >( state.range( 0 ) );
+            auto page_size = temporary_file::storage_file::page_size();
+            auto threads = static_cast< size_t >( state.threads() );
+            auto thread = static_cast< size_t >( state.thread_index() );
+
+            std::minstd_rand rand( static_cast< unsigned >( thread + 1 ) );
+            std::uniform_int_distribution< size_t > uniform( 0, churn_file_pages - 1 );
+            size_t sequential = thread * churn_file_pages / threads;
+
+            auto next_offset = [&] {
+                switch ( stream )
+                {
+                case churn_stream::uniform:
+                    return uniform( rand ) * page_size;
+
+                case churn_stream::zipfian:
+                    return ycsb::fnv_hash( zipfian( rand ) ) % churn_file_pages * page_size;
+
+                case churn_stream::sequential:
+                default:
+                    return sequential++ % churn_file_pages * page_size;
+                }
+            };
+
+            // the other threads touch the results only after the loop, that starts with all the threads at barrier
+            if ( !thread )
+            {
+                results.rates_.assign( threads, 0 );
+                results.finished_.store( 0, std::memory_order_relaxed );
+                results.allocated_ = std::get< 0 >( file->cache_usage() );
+            }
+
+            std::array< temporary_file::storage_file::mapped_page_ptr, churn_window > window;
+            size_t slot = 0;
+            std::chrono::steady_clock::time_point start;
+
+            {
+                perf_counters perf( state );
+                for ( auto _ : state )
+                {
+                    if ( !slot ) start = std::chrono::steady_clock::now();
+                    window[ slot++ % churn_window ] = file->get_page( next_offset() );
+                }
+            }
+
+            auto elapsed = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+            for ( auto& page : window ) page.reset();
+
+            state.SetItemsProcessed( state.iterations() );
+
+            results.rates_[ thread ] = elapsed > 0 ? state.iterations() / elapsed : 0;
+
+            // the last thread to finish sees the results of all the others
+            if ( results.finished_.fetch_add( 1, std::memory_order_acq_rel ) + 1 == threads )
+            {
+                auto [ allocated, used ] = file->cache_usage();
+                auto total_iterations = static_cast< double >( state.iterations() ) * threads;
+
+                state.counters[ "fairness" ] = jain_index( results.rates_ );
+                state.counters[ "allocated_pages" ] = static_cast< double >( allocated );
+                state.counters[ "growth_per_Mop" ] = ( allocated - results.allocated_ ) * 1e6 / total_iterations;
+                state.counters[ "retained_pages" ] = static_cast< double >( used );
+            }
+        }
+        BENCHMARK( cache_churn )->ArgName( "stream" )->DenseRange( 0, 2 )->Apply( thread_sweep );
+    }
+}
@@ -0,0 +1,136 @@
+#include <benchmark/benchmark.h>
+#include <jb/layout.h>
+#include <jb/rare_exclusive_frequent_shared_mutex.h>
+#include "temporary_file.h"
+#include "perf_counters.h"
+#include "thread_sweep.h"
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+/** Padded against compact layout of page descriptors (see layout.h)
+
+Threads take random pages out of state.range( 0 ) distinct ones: a single page puts all the threads on the same
+descriptor, that is where false sharing between its field groups shows up, many pages spread the threads apart.
+Each benchmark reports descriptor_bytes counter, and the memory overhead of each layout is printed in the context
+header as
+
+    layout/<layout>/mapped_page: <bytes per resident page>, <MB per million pages>
+    layout/<layout>/shared_mutex: <bytes per rare_exclusive_frequent_shared_mutex>, <MB per million mutexes>
+*/
+namespace jb
+{
+    namespace benchmark
+    {
+        static constexpr size_t layout_page_count = 256;
+
+
+        template < typename Layout >
+        struct layout_policies : public default_policies
+        {
+            using layout = Layout;
+        };
+
+        template < typename Layout >
+        using layout_file = basic_temporary_file< layout_policies< Layout > >;
+
+        template < typename Layout >
+        using layout_page = typename layout_file< Layout >::storage_file::mapped_page_ptr::element_type;
+
+        template < typename Layout >
+        static constexpr const char* layout_name = std::is_same_v< Layout, details::padded_layout > ? "padded" : "compact";
+
+
+        /** Adds memory overhead of a layout to the context header
+        */
+        template < typename Layout >
+        static bool report_layout()
+        {
+            auto page = sizeof( layout_page< Layout > );
+            auto mutex = sizeof( details::rare_exclusive_frequent_shared_mutex< 31, details::backoff<>, details::null_tracer, Layout > );
+            auto prefix = std::string( "layout/" ) + layout_name< Layout >;
+
+            ::benchmark::AddCustomContext( prefix + "/mapped_page",
+                std::to_string( page ) + " bytes, " + std::to_string( page * 1'000'000 >> 20 ) + " MB per million pages" );
+            ::benchmark::AddCustomContext( prefix + "/shared_mutex",
+                std::to_string( mutex ) + " bytes, " + std::to_string( mutex * 1'000'000 >> 20 ) + " MB per million mutexes" );
+
+            return true;
+        }
+
+        static const bool padded_reported = report_layout< details::padded_layout >();
+        static const bool compact_reported = report_layout< details::compact_layout >();
+
+
+        /** Takes a random page and drops it: walks a bucket chain and changes the page reference counter
+        */
+        template < typename Layout >
+        static void layout_get_page( ::benchmark::State& state )
+        {
+            static layout_file< Layout > file( ( std::string( "./benchmark_layout_get_page_" ) + layout_name< Layout > + ".jb" ).c_str(), layout_page_count );
+
+            auto page_size = layout_file< Layout >::storage_file::page_size();
+            std::minstd_rand rand( static_cast< unsigned >( state.thread_index() + 1 ) );
+            std::uniform_int_distribution< size_t > dist( 0, static_cast< size_t >( state.range( 0 ) ) - 1 );
+
+            // keep the pages referred, so they are not recycled on each iteration
+            static auto pinned = [&] {
+                std::vector< typename layout_file< Layout >::storage_file::mapped_page_ptr > pages;
+                for ( size_t i = 0; i < layout_page_count; ++i ) pages.push_back( file->get_page( i * page_size ) );
+                return pages;
+            }();
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                auto page = file->get_page( dist( rand ) * page_size );
+                ::benchmark::DoNotOptimize( page.get() );
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+            state.counters[ "descriptor_bytes" ] = ::benchmark::Counter( sizeof( layout_page< Layout > ), ::benchmark::Counter::kAvgThreads );
+        }
+        BENCHMARK_TEMPLATE( layout_get_page, details::padded_layout )->Arg( 1 )->Arg( layout_page_count )->Apply( thread_sweep );
+        BENCHMARK_TEMPLATE( layout_get_page, details::compact_layout )->Arg( 1 )->Arg( layout_page_count )->Apply( thread_sweep );
+
+
+        /** Takes a random page, locks and unlocks it: adds lock counter changes to the walk
+        */
+        template < typename Layout >
+        static void layout_lock_page( ::benchmark::State& state )
+        {
+            static layout_file< Layout > file( ( std::string( "./benchmark_layout_lock_page_" ) + layout_name< Layout > + ".jb" ).c_str(), layout_page_count );
+
+            auto page_size = layout_file< Layout >::storage_file::page_size();
+            std::minstd_rand rand( static_cast< unsigned >( state.thread_index() + 1 ) );
+            std::uniform_int_distribution< size_t > dist( 0, static_cast< size_t >( state.range( 0 ) ) - 1 );
+
+            // keep the pages referred and mapped, so the lock just changes the counter
+            static auto pinned = [&] {
+                std::vector< typename layout_file< Layout >::storage_file::mapped_page_ptr > pages;
+                for ( size_t i = 0; i < layout_page_count; ++i )
+                {
+                    pages.push_back( file->get_page( i * page_size ) );
+                    pages.back()->lock();
+                }
+                return pages;
+            }();
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                auto page = file->get_page( dist( rand ) * page_size );
+                page->lock();
+                ::benchmark::DoNotOptimize( page->data() );
+                page->unlock();
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+            state.counters[ "descriptor_bytes" ] = ::benchmark::Counter( sizeof( layout_page< Layout > ), ::benchmark::Counter::kAvgThreads );
+        }
+        BENCHMARK_TEMPLATE( layout_lock_page, details::padded_layout )->Arg( 1 )->Arg( layout_page_count )->Apply( thread_sweep );
+        BENCHMARK_TEMPLATE( layout_lock_page, details::compact_layout )->Arg( 1 )->Arg( layout_page_count )->Apply( thread_sweep );
+    }
+}
@@ -0,0 +1,201 @@
+#include <benchmark/benchmark.h>
+#include <jb/aligned_atomic.h>
+#include <jb/backoff.h>
+#include <jb/rare_exclusive_frequent_shared_mutex.h>
+#include "perf_counters.h"
+#include "thread_sweep.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+#if defined( UNIX )
+#   include <pthread.h>
+#endif
+
+
+/** Lock matrix: rare_exclusive_frequent_shared_mutex against conventional reader-writer locks
+
+Each lock runs over the product of
+    - writer share: state.range( 0 ) exclusive locks per 1000 locks,
+    - critical section length: state.range( 1 ) pause instructions under the lock,
+    - thread count: see thread_sweep().
+
+The parameters are also reported as counters, so the matrix could be taken as machine-readable table with
+
+    benchmark --benchmark_filter=lock_matrix --benchmark_out=locks.json --benchmark_out_format=json
+
+(or csv) and a policy picked per host type by comparing items_per_second of the locks at the same parameters
+*/
+namespace jb
+{
+    namespace benchmark
+    {
+        /** Adapts rare_exclusive_frequent_shared_mutex to the matrix
+        */
+        template < size_t SharedLockCount >
+        class jb_lock
+        {
+            using mutex = details::rare_exclusive_frequent_shared_mutex< SharedLockCount >;
+            mutex mtx_;
+
+        public:
+
+            using shared_lock = typename mutex::shared_lock;
+            using unique_lock = typename mutex::unique_lock;
+
+            shared_lock lock_shared() noexcept { return shared_lock( mtx_, std::this_thread::get_id() ); }
+            unique_lock lock() noexcept { return unique_lock( mtx_ ); }
+        };
+
+
+        /** Adapts std::shared_mutex (default_policies::shared_mutex) to the matrix
+        */
+        class std_lock
+        {
+            std::shared_mutex mtx_;
+
+        public:
+
+            std::shared_lock< std::shared_mutex > lock_shared() { return std::shared_lock( mtx_ ); }
+            std::unique_lock< std::shared_mutex > lock() { return std::unique_lock( mtx_ ); }
+        };
+
+
+#if defined( UNIX )
+        /** Adapts pthread rwlock to the matrix
+        */
+        class pthread_lock
+        {
+            pthread_rwlock_t lock_ = PTHREAD_RWLOCK_INITIALIZER;
+
+            struct unlocker
+            {
+                void operator()( pthread_rwlock_t* lock ) const noexcept { ::pthread_rwlock_unlock( lock ); }
+            };
+
+        public:
+
+            using guard = std::unique_ptr< pthread_rwlock_t, unlocker >;
+
+            ~pthread_lock() { ::pthread_rwlock_destroy( &lock_ ); }
+
+            guard lock_shared() { ::pthread_rwlock_rdlock( &lock_ ); return guard( &lock_ ); }
+            guard lock() { ::pthread_rwlock_wrlock( &lock_ ); return guard( &lock_ ); }
+        };
+#endif
+
+
+        /** Big-reader lock: a mutex per CPU, a reader takes the mutex of its CPU, a writer takes them all
+        */
+        class brlock
+        {
+            struct alignas( std::hardware_destructive_interference_size ) slot
+            {
+                std::mutex mtx_;
+            };
+
+            size_t slot_count_ = std::max( 1u, std::thread::hardware_concurrency() );
+            std::unique_ptr< slot[] > slots_ = std::make_unique< slot[] >( slot_count_ );
+
+        public:
+
+            class shared_guard
+            {
+                std::unique_lock< std::mutex > lock_;
+            public:
+                explicit shared_guard( std::mutex& mtx ) : lock_( mtx ) {}
+            };
+
+            class unique_guard
+            {
+                brlock* lock_;
+            public:
+                explicit unique_guard( brlock& lock ) : lock_( &lock )
+                {
+                    for ( size_t i = 0; i < lock_->slot_count_; ++i ) lock_->slots_[ i ].mtx_.lock();
+                }
+                ~unique_guard()
+                {
+                    for ( size_t i = lock_->slot_count_; i; --i ) lock_->slots_[ i - 1 ].mtx_.unlock();
+                }
+            };
+
+            shared_guard lock_shared()
+            {
+                auto cpu = details::rare_exclusive_frequent_shared_mutex< 0 >::current_cpu();
+                return shared_guard( slots_[ cpu % slot_count_ ].mtx_ );
+            }
+
+            unique_guard lock() { return unique_guard( *this ); }
+        };
+
+
+        /** Runs the matrix cell for given lock
+
+        @tparam Lock - adapted lock
+        */
+        template < typename Lock >
+        static void lock_matrix( ::benchmark::State& state )
+        {
+            static Lock lock;
+
+            auto writes_per_mille = static_cast< size_t >( state.range( 0 ) );
+            auto section_length = static_cast< size_t >( state.range( 1 ) );
+            auto critical_section = [=] {
+                for ( size_t i = 0; i < section_length; ++i ) details::backoff<>::pause();
+            };
+
+            // spread writers over threads and time: thread i starts at i-th position of its period
+            size_t op = state.thread_index() * 997;
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                if ( ( op++ % 1000 ) < writes_per_mille )
+                {
+                    auto guard = lock.lock();
+                    critical_section();
+                }
+                else
+                {
+                    auto guard = lock.lock_shared();
+                    critical_section();
+                }
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+
+            // counters are summed over threads by default, the parameters are the same for each thread
+            auto parameter = []( auto value ) {
+                return ::benchmark::Counter( static_cast< double >( value ), ::benchmark::Counter::kAvgThreads );
+            };
+            state.counters[ "writes_per_mille" ] = parameter( writes_per_mille );
+            state.counters[ "section_length" ] = parameter( section_length );
+            state.counters[ "threads" ] = parameter( state.threads() );
+        }
+
+
+        /** Defines the matrix axes except thread count
+        */
+        static void lock_matrix_axes( ::benchmark::internal::Benchmark* b )
+        {
+            b->ArgNames( { "writes_per_mille", "section_length" } );
+            b->ArgsProduct( { { 0, 1, 10, 100, 500 }, { 0, 16, 256 } } );
+            thread_sweep( b );
+        }
+
+
+        BENCHMARK_TEMPLATE( lock_matrix, jb_lock< 0 > )->Apply( lock_matrix_axes );
+        BENCHMARK_TEMPLATE( lock_matrix, jb_lock< 1 > )->Apply( lock_matrix_axes );
+        BENCHMARK_TEMPLATE( lock_matrix, jb_lock< 7 > )->Apply( lock_matrix_axes );
+        BENCHMARK_TEMPLATE( lock_matrix, jb_lock< 31 > )->Apply( lock_matrix_axes );
+        BENCHMARK_TEMPLATE( lock_matrix, jb_lock< 127 > )->Apply( lock_matrix_axes );
+        BENCHMARK_TEMPLATE( lock_matrix, std_lock )->Apply( lock_matrix_axes );
+#if defined( UNIX )
+        BENCHMARK_TEMPLATE( lock_matrix, pthread_lock )->Apply( lock_matrix_axes );
+#endif
+        BENCHMARK_TEMPLATE( lock_matrix, brlock )->Apply( lock_matrix_axes );
+    }
+}
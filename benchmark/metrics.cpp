@@ -0,0 +1,45 @@
+#include <benchmark/benchmark.h>
+#include <jb/metrics.h>
+#include "perf_counters.h"
+#include "thread_sweep.h"
+
+
+namespace jb
+{
+    namespace benchmark
+    {
+        /** Cost of measuring an empty operation, that is the overhead each public storage operation pays
+        */
+        template < typename Metrics >
+        static void metrics_scope( ::benchmark::State& state )
+        {
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                typename Metrics::scope measure( details::operation::scan );
+                ::benchmark::ClobberMemory();
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK_TEMPLATE( metrics_scope, details::null_metrics )->Apply( thread_sweep );
+        BENCHMARK_TEMPLATE( metrics_scope, details::latency_metrics<> )->Apply( thread_sweep );
+
+
+        /** Cost of merging the histograms of an operation over all the threads
+        */
+        static void metrics_snapshot( ::benchmark::State& state )
+        {
+            using metrics_t = details::latency_metrics<>;
+
+            { metrics_t::scope measure( details::operation::scan ); }
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                ::benchmark::DoNotOptimize( metrics_t::snapshot( details::operation::scan ).percentile( 99.9 ) );
+            }
+        }
+        BENCHMARK( metrics_snapshot );
+    }
+}
@@ -0,0 +1,169 @@
+#ifndef __JB__BENCHMARK__PERF_COUNTERS__H__
+#define __JB__BENCHMARK__PERF_COUNTERS__H__
+
+
+#include <benchmark/benchmark.h>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#if defined( __linux__ )
+#   include <linux/perf_event.h>
+#   include <sys/ioctl.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#   include <cerrno>
+#endif
+
+
+namespace jb
+{
+    namespace benchmark
+    {
+        /** Hardware performance counters of the calling thread around a measured region
+
+        The counters are opened only if JB_PERF_COUNTERS environment variable is set (and is not "0"), e.g.
+
+            JB_PERF_COUNTERS=1 benchmark --benchmark_filter=cache_
+
+        and get reported per operation (i.e. divided by the total number of iterations of all the threads) next
+        to the timings: cycles, instructions, LLC misses and dTLB misses. If perf_event_open() is restricted
+        (see /proc/sys/kernel/perf_event_paranoid) the kernel part gets excluded, if it's not possible either or
+        a counter is not supported (e.g. in a virtual machine) the counter is silently omitted. The reason gets
+        printed to stderr once per process. On other systems than Linux the class does nothing
+
+        Usage: construct right before the benchmark loop, the counters are stopped and reported on destruction
+        */
+        class perf_counters
+        {
+#if defined( __linux__ )
+            struct counter_config
+            {
+                const char* name_;
+                uint32_t type_;
+                uint64_t config_;
+            };
+
+            static constexpr std::array< counter_config, 4 > configs_{ {
+                { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+                { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+                { "LLC_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+                { "dTLB_misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+            } };
+
+            ::benchmark::State& state_;
+            std::array< int, configs_.size() > fds_;
+
+
+            static bool enabled() noexcept
+            {
+                static const bool enabled = [] {
+                    auto value = std::getenv( "JB_PERF_COUNTERS" );
+                    return value && *value && std::strcmp( value, "0" ) != 0;
+                }();
+                return enabled;
+            }
+
+
+            static void warn_once( const char* name, int error ) noexcept
+            {
+                static std::once_flag flag;
+                std::call_once( flag, [=] {
+                    std::fprintf( stderr, "perf_counters: %s is not available (%s), such counters are omitted\n", name, std::strerror( error ) );
+                } );
+            }
+
+
+            /** Opens disabled counter for the calling thread, any CPU
+
+            @retval file descriptor or -1 if the counter is not available
+            */
+            static int open( const counter_config& config ) noexcept
+            {
+                perf_event_attr attr{};
+                attr.size = sizeof( attr );
+                attr.type = config.type_;
+                attr.config = config.config_;
+                attr.disabled = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+                auto fd = static_cast< int >( ::syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 ) );
+
+                // unprivileged process may be allowed to count user space only
+                if ( fd < 0 && ( errno == EACCES || errno == EPERM ) )
+                {
+                    attr.exclude_kernel = 1;
+                    fd = static_cast< int >( ::syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 ) );
+                }
+
+                if ( fd < 0 )
+                {
+                    warn_once( config.name_, errno );
+                }
+
+                return fd;
+            }
+
+
+            /** Reads a counter, extrapolates the value if the counter was multiplexed
+
+            @retval the value or -1 if it cannot be read
+            */
+            static double read( int fd ) noexcept
+            {
+                uint64_t values[ 3 ]; // value, time enabled, time running
+
+                if ( ::read( fd, values, sizeof( values ) ) != static_cast< ssize_t >( sizeof( values ) ) || !values[ 2 ] )
+                {
+                    return -1;
+                }
+
+                return static_cast< double >( values[ 0 ] ) * values[ 1 ] / values[ 2 ];
+            }
+
+        public:
+
+            explicit perf_counters( ::benchmark::State& state ) noexcept : state_( state )
+            {
+                fds_.fill( -1 );
+                if ( !enabled() ) return;
+
+                for ( size_t i = 0; i < configs_.size(); ++i ) fds_[ i ] = open( configs_[ i ] );
+                for ( auto fd : fds_ ) if ( fd >= 0 ) ::ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+            }
+
+            perf_counters( perf_counters&& ) = delete;
+
+            ~perf_counters()
+            {
+                for ( auto fd : fds_ ) if ( fd >= 0 ) ::ioctl( fd, PERF_EVENT_IOC_DISABLE, 0 );
+
+                for ( size_t i = 0; i < configs_.size(); ++i )
+                {
+                    if ( fds_[ i ] < 0 ) continue;
+
+                    if ( auto value = read( fds_[ i ] ); value >= 0 )
+                    {
+                        // summed over threads then divided by iterations of all threads
+                        state_.counters[ configs_[ i ].name_ ] = ::benchmark::Counter( value, ::benchmark::Counter::kAvgIterations );
+                    }
+
+                    ::close( fds_[ i ] );
+                }
+            }
+#else
+        public:
+
+            explicit perf_counters( ::benchmark::State& ) noexcept {}
+
+            perf_counters( perf_counters&& ) = delete;
+#endif
+        };
+    }
+}
+
+#endif
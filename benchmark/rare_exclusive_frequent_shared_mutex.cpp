@@ -0,0 +1,86 @@
+#include <benchmark/benchmark.h>
+#include <jb/rare_exclusive_frequent_shared_mutex.h>
+#include "perf_counters.h"
+#include "thread_sweep.h"
+#include <thread>
+
+
+namespace jb
+{
+    namespace benchmark
+    {
+        /** Takes and releases shared lock, nobody takes exclusive one
+
+        @tparam SharedLockCount - number of shared lock slots, 0 for per-CPU slots
+        */
+        template < size_t SharedLockCount >
+        static void mutex_shared_lock( ::benchmark::State& state )
+        {
+            using mutex = details::rare_exclusive_frequent_shared_mutex< SharedLockCount >;
+            static mutex mtx;
+
+            auto id = std::this_thread::get_id();
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                typename mutex::shared_lock lock( mtx, id );
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK_TEMPLATE( mutex_shared_lock, 31 )->Apply( thread_sweep );
+        BENCHMARK_TEMPLATE( mutex_shared_lock, 0 )->Apply( thread_sweep );
+
+
+        /** Takes shared lock, each state.range( 0 )-th lock is exclusive
+
+        @tparam SharedLockCount - number of shared lock slots, 0 for per-CPU slots
+        */
+        template < size_t SharedLockCount >
+        static void mutex_mixed_lock( ::benchmark::State& state )
+        {
+            using mutex = details::rare_exclusive_frequent_shared_mutex< SharedLockCount >;
+            static mutex mtx;
+
+            auto id = std::this_thread::get_id();
+            auto period = static_cast< size_t >( state.range( 0 ) );
+            size_t i = 0;
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                if ( ++i % period )
+                {
+                    typename mutex::shared_lock lock( mtx, id );
+                }
+                else
+                {
+                    typename mutex::unique_lock lock( mtx );
+                }
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK_TEMPLATE( mutex_mixed_lock, 31 )->Arg( 1000 )->Arg( 100 )->Apply( thread_sweep );
+        BENCHMARK_TEMPLATE( mutex_mixed_lock, 0 )->Arg( 1000 )->Arg( 100 )->Apply( thread_sweep );
+
+
+        /** Takes and releases exclusive lock only
+        */
+        static void mutex_exclusive_lock( ::benchmark::State& state )
+        {
+            using mutex = details::rare_exclusive_frequent_shared_mutex<>;
+            static mutex mtx;
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                mutex::unique_lock lock( mtx );
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK( mutex_exclusive_lock )->Apply( thread_sweep );
+    }
+}
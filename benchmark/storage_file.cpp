@@ -0,0 +1,73 @@
+#include <benchmark/benchmark.h>
+#include "temporary_file.h"
+#include "perf_counters.h"
+#include "thread_sweep.h"
+
+
+namespace jb
+{
+    namespace benchmark
+    {
+        static constexpr size_t page_count = 1024;
+
+
+        /** Maps and unmaps pages of the file, each thread walks the pages from its own starting point
+        */
+        static void storage_file_map_page( ::benchmark::State& state )
+        {
+            static temporary_file file( "./benchmark_map_page.jb", page_count );
+
+            auto page_size = temporary_file::storage_file::page_size();
+            size_t page = state.thread_index() * 7919;
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                auto area = file->map_page( ( page++ % page_count ) * page_size );
+                ::benchmark::DoNotOptimize( area.get() );
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK( storage_file_map_page )->Apply( thread_sweep );
+
+
+        /** Reads the file size, that is what each page access validates the offset against
+        */
+        static void storage_file_size( ::benchmark::State& state )
+        {
+            static temporary_file file( "./benchmark_size.jb", 1 );
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                ::benchmark::DoNotOptimize( file->size() );
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+        }
+        BENCHMARK( storage_file_size )->Apply( thread_sweep );
+
+
+        /** Grows the file by a page, threads race for each growth: only one of them wins
+
+        The file is sparse, so the growth does not consume disk space
+        */
+        static void storage_file_grow( ::benchmark::State& state )
+        {
+            static temporary_file file( "./benchmark_grow.jb", 1 );
+
+            size_t grown = 0;
+
+            perf_counters perf( state );
+            for ( auto _ : state )
+            {
+                grown += file->grow( file->size() ) ? 1 : 0;
+            }
+
+            state.SetItemsProcessed( state.iterations() );
+            state.counters[ "grown" ] = ::benchmark::Counter( static_cast< double >( grown ), ::benchmark::Counter::kIsRate );
+        }
+        BENCHMARK( storage_file_grow )->Apply( thread_sweep );
+    }
+}
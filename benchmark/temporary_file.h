@@ -0,0 +1,67 @@
+#ifndef __JB__BENCHMARK__TEMPORARY_FILE__H__
+#define __JB__BENCHMARK__TEMPORARY_FILE__H__
+
+
+#include <jb/storage.h>
+#include <jb/storage_file.h>
+#include <filesystem>
+
+
+namespace jb
+{
+    namespace benchmark
+    {
+        /** Storage file shared by all threads of a benchmark, removed from disk on destruction
+
+        Benchmarked threads keep the instance as function-local static, so it's created once by the first thread
+        and survives thread count sweep
+
+        @tparam Policies - storage settings
+        */
+        template < typename Policies >
+        class basic_temporary_file
+        {
+        public:
+
+            using storage_file = details::storage_file< Policies >;
+
+        private:
+
+            struct remover
+            {
+                std::filesystem::path path_;
+
+                ~remover()
+                {
+                    std::error_code ec;
+                    std::filesystem::remove( path_, ec );
+                }
+            };
+
+            remover remover_;   // must precede file_, cuz the file must be closed before removal
+            storage_file file_;
+
+        public:
+
+            /** Creates the file and grows it up to given number of pages
+
+            @param [in] path - file path
+            @param [in] page_count - number of pages
+            */
+            basic_temporary_file( const char* path, size_t page_count )
+                : remover_{ path }
+                , file_( std::filesystem::path( path ) )
+            {
+                while ( file_.size() < page_count * storage_file::page_size() ) file_.grow( file_.size() );
+            }
+
+            storage_file& operator * () noexcept { return file_; }
+            storage_file* operator -> () noexcept { return &file_; }
+        };
+
+
+        using temporary_file = basic_temporary_file< default_policies >;
+    }
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __JB__BENCHMARK__THREAD_SWEEP__H__
+#define __JB__BENCHMARK__THREAD_SWEEP__H__
+
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <thread>
+
+
+namespace jb
+{
+    namespace benchmark
+    {
+        /** Runs a benchmark with 1, 2, 4, ... threads up to twice the number of hardware threads
+
+        Oversubscription is included deliberately: a lock holder preempted by the system is the case spin loops
+        behave worst at
+
+        @param [in/out] b - the benchmark
+        */
+        inline void thread_sweep( ::benchmark::internal::Benchmark* b )
+        {
+            int limit = 2 * static_cast< int >( std::max( 1u, std::thread::hardware_concurrency() ) );
+
+            for ( int threads = 1; threads < limit; threads *= 2 ) b->Threads( threads );
+            b->Threads( limit );
+            b->UseRealTime();
+        }
+    }
+}
+
+#endif
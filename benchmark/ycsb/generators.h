@@ -0,0 +1,130 @@
+#ifndef __JB__BENCHMARK__YCSB__GENERATORS__H__
+#define __JB__BENCHMARK__YCSB__GENERATORS__H__
+
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+
+namespace jb
+{
+    namespace ycsb
+    {
+        /** FNV-1a hash of a 64-bit number, scatters key numbers over the key space the same way YCSB does
+        */
+        inline uint64_t fnv_hash( uint64_t value ) noexcept
+        {
+            uint64_t hash = 0xcbf29ce484222325ULL;
+
+            for ( size_t i = 0; i < 8; ++i )
+            {
+                hash ^= value & 0xff;
+                hash *= 0x100000001b3ULL;
+                value >>= 8;
+            }
+
+            return hash;
+        }
+
+
+        /** Draws numbers from [0, n) following Zipfian distribution, small numbers are the popular ones
+
+        Implements the algorithm from "Quickly Generating Billion-Record Synthetic Databases" (Gray et al.), the one
+        YCSB uses. Zeta constant is computed once for the given item count, O(n) at construction
+        */
+        class zipfian
+        {
+            uint64_t items_;
+            double theta_;
+            double zeta_n_;
+            double alpha_;
+            double eta_;
+
+            static double zeta( uint64_t n, double theta ) noexcept
+            {
+                double sum = 0;
+                for ( uint64_t i = 1; i <= n; ++i ) sum += 1 / std::pow( static_cast< double >( i ), theta );
+                return sum;
+            }
+
+        public:
+
+            static constexpr double default_theta = 0.99;
+
+            explicit zipfian( uint64_t items, double theta = default_theta ) noexcept
+                : items_( items ? items : 1 )
+                , theta_( theta )
+                , zeta_n_( zeta( items_, theta_ ) )
+                , alpha_( 1 / ( 1 - theta_ ) )
+                , eta_( ( 1 - std::pow( 2.0 / items_, 1 - theta_ ) ) / ( 1 - zeta( 2, theta_ ) / zeta_n_ ) )
+            {}
+
+            uint64_t items() const noexcept { return items_; }
+
+            template < typename Random >
+            uint64_t operator()( Random& random ) const noexcept
+            {
+                auto u = std::uniform_real_distribution< double >( 0, 1 )( random );
+                auto uz = u * zeta_n_;
+
+                if ( uz < 1 ) return 0;
+                if ( uz < 1 + std::pow( 0.5, theta_ ) ) return 1;
+
+                auto result = static_cast< uint64_t >( items_ * std::pow( eta_ * u - eta_ + 1, alpha_ ) );
+                return result < items_ ? result : items_ - 1;
+            }
+        };
+
+
+        /** Key number distributions of the YCSB core workloads
+
+        The key space grows with inserts, so each chooser draws from [0, count) where count is the number of
+        inserted keys at the moment
+        */
+        enum class distribution
+        {
+            uniform,    // every key is equally popular
+            zipfian,    // popular keys are scattered over the key space
+            latest      // the most recently inserted keys are the popular ones
+        };
+
+
+        /** Chooses key numbers for read/update/scan operations
+        */
+        class key_chooser
+        {
+            distribution distribution_;
+            zipfian zipfian_;
+
+        public:
+
+            key_chooser( distribution d, uint64_t items ) noexcept
+                : distribution_( d )
+                , zipfian_( items )
+            {}
+
+            template < typename Random >
+            uint64_t operator()( Random& random, uint64_t count ) const noexcept
+            {
+                if ( !count ) return 0;
+
+                switch ( distribution_ )
+                {
+                case distribution::uniform:
+                    return std::uniform_int_distribution< uint64_t >( 0, count - 1 )( random );
+
+                case distribution::zipfian:
+                    return fnv_hash( zipfian_( random ) ) % count;
+
+                case distribution::latest:
+                default:
+                    return count - 1 - zipfian_( random ) % count;
+                }
+            }
+        };
+    }
+}
+
+#endif
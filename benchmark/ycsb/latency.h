@@ -0,0 +1,104 @@
+#ifndef __JB__BENCHMARK__YCSB__LATENCY__H__
+#define __JB__BENCHMARK__YCSB__LATENCY__H__
+
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+
+namespace jb
+{
+    namespace ycsb
+    {
+        /** Log-linear latency histogram: each power of two range splits into 16 buckets, so a percentile is
+            precise within 1/16 of its value whatever the value is
+
+        Owned by a single thread while recording, merged after the run
+        */
+        class latency
+        {
+            static constexpr size_t sub_bits_ = 4;
+            static constexpr size_t sub_count_ = 1 << sub_bits_;
+            static constexpr size_t bucket_count_ = ( 64 - sub_bits_ + 1 ) * sub_count_;
+
+            std::array< uint64_t, bucket_count_ > buckets_{};
+            uint64_t count_ = 0;
+            uint64_t sum_ = 0;
+            uint64_t max_ = 0;
+
+
+            static size_t bucket( uint64_t ns ) noexcept
+            {
+                if ( ns < sub_count_ ) return static_cast< size_t >( ns );
+
+                size_t shift = 0;
+                for ( auto v = ns >> sub_bits_; v > 1; v >>= 1 ) ++shift;
+                return ( shift + 1 ) * sub_count_ + static_cast< size_t >( ( ns >> shift ) & ( sub_count_ - 1 ) );
+            }
+
+
+            static uint64_t upper_bound( size_t bucket ) noexcept
+            {
+                if ( bucket < sub_count_ ) return bucket;
+
+                size_t shift = bucket / sub_count_ - 1;
+                return ( ( sub_count_ + bucket % sub_count_ + 1 ) << shift ) - 1;
+            }
+
+        public:
+
+            /** Records a latency
+
+            @param [in] ns - latency, nanoseconds
+            */
+            void record( uint64_t ns ) noexcept
+            {
+                ++buckets_[ bucket( ns ) ];
+                ++count_;
+                sum_ += ns;
+                max_ = std::max( max_, ns );
+            }
+
+
+            /** Adds another histogram to this one
+            */
+            latency& operator += ( const latency& other ) noexcept
+            {
+                for ( size_t i = 0; i < bucket_count_; ++i ) buckets_[ i ] += other.buckets_[ i ];
+                count_ += other.count_;
+                sum_ += other.sum_;
+                max_ = std::max( max_, other.max_ );
+                return *this;
+            }
+
+
+            uint64_t count() const noexcept { return count_; }
+            uint64_t max() const noexcept { return max_; }
+            double mean() const noexcept { return count_ ? static_cast< double >( sum_ ) / count_ : 0; }
+
+
+            /** Provides a percentile
+
+            @param [in] p - percentile, (0, 100]
+            @retval the upper bound of the bucket the percentile falls into, nanoseconds
+            */
+            uint64_t percentile( double p ) const noexcept
+            {
+                auto rank = static_cast< uint64_t >( p / 100 * count_ + 0.5 );
+                rank = std::clamp< uint64_t >( rank, 1, std::max< uint64_t >( count_, 1 ) );
+
+                uint64_t seen = 0;
+                for ( size_t i = 0; i < bucket_count_; ++i )
+                {
+                    seen += buckets_[ i ];
+                    if ( seen >= rank ) return std::min( upper_bound( i ), max_ );
+                }
+
+                return max_;
+            }
+        };
+    }
+}
+
+#endif
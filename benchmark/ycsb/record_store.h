@@ -0,0 +1,139 @@
+#ifndef __JB__BENCHMARK__YCSB__RECORD_STORE__H__
+#define __JB__BENCHMARK__YCSB__RECORD_STORE__H__
+
+
+#include <jb/version_chain.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+
+namespace jb
+{
+    namespace ycsb
+    {
+        /** In-memory records of a physical volume
+
+        storage<> has no record operations yet, so the driver keeps the records of each physical volume it opens in
+        an ordered index of version chains (see version_chain) sequenced by a snapshot registry of its own: a read
+        goes through a snapshot and waits for writers only for the index lookup, a write takes its commit ticket
+        under the index lock, so versions of each record get pushed in sequence order.
+
+        A scan copies the records it lists, so the stream holds no lock and its owner is free to write to the same
+        store while iterating
+
+        @tparam Key - physical key type
+        @tparam Value - value type
+        @tparam Registry - snapshot registry (see snapshot_registry)
+        */
+        template < typename Key, typename Value, typename Registry >
+        class record_store
+        {
+            using chain_t = details::version_chain< Value >;
+            using records_t = std::map< Key, std::unique_ptr< chain_t >, std::less<> >;
+
+            mutable std::shared_mutex guard_;
+            records_t records_;
+
+        public:
+
+            /** Ordered stream of records taken by scan(), see merged_cursor Source concept
+            */
+            class source
+            {
+                std::vector< std::pair< Key, Value > > records_;
+                size_t current_ = 0;
+
+            public:
+
+                explicit source( std::vector< std::pair< Key, Value > >&& records ) noexcept : records_( std::move( records ) ) {}
+
+                bool valid() const noexcept { return current_ < records_.size(); }
+                const Key& key() const noexcept { return records_[ current_ ].first; }
+                bool deleted() const noexcept { return false; }
+                const Value& value() const noexcept { return records_[ current_ ].second; }
+                void next() noexcept { ++current_; }
+            };
+
+
+            /** Reads a record through a snapshot
+
+            @param [in] key - physical key
+            @param [in] sequence - snapshot sequence number
+            @param [out] value - the value
+            @retval false if the snapshot does not see the record
+            @throw std::bad_alloc
+            */
+            bool get( const Key& key, uint64_t sequence, Value& value ) const
+            {
+                std::shared_lock lock( guard_ );
+
+                if ( auto it = records_.find( key ); it != records_.end() )
+                {
+                    if ( auto v = it->second->get( sequence ) )
+                    {
+                        value = *v;
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+
+            /** Puts new version of a record, it becomes visible to snapshots opened after the call returned
+
+            @param [in/out] registry - snapshot registry sequencing the commits
+            @param [in] key - physical key
+            @param [in] value - value
+            @throw std::bad_alloc
+            */
+            void put( Registry& registry, const Key& key, Value&& value )
+            {
+                typename Registry::commit commit;
+                {
+                    std::unique_lock lock( guard_ );
+
+                    auto it = records_.find( key );
+                    if ( it == records_.end() )
+                    {
+                        it = records_.emplace( key, std::make_unique< chain_t >() ).first;
+                    }
+
+                    // the ticket gets published out of the lock, an exception included
+                    commit = registry.begin_commit();
+                    it->second->put( commit.sequence(), std::move( value ) );
+                    it->second->collect( registry.oldest() );
+                }
+            }
+
+
+            /** Takes the records starting with a prefix as a snapshot sees them
+
+            @param [in] prefix - physical key prefix
+            @param [in] sequence - snapshot sequence number
+            @param [in] limit - max number of records to be taken
+            @retval ordered stream of the records
+            @throw std::bad_alloc
+            */
+            source scan( const Key& prefix, uint64_t sequence, size_t limit ) const
+            {
+                std::vector< std::pair< Key, Value > > records;
+
+                std::shared_lock lock( guard_ );
+
+                for ( auto it = records_.lower_bound( prefix ); it != records_.end() && records.size() < limit && !it->first.compare( 0, prefix.size(), prefix ); ++it )
+                {
+                    if ( auto v = it->second->get( sequence ) ) records.emplace_back( it->first, *v );
+                }
+
+                return source( std::move( records ) );
+            }
+        };
+    }
+}
+
+#endif
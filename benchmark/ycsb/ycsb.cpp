@@ -0,0 +1,487 @@
+/** YCSB-style end-to-end workload driver for storage<>
+
+Opens physical volumes through storage::open_physical_volume(), mounts each of them to its own logical path of
+a virtual volume, loads the records and runs a mix of operations over them across threads. Reports throughput
+and latency percentiles per operation.
+
+storage<> has no record operations yet, so the records live in the driver (see record_store.h), one store per
+physical volume, versioned under a snapshot registry of the driver. A scan goes through the merged cursor of the
+virtual volume over the stores of the mounted volumes.
+
+Usage:
+    ycsb [--workload=a|b|c|d|e|f] [--records=N] [--operations=N] [--threads=N] [--volumes=N]
+         [--distribution=uniform|zipfian|latest] [--value-size=N] [--max-scan=N] [--path=DIR]
+         [--read=P] [--update=P] [--scan=P] [--insert=P] [--rmw=P]
+
+A workload sets the proportions and the key distribution of the YCSB core workload with the same letter:
+    a - update heavy: 50% read, 50% update, zipfian
+    b - read mostly: 95% read, 5% update, zipfian
+    c - read only: 100% read, zipfian
+    d - read latest: 95% read, 5% insert, latest
+    e - short ranges: 95% scan, 5% insert, zipfian
+    f - read-modify-write: 50% read, 50% read-modify-write, zipfian
+the options following it override the workload settings.
+
+A record key is "user", the zero-padded group of the record and the record number. The hash of the record number
+picks the group, and the group count follows from the record count so that a group of a volume holds about
+max-scan records. A scan lists the logical keys sharing the group of the chosen key up to the scan length, that is
+the nearest storage<> equivalent of YCSB seek-and-next
+*/
+
+#include <jb/storage.h>
+#include "generators.h"
+#include "latency.h"
+#include "record_store.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace jb
+{
+    namespace ycsb
+    {
+        using storage_t = storage<>;
+        using key_t = typename storage_t::key_t;
+        using value_t = typename storage_t::value_t;
+        using virtual_volume_t = typename storage_t::virtual_volume_t;
+        using physical_volume_t = typename storage_t::physical_volume_t;
+        using mount_point_t = typename storage_t::mount_point_t;
+        using registry_t = details::snapshot_registry< default_policies::snapshot_slot_count, default_policies::backoff >;
+        using snapshot_t = typename registry_t::snapshot;
+        using store_t = record_store< key_t, value_t, registry_t >;
+
+
+        enum operation : size_t
+        {
+            read,
+            update,
+            scan,
+            insert,
+            read_modify_write,
+            operation_count
+        };
+
+        static const char* const operation_names[ operation_count ] = { "READ", "UPDATE", "SCAN", "INSERT", "READ-MODIFY-WRITE" };
+
+
+        /** Run settings
+        */
+        struct settings
+        {
+            std::array< double, operation_count > proportions{ 0.5, 0.5, 0, 0, 0 };
+            distribution key_distribution = distribution::zipfian;
+            uint64_t records = 100000;
+            uint64_t operations = 1000000;
+            size_t threads = std::max( 1u, std::thread::hardware_concurrency() );
+            size_t volumes = 4;
+            size_t value_size = 100;
+            size_t max_scan = 100;
+            std::string path = ".";
+
+
+            /** Applies YCSB core workload settings
+
+            @param [in] workload - workload letter
+            @retval false if the letter is unknown
+            */
+            bool apply_workload( char workload )
+            {
+                switch ( workload )
+                {
+                case 'a': proportions = { 0.5, 0.5, 0, 0, 0 }; key_distribution = distribution::zipfian; return true;
+                case 'b': proportions = { 0.95, 0.05, 0, 0, 0 }; key_distribution = distribution::zipfian; return true;
+                case 'c': proportions = { 1, 0, 0, 0, 0 }; key_distribution = distribution::zipfian; return true;
+                case 'd': proportions = { 0.95, 0, 0, 0.05, 0 }; key_distribution = distribution::latest; return true;
+                case 'e': proportions = { 0, 0, 0.95, 0.05, 0 }; key_distribution = distribution::zipfian; return true;
+                case 'f': proportions = { 0.5, 0, 0, 0, 0.5 }; key_distribution = distribution::zipfian; return true;
+                default: return false;
+                }
+            }
+
+
+            /** Parses command line
+
+            @retval false if the command line is invalid
+            */
+            bool parse( int argc, char** argv )
+            {
+                for ( int i = 1; i < argc; ++i )
+                {
+                    std::string arg = argv[ i ];
+                    auto eq = arg.find( '=' );
+                    if ( arg.compare( 0, 2, "--" ) || eq == std::string::npos ) return false;
+
+                    auto name = arg.substr( 2, eq - 2 );
+                    auto value = arg.substr( eq + 1 );
+                    auto number = [&] { return std::strtoull( value.c_str(), nullptr, 10 ); };
+                    auto share = [&] { return std::strtod( value.c_str(), nullptr ); };
+
+                    if ( name == "workload" ) { if ( value.size() != 1 || !apply_workload( value[ 0 ] ) ) return false; }
+                    else if ( name == "records" ) records = number();
+                    else if ( name == "operations" ) operations = number();
+                    else if ( name == "threads" ) threads = std::max< size_t >( number(), 1 );
+                    else if ( name == "volumes" ) volumes = std::max< size_t >( number(), 1 );
+                    else if ( name == "value-size" ) value_size = number();
+                    else if ( name == "max-scan" ) max_scan = std::max< size_t >( number(), 1 );
+                    else if ( name == "path" ) path = value;
+                    else if ( name == "read" ) proportions[ read ] = share();
+                    else if ( name == "update" ) proportions[ update ] = share();
+                    else if ( name == "scan" ) proportions[ scan ] = share();
+                    else if ( name == "insert" ) proportions[ insert ] = share();
+                    else if ( name == "rmw" ) proportions[ read_modify_write ] = share();
+                    else if ( name == "distribution" )
+                    {
+                        if ( value == "uniform" ) key_distribution = distribution::uniform;
+                        else if ( value == "zipfian" ) key_distribution = distribution::zipfian;
+                        else if ( value == "latest" ) key_distribution = distribution::latest;
+                        else return false;
+                    }
+                    else return false;
+                }
+
+                return true;
+            }
+        };
+
+
+        /** Drives the storage
+        */
+        class driver
+        {
+            const settings& settings_;
+            details::handle< virtual_volume_t > virtual_volume_;
+            registry_t snapshots_;
+            std::vector< std::unique_ptr< store_t > > stores_;
+            std::map< const physical_volume_t*, store_t* > volume_stores_;
+            key_chooser chooser_;
+            std::atomic< uint64_t > next_insert_;
+            std::atomic< uint64_t > inserted_;
+            std::atomic< uint64_t > failed_{ 0 };
+            std::atomic< uint64_t > scanned_{ 0 };
+            uint64_t groups_;
+            size_t group_width_;
+
+
+            /** Builds physical key of a record: the record goes to the key group chosen by hash, the group is
+                zero-padded so that all the keys of a group share the same prefix
+            */
+            key_t physical_key( uint64_t number ) const
+            {
+                auto group = std::to_string( fnv_hash( number ) % groups_ );
+                return "/user" + std::string( group_width_ - group.size(), '0' ) + group + "/" + std::to_string( number );
+            }
+
+
+            /** Builds logical prefix of the key group of a record
+            */
+            key_t group_prefix( uint64_t number ) const
+            {
+                auto k = key( number );
+                k.resize( k.rfind( '/' ) + 1 );
+                return k;
+            }
+
+
+            /** Builds logical key of a record: the record goes to the volume chosen by its number
+            */
+            key_t key( uint64_t number ) const
+            {
+                return "/ycsb/" + std::to_string( number % settings_.volumes ) + physical_key( number );
+            }
+
+
+            /** Provides the store of the volume a record goes to
+            */
+            store_t& store( uint64_t number ) const
+            {
+                return *stores_[ number % settings_.volumes ];
+            }
+
+
+            /** Writes a record
+            */
+            void put( uint64_t number, value_t&& value )
+            {
+                store( number ).put( snapshots_, physical_key( number ), std::move( value ) );
+            }
+
+
+            value_t value( std::minstd_rand& random ) const
+            {
+                std::string v( settings_.value_size, ' ' );
+                for ( auto& c : v ) c = static_cast< char >( 'a' + random() % 26 );
+                return value_t{ std::move( v ) };
+            }
+
+
+            /** Opens snapshot, waits for a free slot if there are more threads than snapshot slots
+            */
+            snapshot_t snapshot()
+            {
+                while ( true )
+                {
+                    if ( auto s = snapshots_.open( std::hash< std::thread::id >{}( std::this_thread::get_id() ) ) ) return s;
+                    std::this_thread::yield();
+                }
+            }
+
+
+            void check( bool succeeded ) noexcept
+            {
+                if ( !succeeded ) failed_.fetch_add( 1, std::memory_order_relaxed );
+            }
+
+
+            void execute( virtual_volume_t& volume, operation op, std::minstd_rand& random )
+            {
+                auto count = inserted_.load( std::memory_order_acquire );
+
+                switch ( op )
+                {
+                case read:
+                {
+                    auto number = chooser_( random, count );
+                    auto s = snapshot();
+                    value_t v;
+                    check( store( number ).get( physical_key( number ), s.sequence(), v ) );
+                    break;
+                }
+
+                case update:
+                    put( chooser_( random, count ), value( random ) );
+                    break;
+
+                case scan:
+                {
+                    auto s = snapshot();
+                    auto k = group_prefix( chooser_( random, count ) );
+
+                    // each mounted volume contributes its records out of the scanned range
+                    auto length = std::uniform_int_distribution< size_t >( 1, settings_.max_scan )( random );
+                    auto [ rc, cursor ] = volume.list( k, [&]( const mount_point_t& mp, const key_t& physical_prefix ) {
+                        return volume_stores_.at( mp.physical_volume().get() )->scan( physical_prefix, s.sequence(), length );
+                    } );
+                    check( RetCode::Ok == rc );
+                    for ( ; cursor.valid() && length; cursor.next(), --length ) scanned_.fetch_add( 1, std::memory_order_relaxed );
+                    break;
+                }
+
+                case insert:
+                {
+                    auto number = next_insert_.fetch_add( 1, std::memory_order_relaxed );
+                    put( number, value( random ) );
+
+                    // the key becomes choosable as soon as all the preceding inserts are done
+                    for ( auto expected = number; !inserted_.compare_exchange_weak( expected, number + 1, std::memory_order_acq_rel ); expected = number )
+                    {
+                        std::this_thread::yield();
+                    }
+                    break;
+                }
+
+                case read_modify_write:
+                {
+                    auto number = chooser_( random, count );
+                    auto s = snapshot();
+                    value_t v;
+                    check( store( number ).get( physical_key( number ), s.sequence(), v ) );
+                    s.release();
+                    put( number, value( random ) );
+                    break;
+                }
+
+                default:
+                    break;
+                }
+            }
+
+        public:
+
+            /** Creates record stores of the volumes
+
+            @param [in] s - run settings
+            @param [in] virtual_volume - virtual volume the physical volumes are mounted to
+            @param [in] physical_volumes - physical volume per record store
+            */
+            driver( const settings& s, const details::handle< virtual_volume_t >& virtual_volume, const std::vector< details::handle< physical_volume_t > >& physical_volumes )
+                : settings_( s )
+                , virtual_volume_( virtual_volume )
+                , chooser_( s.key_distribution, s.records )
+                , next_insert_( s.records )
+                , inserted_( s.records )
+                , groups_( std::max< uint64_t >( s.records / s.volumes / s.max_scan, 1 ) )
+                , group_width_( std::to_string( groups_ - 1 ).size() )
+            {
+                for ( const auto& volume : physical_volumes )
+                {
+                    stores_.push_back( std::make_unique< store_t >() );
+                    volume_stores_.emplace( volume.lock().get(), stores_.back().get() );
+                }
+            }
+
+
+            uint64_t failed() const noexcept { return failed_.load(); }
+            uint64_t scanned() const noexcept { return scanned_.load(); }
+
+
+            /** Loads the records, each thread loads its share
+            */
+            void load()
+            {
+                std::vector< std::thread > threads;
+
+                for ( size_t t = 0; t < settings_.threads; ++t )
+                {
+                    threads.emplace_back( [this, t] {
+                        std::minstd_rand random( static_cast< unsigned >( t + 1 ) );
+
+                        for ( uint64_t i = t; i < settings_.records; i += settings_.threads )
+                        {
+                            put( i, value( random ) );
+                        }
+                    } );
+                }
+
+                for ( auto& t : threads ) t.join();
+            }
+
+
+            /** Runs the operation mix
+
+            @retval latency histogram per operation
+            */
+            std::array< latency, operation_count > run()
+            {
+                std::vector< std::array< latency, operation_count > > latencies( settings_.threads );
+                std::vector< std::thread > threads;
+
+                for ( size_t t = 0; t < settings_.threads; ++t )
+                {
+                    threads.emplace_back( [this, t, &latencies] {
+                        auto volume = virtual_volume_.lock();
+                        std::minstd_rand random( static_cast< unsigned >( 1000 + t ) );
+                        std::discrete_distribution< size_t > choose_op( settings_.proportions.begin(), settings_.proportions.end() );
+
+                        auto share = settings_.operations / settings_.threads + ( t < settings_.operations % settings_.threads ? 1 : 0 );
+                        for ( uint64_t i = 0; i < share; ++i )
+                        {
+                            auto op = static_cast< operation >( choose_op( random ) );
+
+                            auto start = std::chrono::steady_clock::now();
+                            execute( *volume, op, random );
+                            auto ns = std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - start ).count();
+
+                            latencies[ t ][ op ].record( static_cast< uint64_t >( ns ) );
+                        }
+                    } );
+                }
+
+                for ( auto& t : threads ) t.join();
+
+                std::array< latency, operation_count > result;
+                for ( const auto& l : latencies )
+                {
+                    for ( size_t op = 0; op < operation_count; ++op ) result[ op ] += l[ op ];
+                }
+
+                return result;
+            }
+        };
+
+
+        /** Prints the report in YCSB-like format: [SECTION], metric, value
+        */
+        static void report( const char* phase, uint64_t operations, double seconds, const std::array< latency, operation_count >* latencies )
+        {
+            std::cout << "[" << phase << "], RunTime(ms), " << static_cast< uint64_t >( seconds * 1000 ) << "\n";
+            std::cout << "[" << phase << "], Throughput(ops/sec), " << std::fixed << std::setprecision( 1 ) << ( seconds > 0 ? operations / seconds : 0 ) << "\n";
+
+            if ( !latencies ) return;
+
+            for ( size_t op = 0; op < operation_count; ++op )
+            {
+                const auto& l = ( *latencies )[ op ];
+                if ( !l.count() ) continue;
+
+                auto name = operation_names[ op ];
+                std::cout << "[" << name << "], Operations, " << l.count() << "\n";
+                std::cout << "[" << name << "], AverageLatency(us), " << std::setprecision( 3 ) << l.mean() / 1000 << "\n";
+                for ( double p : { 50.0, 95.0, 99.0, 99.9, 99.99 } )
+                {
+                    std::cout << "[" << name << "], " << p << "thPercentileLatency(us), " << l.percentile( p ) / 1000.0 << "\n";
+                }
+                std::cout << "[" << name << "], MaxLatency(us), " << l.max() / 1000.0 << "\n";
+            }
+        }
+    }
+}
+
+
+int main( int argc, char** argv )
+{
+    using namespace jb;
+    using namespace jb::ycsb;
+
+    settings s;
+    if ( !s.parse( argc, argv ) )
+    {
+        std::cerr << "Invalid command line, see the header of ycsb.cpp for usage\n";
+        return 1;
+    }
+
+    auto [ rc, virtual_volume ] = storage_t::open_virtual_volume();
+    if ( RetCode::Ok != rc )
+    {
+        std::cerr << "Unable to open virtual volume: " << static_cast< int >( rc ) << "\n";
+        return 1;
+    }
+
+    std::vector< details::handle< physical_volume_t > > physical_volumes;
+    for ( size_t i = 0; i < s.volumes; ++i )
+    {
+        auto [ rc_open, physical_volume ] = storage_t::open_physical_volume( std::filesystem::path( s.path ) / ( "ycsb_" + std::to_string( i ) + ".jb" ) );
+        if ( RetCode::Ok != rc_open )
+        {
+            std::cerr << "Unable to open physical volume: " << static_cast< int >( rc_open ) << "\n";
+            return 1;
+        }
+
+        auto [ rc_mount, mp ] = virtual_volume.lock()->mount( physical_volume, "/", "/ycsb/" + std::to_string( i ) + "/" );
+        if ( RetCode::Ok != rc_mount )
+        {
+            std::cerr << "Unable to mount physical volume: " << static_cast< int >( rc_mount ) << "\n";
+            return 1;
+        }
+
+        physical_volumes.push_back( physical_volume );
+    }
+
+    driver d( s, virtual_volume, physical_volumes );
+
+    auto start = std::chrono::steady_clock::now();
+    d.load();
+    auto load_time = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+    report( "LOAD", s.records, load_time, nullptr );
+
+    start = std::chrono::steady_clock::now();
+    auto latencies = d.run();
+    auto run_time = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+    report( "OVERALL", s.operations, run_time, &latencies );
+
+    std::cout << "[OVERALL], Failed, " << d.failed() << "\n";
+    std::cout << "[OVERALL], ScannedRecords, " << d.scanned() << "\n";
+
+    storage_t::close_all();
+
+    return 0;
+}
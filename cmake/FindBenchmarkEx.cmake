@@ -0,0 +1,86 @@
+cmake_minimum_required( VERSION 3.13 )
+
+#
+# try find Google Benchmark as installed target
+#
+find_package( benchmark QUIET )
+
+#
+# if Google Benchmark is not installed
+#
+if ( NOT benchmark_FOUND )
+
+    #
+    # define path for Google Benchmark as external project
+    #
+    set( external_dir ${PROJECT_SOURCE_DIR}/externals )
+    set( benchmark_dir ${external_dir}/benchmark )
+
+    #
+    # try to find Google Benchmark sources in externals
+    #
+    find_path( BENCHMARK_CMAKE CMakeLists.txt HINTS ${benchmark_dir} )
+
+    if (  ${BENCHMARK_CMAKE} STREQUAL BENCHMARK_CMAKE-NOTFOUND )
+
+        #
+        # if Google Benchmark sources is not found but downloading allowed...
+        #
+        if( ${DOWNLOAD_EXTERNALS} )
+
+            #
+            # make sure ./externals folder exists and does not contain benchmark folder
+            #
+            file( MAKE_DIRECTORY ${external_dir} )
+            file( REMOVE_RECURSE ${benchmark_dir} )
+
+            #
+            # gonna use Git to download Google Benchmark from Github
+            #
+            find_package( Git )
+            if ( NOT Git_FOUND )
+                message( FATAL_ERROR "Unable to locate Git package!" )
+            endif()
+
+            #
+            # download Google Benchmark
+            #
+            execute_process(
+                COMMAND ${GIT_EXECUTABLE} clone https://github.com/google/benchmark
+                WORKING_DIRECTORY ${external_dir}
+                TIMEOUT 14400
+                RESULT_VARIABLE git_result
+            )
+
+            if ( NOT git_result EQUAL 0 )
+                message( FATAL_ERROR "Unable to download Google Benchmark library!" )
+            endif()
+
+        else()
+
+            #
+            # nothing we can do
+            #
+            message( FATAL_ERROR "\nUnable to locate Google Benchmark library!\nMake sure it presents on the host and benchmark_DIR variable points actual location\nOR\nuse -DDOWNLOAD_EXTERNALS=ON option to deploy it automatically...\n" )
+
+        endif()
+
+    endif()
+
+    #
+    # suppress testing of Google Benchmark, it also makes GTest unnecessary
+    #
+    set( BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE )
+    set( BENCHMARK_ENABLE_INSTALL OFF CACHE BOOL "" FORCE )
+
+    #
+    # add Google Benchmark project
+    #
+    add_subdirectory( ${benchmark_dir} )
+
+    #
+    # for multiple-configuration place Google Benchmark targets to 'externals' folder
+    #
+    set_target_properties( benchmark benchmark_main PROPERTIES FOLDER externals )
+
+endif()
@@ -0,0 +1,16 @@
+#ifndef __JB__ACCESS_MODE__H__
+#define __JB__ACCESS_MODE__H__
+
+namespace jb
+{
+    /** Defines how a storage file is shared between processes
+    */
+    enum class AccessMode
+    {
+        Exclusive = 0,  // the only process opens the file for reading and writing
+        Writer,         // the only writer process, reader processes could map the file at the same time
+        Reader          // one of reader processes, maps the file read-only
+    };
+}
+
+#endif
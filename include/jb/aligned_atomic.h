@@ -2,6 +2,7 @@
 #define __JB__ALIGNED_ATOMIC__H__
 
 
+#include "parking.h"
 #include <atomic>
 #include <new>
 
@@ -16,16 +17,17 @@ namespace jb
 
         @tparam T - type to be hold as atomic
         @tparam A - the holder type, used for testing
+        @tparam Alignment - alignment of the holder, a cache line unless a layout packs atomics tighter (see layout.h)
         */
-        template < typename T, typename A = std::atomic< T > >
+        template < typename T, typename A = std::atomic< T >, size_t Alignment = std::hardware_destructive_interference_size >
         class aligned_atomic
         {
-            alignas( std::hardware_destructive_interference_size ) A a_ = 0;
+            alignas( Alignment ) A a_ = 0;
 
         public:
 
             aligned_atomic() noexcept = default;
-            constexpr aligned_atomic( T desired ) noexcept : a_( T ) {}
+            constexpr aligned_atomic( T desired ) noexcept : a_( desired ) {}
 
             /** Wraps std::atomic< T >::store() method */
             template < typename... Args >
@@ -86,6 +88,12 @@ namespace jb
             auto fetch_xor( Args&&... args ) noexcept { return a_.fetch_xor( std::forward< Args >( args )... ); }
             template < typename... Args >
             auto fetch_xor( Args&&... args ) volatile noexcept { return a_.fetch_xor( std::forward< Args >( args )... ); }
+
+            /** Emulates C++20 std::atomic< T >::wait() method, see park() */
+            void wait( T old ) const noexcept { park( a_, old ); }
+
+            /** Emulates C++20 std::atomic< T >::notify_all() method, see unpark_all() */
+            void notify_all() noexcept { unpark_all( a_ ); }
         };
     }
 }
@@ -0,0 +1,110 @@
+#ifndef __JB__BACKOFF__H__
+#define __JB__BACKOFF__H__
+
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#if defined( _MSC_VER )
+#   include <intrin.h>
+#endif
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Implements waiting strategy for spin loops: exponential pausing, then yielding, then sleeping
+
+        A waiter calls the instance once per failed attempt. First attempts execute CPU pause instruction
+        1, 2, 4, ... up to PauseLimit times, that lets SMT sibling run and keeps the core off the memory bus
+        while the awaited cache line stays owned by another core. Then YieldLimit attempts give the core to other
+        threads, and finally the waiter parks by sleeping for SleepTime microseconds per attempt, so a waiter for a
+        preempted owner does not burn CPU at all.
+
+        The strategy is a compile-time setting (Policies::backoff), so it can be tuned per deployment
+
+        @tparam PauseLimit - max number of pause instructions per attempt
+        @tparam YieldLimit - number of yielding attempts
+        @tparam SleepTime - sleep time per parked attempt, microseconds
+        */
+        template < size_t PauseLimit = 64, size_t YieldLimit = 16, size_t SleepTime = 50 >
+        class backoff
+        {
+            static_assert( PauseLimit );
+
+            size_t pauses_ = 1;
+            size_t yields_ = 0;
+
+        public:
+
+            /** Executes CPU pause (spin-wait hint) instruction
+
+            @throw nothing
+            */
+            static void pause() noexcept
+            {
+#if defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+                _mm_pause();
+#elif defined( _MSC_VER ) && defined( _M_ARM64 )
+                __yield();
+#elif defined( __i386__ ) || defined( __x86_64__ )
+                __builtin_ia32_pause();
+#elif defined( __aarch64__ ) || defined( __arm__ )
+                asm volatile( "yield" ::: "memory" );
+#else
+                std::atomic_signal_fence( std::memory_order_seq_cst );
+#endif
+            }
+
+
+            /** Checks if the waiter is still at pausing stage, a caller having its own way to park (e.g. futex)
+                should stop spinning as soon as the stage is over
+
+            @retval true if next attempt is going to pause
+            @throw nothing
+            */
+            bool spinning() const noexcept
+            {
+                return pauses_ <= PauseLimit;
+            }
+
+
+            /** Waits a bit longer than on previous call
+
+            @throw nothing
+            */
+            void operator()() noexcept
+            {
+                if ( pauses_ <= PauseLimit )
+                {
+                    for ( size_t i = 0; i < pauses_; ++i ) pause();
+                    pauses_ <<= 1;
+                }
+                else if ( yields_ < YieldLimit )
+                {
+                    ++yields_;
+                    std::this_thread::yield();
+                }
+                else
+                {
+                    std::this_thread::sleep_for( std::chrono::microseconds( SleepTime ) );
+                }
+            }
+
+
+            /** Restarts the strategy from the pausing stage
+
+            @throw nothing
+            */
+            void reset() noexcept
+            {
+                pauses_ = 1;
+                yields_ = 0;
+            }
+        };
+    }
+}
+
+#endif
@@ -3,7 +3,13 @@
 
 
 #include "aligned_atomic.h"
+#include "epoch.h"
+#include "magazine_depot.h"
+#include "numa.h"
+#include <boost/smart_ptr/intrusive_ptr.hpp>
+#include <memory>
 #include <memory_resource>
+#include <mutex>
 #include <thread>
 
 
@@ -11,6 +17,39 @@ namespace jb
 {
     namespace details
     {
+        /** Keeps mapped pages of storage file
+
+        Pages are kept in bucket chains ordered by offset, a walker holds ownership over the link it stays on
+        (hand-over-hand, the lowest bit of the link marks it owned). A page gets unlinked as soon as nobody refers
+        to it and goes to unused pages to be recycled for another offset.
+
+        Recycling is deferred with epoch-based reclamation: every walker and every releaser pins the cache epoch,
+        an unlinked page gets retired and becomes unused only when all the threads that could have seen it have
+        unpinned. That closes ABA hazard: a thread still keeping a raw pointer to the page never observes it
+        recycled with another offset. Pinning touches a counter in a cache line shared only with threads hashed to
+        the same slot, readers never wait for writers. Releasers retire pages in per-thread batches and reclaim a
+        whole batch at once (see epoch), so a released page comes back to unused pages with some delay.
+
+        Unused pages are kept in per-thread magazines (see magazine_depot), so a miss does not contend on a single
+        list head. When there is no unused page at all a whole magazine of pages gets allocated at once, so the
+        allocator lock is taken once per page_batch_ new pages.
+
+        The cache is sharded per NUMA node: each node has its own buckets, unused pages, allocator and epoch, and
+        a thread looks pages up only in the shard of the node it runs on. A shard gets created by the first thread
+        coming from its node, so the shard and its page descriptors are first touched (i.e. placed) node-locally.
+        A page used from several nodes gets a descriptor in each of them: hot pages are replicated, while the data
+        stays single as all the descriptors map the same file page. A thread migrating while holding a page keeps
+        working with the page's home shard, the only cost is a remote access
+
+        Hot pages (B-tree roots and upper inner nodes) could be taken through a small per-thread direct-mapped
+        cache (see get_cached_page()), a hit writes nothing but the thread's epoch pin. Thread cache entries keep
+        no references, so they never keep a page from leaving the cache: an entry remembers the page and its
+        generation, that changes each time the page gets unlinked, and a hit is valid only while the generation
+        stays the same. An entry of another (e.g. destroyed) cache never matches thanks to the cache serial number
+
+        Memory taken by page descriptors is traded against false sharing between their users by Policies::layout,
+        see layout.h
+        */
         template < typename Policies >
         class storage_file< Policies >::cache
         {
@@ -18,84 +57,355 @@ namespace jb
         public:
 
             class mapped_page;
+            using mapped_page_ptr = boost::intrusive_ptr< mapped_page >;
 
         private:
 
-            static constexpr size_t bucket_count_ = 41;
-            static constexpr uintptr_t owned_ = 1;
+            class shard;
+
+            /** Entry of thread cache: a page of some cache and the page generation it was seen with, holds no
+                reference
+            */
+            struct thread_cache_entry
+            {
+                uint64_t serial_ = 0;
+                size_t offset_ = 0;
+                mapped_page* page_ = nullptr;
+                uint32_t generation_ = 0;
+            };
+
+
+            /** Provides serial number for a new cache, makes thread cache entries of a destroyed cache never match
+                a cache created at the same address
+            */
+            static uint64_t next_serial() noexcept
+            {
+                static std::atomic< uint64_t > serial = 0;
+                return serial.fetch_add( 1, std::memory_order_relaxed ) + 1;
+            }
+
 
             storage_file& file_;
-            std::pmr::monotonic_buffer_resource monotonic_buffer_;
-            std::pmr::polymorphic_allocator< mapped_page > allocator_;
-            std::array< aligned_atomic< uintptr_t >, bucket_count_ > used_pages_;
-            aligned_atomic< uintptr_t > unused_pages_;
-            aligned_atomic< size_t > size_, used_;
+            size_t shard_count_;
+            std::unique_ptr< aligned_atomic< shard* >[] > shards_;
+            uint64_t serial_;
+
+
+            /** Provides shard of the NUMA node calling thread runs on, creates it if necessary
+
+            @throw std::bad_alloc
+            */
+            shard& local_shard()
+            {
+                auto& slot = shards_[ shard_count_ > 1 ? numa::current_node() % shard_count_ : 0 ];
+
+                if ( auto s = slot.load( std::memory_order_acquire ) ) return *s;
+
+                // the first thread from the node makes up the shard
+                auto s = std::make_unique< shard >( file_ );
+                shard* expected = nullptr;
+                if ( slot.compare_exchange_strong( expected, s.get(), std::memory_order_acq_rel ) ) return *s.release();
+
+                return *expected;
+            }
+
+
+            /** Visits all created shards
+
+            @param [in] fn - callable( shard& )
+            */
+            template < typename Fn >
+            void for_each_shard( Fn&& fn ) const
+            {
+                for ( size_t i = 0; i < shard_count_; ++i )
+                {
+                    if ( auto s = shards_[ i ].load( std::memory_order_acquire ) ) fn( *s );
+                }
+            }
 
         public:
 
-            class mapped_page;
-            using mapped_page_ptr = typename mapped_page::mapped_page_ptr;
+            /** Page taken through the thread cache, see get_cached_page()
+
+            A hit does not refer to the page: the pin of the page's shard epoch keeps it from being recycled, so the
+            handle is meant for a short use (e.g. a step of B-tree descent) and delays recycling of unused pages of
+            the shard while it lives
+            */
+            class cached_page
+            {
+                friend class cache;
+
+                typename epoch<>::guard pin_;
+                mapped_page* page_ = nullptr;
+                mapped_page_ptr owner_;
+
+            public:
+
+                cached_page() noexcept = default;
+                cached_page( cached_page&& ) noexcept = default;
+                cached_page& operator = ( cached_page&& ) noexcept = default;
+
+                mapped_page* get() const noexcept { return page_; }
+                mapped_page* operator -> () const noexcept { assert( page_ ); return page_; }
+                mapped_page& operator * () const noexcept { assert( page_ ); return *page_; }
+                explicit operator bool() const noexcept { return page_; }
+            };
+
 
             cache() = delete;
             cache( cache&& ) = delete;
 
             explicit cache( storage_file& file )
                 : file_( file )
-                , monotonic_buffer_()
-                , allocator_( &monotonic_buffer_ )
-            {}
+                , shard_count_( numa::node_count() )
+                , shards_( std::make_unique< aligned_atomic< shard* >[] >( shard_count_ ) )
+                , serial_( next_serial() )
+            {
+                for ( size_t i = 0; i < shard_count_; ++i ) shards_[ i ].store( nullptr, std::memory_order_relaxed );
+            }
 
-            size_t size() const noexcept { return size_.load( std::memory_order_acquire ); }
-            size_t used() const noexcept { return used_.load( std::memory_order_acquire ); }
+            /** Destructor, destroys the shards, nobody must refer the pages anymore
+            */
+            ~cache()
+            {
+                for_each_shard( []( shard& s ) { delete &s; } );
+            }
+
+            size_t shard_count() const noexcept { return shard_count_; }
 
-            template < typename... Args >
-            mapped_page* new_page( Args&&... args )
+            size_t size() const noexcept
             {
-                try
+                size_t result = 0;
+                for_each_shard( [&]( const shard& s ) { result += s.size(); } );
+                return result;
+            }
+
+            size_t used() const noexcept
+            {
+                size_t result = 0;
+                for_each_shard( [&]( const shard& s ) { result += s.used(); } );
+                return result;
+            }
+
+
+            /** Provides a page for given offset from the shard of calling thread's NUMA node
+
+            @param [in] offset - page offset
+            @retval the page
+            @throw std::bad_alloc
+            */
+            mapped_page_ptr get_mapped_page( size_t offset )
+            {
+                return local_shard().get_mapped_page( offset );
+            }
+
+
+            /** Provides a page for given offset through the thread cache
+
+            A hit pins the epoch of the page's shard and checks the page generation, it neither walks a bucket nor
+            changes the page reference counter. A miss takes the page from the cache and refers to it
+
+            @param [in] offset - page offset
+            @retval the page
+            @throw std::bad_alloc
+            */
+            cached_page get_cached_page( size_t offset )
+            {
+                static thread_local std::array< thread_cache_entry, Policies::thread_page_cache_size > thread_cache;
+
+                auto& entry = thread_cache[ ( offset / file_.page_size() ) % thread_cache.size() ];
+                cached_page result;
+
+                // page descriptors live as long as their cache, so the entry of this cache could be dereferenced
+                if ( entry.serial_ == serial_ && entry.offset_ == offset )
                 {
-                    auto p = allocator_->allocate( 1 );
-                    assert( p );
-                    //
-                    allocator_->construct( p, std::forward< Args >( args )... );
-                    //
-                    return p
+                    // the page could not be recycled after the pin, so it is still ours if it was not unlinked yet
+                    result.pin_ = entry.page_->shard_.pin();
+                    if ( entry.page_->generation_.load( std::memory_order_seq_cst ) == entry.generation_ )
+                    {
+                        result.page_ = entry.page_;
+                        return result;
+                    }
+
+                    result.pin_ = typename epoch<>::guard();
                 }
-                catch ( ... )
+
+                result.owner_ = get_mapped_page( offset );
+                result.page_ = result.owner_.get();
+                entry = thread_cache_entry{ serial_, offset, result.page_, result.page_->generation_.load( std::memory_order_seq_cst ) };
+
+                return result;
+            }
+        };
+
+
+        /** Keeps mapped pages of a NUMA node, see cache
+        */
+        template < typename Policies >
+        class storage_file< Policies >::cache::shard
+        {
+            friend class mapped_page;
+
+            static constexpr size_t bucket_count_ = 41;
+            static constexpr uintptr_t owned_ = 1;
+            static constexpr size_t page_batch_ = 16;
+
+            /** Head of bucket chain, stays on its own cache line whatever the layout: there are few of them and
+                every walker owns one
+            */
+            struct alignas( std::hardware_destructive_interference_size ) bucket_head
+            {
+                std::atomic< uintptr_t > link_ = 0;
+            };
+
+            storage_file& file_;
+            std::mutex allocation_guard_;
+            std::pmr::monotonic_buffer_resource monotonic_buffer_;
+            std::pmr::polymorphic_allocator< mapped_page > allocator_;
+            std::array< bucket_head, bucket_count_ > used_pages_;
+            magazine_depot< mapped_page, page_batch_, 31, typename Policies::backoff > unused_pages_;
+            aligned_atomic< size_t > size_, used_;
+            epoch<> epoch_;
+
+
+            /** Takes ownership over a link of bucket chain
+
+            @param [in] link - the link
+            @retval value of the link
+            @throw nothing
+            */
+            static uintptr_t own( std::atomic< uintptr_t >& link ) noexcept
+            {
+                for ( typename Policies::backoff backoff; ; backoff() )
                 {
-                    throw std::bad_alloc();
+                    if ( auto current = link.fetch_or( owned_, std::memory_order_acq_rel ); !( current & owned_ ) )
+                    {
+                        // got the item
+                        return current;
+                    }
                 }
             }
 
-            mapped_page_ptr get_mapped_page( size_t offset )
+
+            /** Allocates a batch of new pages, keeps the spare ones unused
+
+            @retval new page
+            @throw std::bad_alloc
+            */
+            mapped_page* new_page()
             {
-                auto bucket = ( offset / file_.page_size() ) % bucket_count_;
+                std::array< mapped_page*, page_batch_ > pages;
+                {
+                    std::unique_lock lock( allocation_guard_ );
+
+                    auto p = allocator_.allocate( page_batch_ );
+                    assert( p );
+
+                    for ( size_t i = 0; i < page_batch_; ++i )
+                    {
+                        pages[ i ] = p + i;
+                        allocator_.construct( pages[ i ], file_, *this );
+                    }
+                }
 
-                aligned_atomic< uintptr_t >* p_current = &used_pages_[ bucket ];
-                aligned_atomic< uintptr_t >* p_previous = nullptr;
-                uintptr_t current;
-                uintptr_t previous;
+                size_.fetch_add( page_batch_, std::memory_order_acq_rel );
 
-                while ( true )
+                for ( size_t i = 1; i < page_batch_; ++i )
                 {
-                    // try get ownership over current item in the bucket
-                    for ( size_t spin = 1; ; ++spin )
+                    try
                     {
-                        if ( current = p_current->fetch_or( owned_, std::memory_order_acq_rel ), !( n& owned_ ) )
-                        {
-                            // got the item
-                            break;
-                        }
+                        unused_pages_.free( pages[ i ] );
+                    }
+                    catch ( ... )
+                    {
+                        // the pages just leak
+                        break;
+                    }
+                }
 
-                        // all the attempts failed - fall asleep for a while
-                        static constexpr size_t spin_count = 1024;
-                        if ( spin % spin_count == 0 ) std::this_thread::yield();
+                return pages[ 0 ];
+            }
+
+
+            /** Puts a page to unused ones
+
+            @param [in] page - the page nobody can see anymore
+            @throw nothing
+            */
+            void put_unused( mapped_page* page ) noexcept
+            {
+                assert( page );
+
+                page->mapping_.reset();
+
+                try
+                {
+                    unused_pages_.free( page );
+                }
+                catch ( ... )
+                {
+                    // the page just leaks
+                }
+            }
+
+        public:
+
+            shard() = delete;
+            shard( shard&& ) = delete;
+
+            explicit shard( storage_file& file )
+                : file_( file )
+                , monotonic_buffer_()
+                , allocator_( &monotonic_buffer_ )
+            {}
+
+            /** Destructor, unmaps the pages, nobody must refer them anymore (retired pages get unmapped by the
+                epoch destructor)
+            */
+            ~shard()
+            {
+                for ( auto& bucket : used_pages_ )
+                {
+                    auto link = bucket.link_.load( std::memory_order_acquire );
+                    while ( auto p_page = reinterpret_cast< mapped_page* >( link & ~owned_ ) )
+                    {
+                        link = p_page->next_.load( std::memory_order_acquire );
+                        p_page->~mapped_page();
                     }
+                }
 
-                    // still we've already got ownership over the current item, the previous one can be released for other threads
-                    if ( p_previous ) p_previous->store( previous, std::memory_order_release );
+                unused_pages_.for_each( []( mapped_page* p_page ) { p_page->~mapped_page(); } );
+            }
 
+            size_t size() const noexcept { return size_.load( std::memory_order_acquire ); }
+            size_t used() const noexcept { return used_.load( std::memory_order_acquire ); }
+
+
+            /** Pins the shard epoch, unlinked pages do not get recycled while the pin lives
+
+            @throw nothing
+            */
+            typename epoch<>::guard pin() noexcept { return epoch_.pin(); }
+
+
+            /** Provides a page for given offset, takes it from the bucket or makes it up
+
+            @param [in] offset - page offset
+            @retval the page
+            @throw std::bad_alloc
+            */
+            mapped_page_ptr get_mapped_page( size_t offset )
+            {
+                auto pin = epoch_.pin();
+                auto bucket = ( offset / file_.page_size() ) % bucket_count_;
+
+                std::atomic< uintptr_t >* p_current = &used_pages_[ bucket ].link_;
+                uintptr_t current = own( *p_current );
+
+                while ( true )
+                {
                     // get pointer to current page
-                    auto p_page = reinterpret_cast<mapped_page*>( current );
+                    auto p_page = reinterpret_cast< mapped_page* >( current );
 
                     // if page exists with offset that we're looking for
                     if ( p_page && p_page->offset_ == offset )
@@ -108,119 +418,111 @@ namespace jb
                     // if we've reached end of the bucked or met a page with greater offset
                     else if ( !p_page || p_page->offset_ > offset )
                     {
-                        // requested page not mapped - try to map 
-                        while ( true )
+                        typename Policies::tracer::scope trace( trace_event::cache_miss, offset );
+
+                        // requested page not mapped - take an unused one or allocate new
+                        p_page = unused_pages_.allocate();
+                        if ( !p_page )
                         {
-                            // get the 1st unused page
-                            auto first_unused = unused_pages_.load( std::memory_order_acquire );
-                            p_page = reinterpret_cast<mapped_page*>( first_unused );
-                            if ( p_page )
+                            try
                             {
-                                // remove the page from "unused" list
-                                auto next_unused = p_page->next_.load( std::memory_order_acquire );
-                                if ( !unused_pages_.compare_exchange_weak( unused, next_unused, std::memory_order_acq_rel, std::memory_order_relaxed ) )
-                                {
-                                    continue;
-                                }
+                                p_page = new_page();
                             }
-                            else
+                            catch ( ... )
                             {
-                                p_page = new_page( file_, *this );
+                                p_current->store( current, std::memory_order_release );
+                                throw;
                             }
-
-                            // make up the page and insert it into the bucked at current position and release ownership
-                            mapped_page_ptr page( p_page, false );
-                            page->offset_ = offset;
-                            page->mapping_ = safe_mapped_area{};
-                            page->ref_count_.store( 1, std::memory_order_relaxed );
-                            page->lock_count_.store( mapped_page::unlocked_, std::memory_order_relaxed );
-                            page->next_.store( current, std::memory_order_relaxed );
-                            p_current->store( unused, std::memory_order_release );
-                            return page;
                         }
+
+                        // make up the page and insert it into the bucked at current position and release ownership
+                        p_page->offset_ = offset;
+                        p_page->ref_count_.store( 1, std::memory_order_relaxed );
+                        p_page->lock_count_.store( mapped_page::unlocked_, std::memory_order_relaxed );
+                        p_page->next_.store( current, std::memory_order_relaxed );
+                        used_.fetch_add( 1, std::memory_order_acq_rel );
+                        p_current->store( reinterpret_cast< uintptr_t >( p_page ), std::memory_order_release );
+
+                        return mapped_page_ptr( p_page, false );
                     }
                     else
                     {
-                        // keep searching forward
-                        p_previous = p_current;
-                        previous = current;
+                        // keep searching forward: get the next item owned and release the current one
+                        auto next = own( p_page->next_ );
+                        p_current->store( current, std::memory_order_release );
                         p_current = &p_page->next_;
+                        current = next;
                     }
                 }
             }
 
+
+            /** Unlinks a page if nobody refers to it, the page gets recycled after grace period
+
+            Must be called under epoch pin taken before the page reference counter dropped to zero
+
+            @param [in] page - the page
+            @retval true if the page got unlinked
+            @throw nothing
+            */
             bool try_release_mapped_page( mapped_page* page ) noexcept
             {
                 assert( page );
 
-                auto bucket = ( page->offset_ / page_size() ) % mapped_pages_.size();
+                auto bucket = ( page->offset_ / file_.page_size() ) % bucket_count_;
 
-                aligned_atomic< uintptr_t >* p_current = &used_pages_[ bucket ];
-                aligned_atomic< uintptr_t >* p_previous = nullptr;
-                uintptr_t current;
-                uintptr_t previous;
+                std::atomic< uintptr_t >* p_current = &used_pages_[ bucket ].link_;
+                uintptr_t current = own( *p_current );
 
                 while ( true )
                 {
-                    // try get ownership over current item in the bucket
-                    for ( size_t spin = 1; ; ++spin )
-                    {
-                        if ( current = p_current->fetch_or( owned_, std::memory_order_acq_rel ), !( n& owned_ ) )
-                        {
-                            // got the item
-                            break;
-                        }
+                    // get pointer to current page
+                    auto p_page = reinterpret_cast< mapped_page* >( current );
 
-                        // all the attempts failed - fall asleep for a while
-                        static constexpr size_t spin_count = 1024;
-                        if ( spin % spin_count == 0 ) std::this_thread::yield();
+                    // the page has already gone
+                    if ( !p_page || p_page->offset_ > page->offset_ )
+                    {
+                        p_current->store( current, std::memory_order_release );
+                        return false;
                     }
 
-                    // still we've already got ownership over the current item, the previous one can be released for other threads
-                    if ( p_previous ) p_previous->store( previous, std::memory_order_release );
-
-                    // get pointer to current page
-                    auto p_page = reinterpret_cast<mapped_page*>( current );
-                    assert( p_page );
-
                     //
                     // if page found and it's not referred (as soon as we've got the item owned with ACQUIRE
                     // semantic now we can use RELAXED to check reference count)
                     //
-                    if ( p_page == page && !p_page->ref_count_.load( std::memory_order_relaxed ) )
+                    if ( p_page == page )
                     {
-                        // get the next item owned
-                        for ( size_t spin = 1;; ++spin )
+                        if ( p_page->ref_count_.load( std::memory_order_relaxed ) )
                         {
-                            if ( auto next = p_page.load( std::memory_order_acquire ); !( next & hazard_ ) )
-                            {
-                                // and set current to next, removing the page from the bucket
-                                p_current.store( next, std::memory_order_release );
-                                break;
-                            }
-
-                            static constexpr size_t spin_count = 1024;
-                            if ( !( spin % spin_count ) ) std::this_thread::yield();
+                            p_current->store( current, std::memory_order_release );
+                            return false;
                         }
 
-                        // put the page in the front of unused list
-                        while ( true )
+                        // wait until walkers leave the page and remove it from the bucket, thread cache entries
+                        // referring to the page become stale
+                        auto next = own( p_page->next_ );
+                        p_page->generation_.fetch_add( 1, std::memory_order_seq_cst );
+                        p_current->store( next, std::memory_order_release );
+                        used_.fetch_sub( 1, std::memory_order_acq_rel );
+
+                        // recycle the page as soon as nobody can see it
+                        try
                         {
-                            auto unused_pages = unused_pages_.load( std::memory_order_acquire );
-                            p_page->next_.store( unused_pages, std::memory_order_relaxed );
-                            if ( unused_pages_.compare_exchange_weak( unused_pages, current, std::memory_order_acq_rel, std::memory_order_relaxed ) )
-                            {
-                                break;
-                            }
+                            epoch_.retire( [ this, p_page ] { put_unused( p_page ); } );
                         }
+                        catch ( ... )
+                        {
+                            // the page just leaks
+                        }
+
+                        return true;
                     }
-                    else
-                    {
-                        // keep searching forward
-                        p_previous = p_current;
-                        previous = current;
-                        p_current = &p_page->next_;
-                    }
+
+                    // keep searching forward: get the next item owned and release the current one
+                    auto next = own( p_page->next_ );
+                    p_current->store( current, std::memory_order_release );
+                    p_current = &p_page->next_;
+                    current = next;
                 }
             }
         };
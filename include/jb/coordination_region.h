@@ -0,0 +1,187 @@
+#ifndef __JB__COORDINATION_REGION__H__
+#define __JB__COORDINATION_REGION__H__
+
+
+#include "ret_codes.h"
+#include "exception.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <new>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Coordinates the writer process and reader processes sharing a storage file
+
+        Lays in shared memory mapped by all the processes (see AccessMode). The writer publishes the sequence number
+        of each commit, a reader process pins the sequence it reads at in a reader slot. Pages superseded by a
+        commit could be recycled by the writer only when no reader pins an older sequence (see oldest()).
+
+        A reader pins sequence the same way snapshot_registry does: it stores the published sequence and re-checks
+        it didn't change meanwhile, so the writer either sees the pin or the reader sees the newer commit. A slot of
+        a crashed reader is reclaimed by the writer as soon as the owner process is found dead.
+
+        The region is zero-initialized by the system, all the fields rely on lock-free atomics of fixed layout
+        */
+        class coordination_region
+        {
+        public:
+
+            static constexpr size_t reader_slot_count = 64;
+
+        private:
+
+            static_assert( std::atomic< uint64_t >::is_always_lock_free, "Shared memory requires address-free atomics" );
+
+            static constexpr uint64_t magic_ = 0x3164726f6f63626aULL; // jbcoord1
+
+            struct alignas( 64 ) reader_slot
+            {
+                std::atomic< uint64_t > owner_;
+                std::atomic< uint64_t > sequence_;  // pinned sequence + 1, 0 if not pinned
+            };
+
+            alignas( 64 ) std::atomic< uint64_t > magic_value_;
+            std::atomic< uint64_t > published_;
+            reader_slot readers_[ reader_slot_count ];
+
+        public:
+
+            coordination_region() = delete;
+            coordination_region( coordination_region&& ) = delete;
+
+
+            /** Size of shared memory the region requires
+            */
+            static constexpr size_t size() noexcept { return sizeof( coordination_region ); }
+
+
+            /** Attaches to the region laying in shared memory, initializes it if the memory is new (zeroed)
+
+            @param [in] memory - shared memory of at least size() bytes
+            @retval the region
+            @throw details::runtime_error if the memory holds something else
+            */
+            static coordination_region* attach( void* memory )
+            {
+                auto region = static_cast< coordination_region* >( memory );
+
+                uint64_t expected = 0;
+                if ( !region->magic_value_.compare_exchange_strong( expected, magic_, std::memory_order_acq_rel ) && magic_ != expected )
+                {
+                    throw runtime_error( RetCode::UnknownError, "Invalid coordination region" );
+                }
+
+                return region;
+            }
+
+
+            /** Publishes sequence number of a commit, called by the writer after the commit became durable
+
+            @param [in] sequence - commit sequence number
+            @throw nothing
+            */
+            void publish( uint64_t sequence ) noexcept
+            {
+                published_.store( sequence, std::memory_order_seq_cst );
+            }
+
+
+            /** Provides the last published sequence number
+
+            @throw nothing
+            */
+            uint64_t published() const noexcept
+            {
+                return published_.load( std::memory_order_acquire );
+            }
+
+
+            /** Takes a free reader slot
+
+            @param [in] owner - id of the owner process
+            @retval slot index
+            @throw details::runtime_error( LimitReached ) if all the slots are taken
+            */
+            size_t acquire_reader( uint64_t owner )
+            {
+                for ( size_t i = 0; i < reader_slot_count; ++i )
+                {
+                    uint64_t expected = 0;
+                    if ( readers_[ i ].owner_.compare_exchange_strong( expected, owner, std::memory_order_acq_rel ) ) return i;
+                }
+
+                throw runtime_error( RetCode::LimitReached, "Too many reader processes" );
+            }
+
+
+            /** Releases reader slot
+
+            @param [in] slot - slot index
+            @throw nothing
+            */
+            void release_reader( size_t slot ) noexcept
+            {
+                readers_[ slot ].sequence_.store( 0, std::memory_order_seq_cst );
+                readers_[ slot ].owner_.store( 0, std::memory_order_release );
+            }
+
+
+            /** Pins the last published sequence for a reader, replaces previous pin
+
+            @param [in] slot - slot index
+            @retval pinned sequence number, the reader must not read at a sequence older than it
+            @throw nothing
+            */
+            uint64_t pin( size_t slot ) noexcept
+            {
+                while ( true )
+                {
+                    auto sequence = published_.load( std::memory_order_seq_cst );
+                    readers_[ slot ].sequence_.store( sequence + 1, std::memory_order_seq_cst );
+                    if ( sequence == published_.load( std::memory_order_seq_cst ) ) return sequence;
+                }
+            }
+
+
+            /** Provides the oldest sequence number any reader process could still read at
+
+            @param [in] alive - callable( uint64_t owner ) -> bool, checks if owner process is alive
+            @retval the oldest pinned sequence, the published one if there are no readers
+            @throw nothing
+            */
+            template < typename Alive >
+            uint64_t oldest( Alive&& alive ) noexcept
+            {
+                auto result = published_.load( std::memory_order_seq_cst );
+
+                for ( auto& r : readers_ )
+                {
+                    auto owner = r.owner_.load( std::memory_order_acquire );
+                    if ( !owner ) continue;
+
+                    if ( !alive( owner ) )
+                    {
+                        // the reader crashed: clear its pin before letting the slot go
+                        r.sequence_.store( 0, std::memory_order_seq_cst );
+                        r.owner_.compare_exchange_strong( owner, 0, std::memory_order_acq_rel );
+                        continue;
+                    }
+
+                    if ( auto pinned = r.sequence_.load( std::memory_order_seq_cst ) )
+                    {
+                        result = std::min( result, pinned - 1 );
+                    }
+                }
+
+                return result;
+            }
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef __JB__DIRTY_PAGE_MAP__H__
+#define __JB__DIRTY_PAGE_MAP__H__
+
+
+#include "aligned_atomic.h"
+#include <array>
+#include <atomic>
+#include <stdexcept>
+#include <assert.h>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Keeps dirty bits of storage file pages
+
+        The bitmap is split into chunks allocated on demand, so growing the file does not require to relocate
+        already allocated bits and marking a page never blocks. A bit is set only if it is not set yet, so repeated
+        modification of a hot page costs a single load of the shared cache line. Collecting the bits clears them
+        word by word, thus a page modified after its word got collected is marked again and will be flushed by
+        the next collection.
+
+        A page must be marked AFTER it was modified
+        */
+        class dirty_page_map
+        {
+            static constexpr size_t bits_per_word_ = 64;
+            static constexpr size_t words_per_chunk_ = 4096;
+            static constexpr size_t pages_per_chunk_ = bits_per_word_ * words_per_chunk_;
+            static constexpr size_t chunk_count_ = 4096;
+
+            struct chunk
+            {
+                std::array< std::atomic< uint64_t >, words_per_chunk_ > words_;
+            };
+
+            std::array< std::atomic< chunk* >, chunk_count_ > chunks_{};
+            aligned_atomic< size_t > count_;
+
+
+            /** Provides chunk holding dirty bit of given page, allocates it if needed
+
+            @param [in] chunk_index - index of the chunk
+            @retval the chunk
+            @throw std::bad_alloc
+            */
+            chunk& get_chunk( size_t chunk_index )
+            {
+                auto& slot = chunks_[ chunk_index ];
+
+                if ( auto c = slot.load( std::memory_order_acquire ) )
+                {
+                    return *c;
+                }
+
+                auto c = new chunk{};
+                chunk* expected = nullptr;
+                if ( !slot.compare_exchange_strong( expected, c, std::memory_order_acq_rel, std::memory_order_acquire ) )
+                {
+                    // another thread was faster
+                    delete c;
+                    return *expected;
+                }
+
+                return *c;
+            }
+
+        public:
+
+            /** Maximum number of pages the map can track
+            */
+            static constexpr size_t capacity() noexcept { return pages_per_chunk_ * chunk_count_; }
+
+
+            /** Default constructor, creates clean map
+
+            @throw nothing
+            */
+            dirty_page_map() noexcept = default;
+
+
+            /** Explicitly deleted move constructor, makes the class non-copyable/movable
+            */
+            dirty_page_map( dirty_page_map&& ) = delete;
+
+
+            /** Destructor, releases the chunks
+            */
+            ~dirty_page_map()
+            {
+                for ( auto& slot : chunks_ )
+                {
+                    delete slot.load( std::memory_order_acquire );
+                }
+            }
+
+
+            /** Provides approximate number of dirty pages
+
+            @throw nothing
+            */
+            size_t count() const noexcept { return count_.load( std::memory_order_acquire ); }
+
+
+            /** Marks a page as dirty
+
+            @param [in] page - page number
+            @throw std::bad_alloc, std::logic_error if the page number exceeds capacity
+            */
+            void mark( size_t page )
+            {
+                if ( page >= capacity() )
+                {
+                    throw std::logic_error( "Page number exceeds dirty map capacity" );
+                }
+
+                auto& word = get_chunk( page / pages_per_chunk_ ).words_[ ( page % pages_per_chunk_ ) / bits_per_word_ ];
+                auto bit = uint64_t{ 1 } << ( page % bits_per_word_ );
+
+                // do not touch the cache line exclusively if the bit already set
+                if ( !( word.load( std::memory_order_relaxed ) & bit ) && !( word.fetch_or( bit, std::memory_order_acq_rel ) & bit ) )
+                {
+                    count_.fetch_add( 1, std::memory_order_acq_rel );
+                }
+            }
+
+
+            /** Clears dirty bits reporting them as runs of contiguous pages in ascending order
+
+            @param [in] max_run - maximal number of pages in a run
+            @param [in] max_pages - stop after the number of pages collected (the word being processed gets
+                        completed, so up to 63 pages more could be collected)
+            @param [in] fn - callable( first_page, page_count ) invoked for each run
+            @retval number of collected pages
+            @throw whatever fn throws (the run being reported stays clean)
+            */
+            template < typename Fn >
+            size_t collect( size_t max_run, size_t max_pages, Fn&& fn )
+            {
+                assert( max_run );
+
+                size_t collected = 0, first = 0, length = 0;
+
+                for ( size_t c = 0; c < chunk_count_ && collected < max_pages; ++c )
+                {
+                    auto p_chunk = chunks_[ c ].load( std::memory_order_acquire );
+                    if ( !p_chunk ) continue;
+
+                    for ( size_t w = 0; w < words_per_chunk_ && collected < max_pages; ++w )
+                    {
+                        auto& word = p_chunk->words_[ w ];
+                        if ( !word.load( std::memory_order_relaxed ) ) continue;
+
+                        size_t word_count = 0;
+                        auto bits = word.exchange( 0, std::memory_order_acq_rel );
+                        for ( size_t b = 0; bits; ++b, bits >>= 1 )
+                        {
+                            if ( !( bits & 1 ) ) continue;
+
+                            auto page = c * pages_per_chunk_ + w * bits_per_word_ + b;
+                            if ( length && ( first + length != page || length == max_run ) )
+                            {
+                                fn( first, length );
+                                length = 0;
+                            }
+
+                            if ( !length ) first = page;
+                            ++length;
+                            ++word_count;
+                        }
+
+                        collected += word_count;
+                        count_.fetch_sub( word_count, std::memory_order_acq_rel );
+                    }
+                }
+
+                if ( length ) fn( first, length );
+
+                return collected;
+            }
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef __JB__EPOCH__H__
+#define __JB__EPOCH__H__
+
+
+#include "aligned_atomic.h"
+#include "backoff.h"
+#include <array>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <assert.h>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Implements epoch-based memory reclamation
+
+        Readers pin current epoch for the time they access shared objects, writers unlink an object and retire it
+        instead of destroying. A retired object gets destroyed as soon as all the readers that could see it unpin.
+
+        Readers are counted per epoch parity in a set of atomics, each laying in its own cache line and chosen by
+        locker id hash (the same trick as rare_exclusive_frequent_shared_mutex does), so pinning never writes a
+        cache line shared by all the threads. The global epoch is only read by readers and advanced by
+        reclamation: it moves from E to E+1 when no reader stays in E-1, thus readers always belong to the current
+        or previous epoch and objects retired at E-2 and earlier are not reachable anymore.
+
+        Reclamation is driven by writers only, unpinning never does anything but decrementing the reader counter.
+        Retired objects are batched in slots chosen by thread id hash (like magazine_depot does), and every
+        BatchSize-th retirement into a slot hands all the batches over to the global list under the mutex and
+        reclaims what is unreachable. So an object may wait for more retirements or an explicit reclaim() call
+        after its last reader left.
+
+        @tparam SlotCount - number of reader counters per epoch parity and number of retirement batches
+        @tparam BatchSize - number of retirements into a batch that triggers reclamation
+        @tparam Backoff - waiting strategy for a busy batch
+        */
+        template < size_t SlotCount = 31, size_t BatchSize = 32, typename Backoff = backoff<> >
+        class epoch
+        {
+            static_assert( SlotCount && BatchSize );
+
+            using retired_t = std::vector< std::pair< uint64_t, std::function< void() > > >;
+
+
+            /** Objects retired by the threads of a slot, the aligned flag keeps batches off each other's cache lines
+            */
+            struct batch
+            {
+                aligned_atomic< bool > busy_;
+                retired_t retired_;
+            };
+
+
+            /** Owns a batch for the time of life
+            */
+            class batch_lock
+            {
+                batch& batch_;
+
+            public:
+
+                explicit batch_lock( batch& b ) noexcept : batch_( b )
+                {
+                    for ( Backoff backoff; batch_.busy_.exchange( true, std::memory_order_acquire ); backoff() );
+                }
+
+                ~batch_lock() { batch_.busy_.store( false, std::memory_order_release ); }
+            };
+
+
+            aligned_atomic< uint64_t > global_{ 2 };
+            std::array< std::array< aligned_atomic< size_t >, SlotCount >, 2 > readers_;
+            std::array< batch, SlotCount > batches_;
+
+            std::mutex guard_;
+            retired_t retired_;
+
+
+            /** Checks if there is a reader pinned given epoch
+
+            @param [in] e - epoch
+            @throw nothing
+            */
+            bool pinned( uint64_t e ) const noexcept
+            {
+                for ( const auto& r : readers_[ e & 1 ] )
+                {
+                    if ( r.load( std::memory_order_seq_cst ) ) return true;
+                }
+
+                return false;
+            }
+
+
+            /** Advances the epoch as far as possible and takes reclaimers of unreachable objects
+
+            Must be called under the guard
+
+            @retval reclaimers to be run
+            @throw std::bad_alloc
+            */
+            std::vector< std::function< void() > > collect()
+            {
+                // take the batches over, the objects stay retired in one place or another if an allocation fails
+                for ( auto& b : batches_ )
+                {
+                    batch_lock lock( b );
+
+                    retired_.reserve( retired_.size() + b.retired_.size() );
+                    std::move( b.retired_.begin(), b.retired_.end(), std::back_inserter( retired_ ) );
+                    b.retired_.clear();
+                }
+
+                auto e = global_.load( std::memory_order_seq_cst );
+
+                // at most 2 steps make all currently retired objects unreachable
+                for ( size_t step = 0; step < 2 && !pinned( e - 1 ); ++step )
+                {
+                    global_.store( ++e, std::memory_order_seq_cst );
+                }
+
+                auto it = std::partition( retired_.begin(), retired_.end(), [&]( const auto& r ) { return r.first + 2 > e; } );
+
+                std::vector< std::function< void() > > ready;
+                ready.reserve( static_cast< size_t >( std::distance( it, retired_.end() ) ) );
+                for ( auto i = it; i != retired_.end(); ++i ) ready.push_back( std::move( i->second ) );
+                retired_.erase( it, retired_.end() );
+
+                return ready;
+            }
+
+        public:
+
+            /** Keeps an epoch pinned for the time of life
+            */
+            class guard
+            {
+                epoch* owner_ = nullptr;
+                aligned_atomic< size_t >* counter_ = nullptr;
+
+            public:
+
+                /** Default constructor, creates dummy instance
+
+                @throw nothing
+                */
+                guard() noexcept = default;
+
+
+                /** Pins current epoch
+
+                @param [in] owner - epoch manager
+                @param [in] locker_id - an identifier of the pinning object (uniqueness NOT required)
+                @throw nothing
+                */
+                guard( epoch& owner, size_t locker_id ) noexcept : owner_( &owner )
+                {
+                    while ( true )
+                    {
+                        auto e = owner.global_.load( std::memory_order_seq_cst );
+
+                        counter_ = &owner.readers_[ e & 1 ][ locker_id % SlotCount ];
+                        counter_->fetch_add( 1, std::memory_order_seq_cst );
+
+                        // the epoch must not move while we were registering
+                        if ( e == owner.global_.load( std::memory_order_seq_cst ) ) break;
+
+                        counter_->fetch_sub( 1, std::memory_order_seq_cst );
+                    }
+                }
+
+
+                /** Move constructor
+
+                @param [in/out] other - instance to move from, becomes dummy
+                @throw nothing
+                */
+                guard( guard&& other ) noexcept
+                {
+                    std::swap( owner_, other.owner_ );
+                    std::swap( counter_, other.counter_ );
+                }
+
+
+                /** Move assignment, unpins held epoch if any
+
+                @param [in/out] other - instance to move from, becomes dummy
+                @retval the instance
+                @throw nothing
+                */
+                guard& operator = ( guard&& other ) noexcept
+                {
+                    guard dummy;
+                    std::swap( owner_, dummy.owner_ );
+                    std::swap( counter_, dummy.counter_ );
+                    std::swap( owner_, other.owner_ );
+                    std::swap( counter_, other.counter_ );
+                    return *this;
+                }
+
+
+                /** Destructor, unpins the epoch
+                */
+                ~guard()
+                {
+                    if ( owner_ ) counter_->fetch_sub( 1, std::memory_order_seq_cst );
+                }
+
+
+                /** Checks if the guard pins an epoch
+                */
+                explicit operator bool() const noexcept { return owner_; }
+            };
+
+
+            /** Default constructor
+
+            @throw nothing
+            */
+            epoch() noexcept = default;
+
+
+            /** Explicitly deleted move constructor, makes the class non-copyable/movable
+            */
+            epoch( epoch&& ) = delete;
+
+
+            /** Destructor, destroys all retired objects, no reader must stay pinned
+            */
+            ~epoch()
+            {
+                for ( auto& r : retired_ ) r.second();
+                for ( auto& b : batches_ )
+                {
+                    for ( auto& r : b.retired_ ) r.second();
+                }
+            }
+
+
+            /** Pins current epoch for the calling thread
+
+            @retval guard keeping the epoch pinned
+            @throw nothing
+            */
+            guard pin() noexcept
+            {
+                return guard( *this, std::hash< std::thread::id >()( std::this_thread::get_id() ) );
+            }
+
+
+            /** Retires an unlinked object into the batch of calling thread, reclaims if the batch got full
+
+            @param [in] reclaimer - callable destroying the object when nobody can access it anymore
+            @throw std::bad_alloc (the object did not get retired)
+            */
+            void retire( std::function< void() >&& reclaimer )
+            {
+                bool full = false;
+                {
+                    auto& b = batches_[ std::hash< std::thread::id >()( std::this_thread::get_id() ) % SlotCount ];
+                    batch_lock lock( b );
+
+                    b.retired_.emplace_back( global_.load( std::memory_order_seq_cst ), std::move( reclaimer ) );
+                    full = b.retired_.size() >= BatchSize;
+                }
+
+                if ( full ) reclaim();
+            }
+
+
+            /** Destroys retired objects nobody can access anymore, the batches included
+
+            Does nothing if another thread is reclaiming at the moment
+
+            @throw nothing
+            */
+            void reclaim() noexcept
+            {
+                std::vector< std::function< void() > > ready;
+
+                try
+                {
+                    std::unique_lock lock( guard_, std::try_to_lock );
+                    if ( !lock ) return;
+
+                    ready = collect();
+                }
+                catch ( ... )
+                {
+                    // next call will retry
+                    return;
+                }
+
+                // run reclaimers out of the lock, they are free to pin or retire
+                for ( auto& r : ready ) r();
+            }
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,544 @@
+#ifndef __JB__FREE_SPACE_MAP__H__
+#define __JB__FREE_SPACE_MAP__H__
+
+
+#include "ret_codes.h"
+#include "exception.h"
+#include "aligned_atomic.h"
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <assert.h>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Persistent page allocator of a storage file: bitmap pages with per-thread caches of contiguous runs
+
+        Pages are tracked in groups of page_size * 8 pages, each group has a bitmap page (a set bit means the page
+        is in use) allocated from the file itself. Bitmap pages are found through a chain of directory pages
+        starting at free_space_ field of the superblock:
+
+            word 0 - offset of the next directory page, 0 - none
+            word 1 - number of tracked pages (the first directory only), all the pages below have their bits
+            word 2... - offsets of bitmap pages of consecutive groups, 0 - the group has no bitmap yet
+
+        Nothing is read on construction: directory and bitmap pages are mapped on the first need and stay mapped.
+
+        Every page below the file size gets tracked. The pages that the map has not seen grown (allocated by grow()
+        directly or grown before a crash let the map record them) are taken as used, so the map never hands out a
+        page it does not know to be free. Once the map is in use the file must grow only through it.
+
+        Allocation prefers contiguous runs: allocate( n ) takes the first run of n free pages found from where the
+        previous search stopped (next fit) and grows the file by n pages if there is no such run. Single pages are
+        served from per-thread caches: a slot, chosen by thread id hash like in magazine_depot, keeps a run of up to
+        Policies::free_space_run pages reserved in the bitmap, so a thread allocating page after page gets them
+        contiguous and takes the map mutex once per run. drain() returns reserved pages, a crash just leaks them.
+
+        Bitmap pages are written back by the page flusher like any modified page, so the map is durable only as of
+        the last checkpoint() and a crash may leave pages handed out since then marked free. Hence the map is
+        trusted only if the file was closed cleanly, otherwise it is started over with every page of the file taken
+        as used: the pages freed before the crash leak, but none of them is handed out twice. A page must be
+        deallocated only when no committed state refers to it anymore (see shadow_pager::recycle()).
+
+        @tparam Policies - backoff and free_space_run
+        @tparam File - storage file: page_size(), size(), grow(), map_page(), mark_dirty(), flush(), sync(),
+                read_only(), clean_shutdown(), superblock()
+        */
+        template < typename Policies, typename File >
+        class free_space_map
+        {
+            using safe_mapped_area = typename File::safe_mapped_area;
+
+            static constexpr size_t npos = std::numeric_limits< size_t >::max();
+            static constexpr size_t slot_count_ = 31;
+            static constexpr size_t next_word_ = 0;
+            static constexpr size_t tracked_word_ = 1;
+            static constexpr size_t first_group_word_ = 2;
+            static constexpr uint64_t full_word_ = std::numeric_limits< uint64_t >::max();
+
+            static_assert( Policies::free_space_run > 0 );
+
+
+            /** Mapped page of the map
+            */
+            struct map_page
+            {
+                size_t offset_ = 0;
+                safe_mapped_area mapping_;
+
+                uint64_t* words() const noexcept { return static_cast< uint64_t* >( mapping_.get() ); }
+            };
+
+
+            /** Cache of a thread slot: reserved run of pages [begin_, end_), the aligned flag keeps slots off each
+                other's cache lines
+            */
+            struct slot
+            {
+                aligned_atomic< bool > busy_;
+                size_t begin_ = 0;
+                size_t end_ = 0;
+            };
+
+
+            /** Owns a slot for the time of life
+            */
+            class slot_lock
+            {
+                slot& slot_;
+
+            public:
+
+                explicit slot_lock( slot& s ) noexcept : slot_( s )
+                {
+                    for ( typename Policies::backoff backoff; slot_.busy_.exchange( true, std::memory_order_acquire ); backoff() );
+                }
+
+                ~slot_lock() { slot_.busy_.store( false, std::memory_order_release ); }
+            };
+
+
+            File& file_;
+            std::array< slot, slot_count_ > slots_;
+            std::mutex guard_;
+            std::vector< map_page > directories_;
+            std::vector< map_page > bitmaps_;
+            size_t tracked_ = 0;
+            size_t cursor_ = 0;
+
+
+            static size_t pages_per_group() noexcept { return File::page_size() * 8; }
+            static size_t groups_per_directory() noexcept { return File::page_size() / sizeof( uint64_t ) - first_group_word_; }
+
+
+            /** Provides slot of calling thread
+            */
+            slot& get_slot() noexcept
+            {
+                return slots_[ std::hash< std::thread::id >()( std::this_thread::get_id() ) % slot_count_ ];
+            }
+
+
+            /** Grows the file by a page, must be called under the guard
+
+            @retval number of the new page
+            @throw details::runtime_error
+            */
+            size_t grow_page()
+            {
+                while ( true )
+                {
+                    auto size = file_.size();
+                    if ( file_.grow( size ) ) return size / File::page_size();
+                }
+            }
+
+
+            /** Maps a page of the map
+
+            @param [in] page - page number
+            @retval the mapped page
+            @throw details::runtime_error
+            */
+            map_page load( size_t page )
+            {
+                auto offset = page * File::page_size();
+                return map_page{ offset, file_.map_page( offset ) };
+            }
+
+
+            /** Stores a word of a map page, must be called under the guard
+
+            @throw std::bad_alloc
+            */
+            void store( const map_page& p, size_t word, uint64_t value )
+            {
+                p.words()[ word ] = value;
+                file_.mark_dirty( p.offset_ );
+            }
+
+
+            /** Loads the first directory, creates it if the file has no map yet or the map cannot be trusted after a
+                crash, must be called under the guard
+
+            @throw details::runtime_error, std::bad_alloc
+            */
+            void open()
+            {
+                if ( !directories_.empty() ) return;
+
+                if ( file_.read_only() )
+                {
+                    throw runtime_error( RetCode::ReadOnly, "The file is opened for reading only" );
+                }
+
+                auto offset = file_.superblock().current().free_space_;
+                if ( offset && file_.clean_shutdown() )
+                {
+                    directories_.push_back( load( offset / File::page_size() ) );
+                }
+                else
+                {
+                    // a grown page is zeroed, i.e. the directory is empty and nothing is tracked yet, so all the
+                    // pages of the file including the abandoned map get adopted as used
+                    directories_.push_back( load( grow_page() ) );
+
+                    // the directory must be durable before the superblock refers to it
+                    auto root = directories_.front().offset_;
+                    file_.flush( root, File::page_size() );
+                    file_.sync();
+
+                    file_.superblock().commit( [&]( auto& h ) { h.free_space_ = root; } );
+                }
+
+                tracked_ = directories_.front().words()[ tracked_word_ ];
+            }
+
+
+            /** Provides directory page, creates the missing ones, must be called under the guard
+
+            @param [in] index - index of the directory in the chain
+            @throw details::runtime_error, std::bad_alloc
+            */
+            const map_page& directory( size_t index )
+            {
+                while ( directories_.size() <= index )
+                {
+                    auto& last = directories_.back();
+
+                    if ( auto next = last.words()[ next_word_ ] )
+                    {
+                        directories_.push_back( load( next / File::page_size() ) );
+                    }
+                    else
+                    {
+                        auto page = grow_page();
+                        directories_.push_back( load( page ) );
+                        store( directories_[ directories_.size() - 2 ], next_word_, page * File::page_size() );
+                    }
+                }
+
+                return directories_[ index ];
+            }
+
+
+            /** Provides bitmap page of a group, creates it if needed, must be called under the guard
+
+            @param [in] group - the group
+            @throw details::runtime_error, std::bad_alloc
+            */
+            const map_page& bitmap( size_t group )
+            {
+                if ( bitmaps_.size() <= group ) bitmaps_.resize( group + 1 );
+                if ( bitmaps_[ group ].mapping_ ) return bitmaps_[ group ];
+
+                auto& dir = directory( group / groups_per_directory() );
+                auto word = first_group_word_ + group % groups_per_directory();
+
+                if ( auto offset = dir.words()[ word ] )
+                {
+                    bitmaps_[ group ] = load( offset / File::page_size() );
+                }
+                else
+                {
+                    auto page = grow_page();
+                    bitmaps_[ group ] = load( page );
+                    store( dir, word, page * File::page_size() );
+                }
+
+                return bitmaps_[ group ];
+            }
+
+
+            /** Checks if a group has bitmap page, must be called under the guard
+
+            @throw details::runtime_error, std::bad_alloc
+            */
+            bool has_bitmap( size_t group )
+            {
+                if ( group < bitmaps_.size() && bitmaps_[ group ].mapping_ ) return true;
+                return directory( group / groups_per_directory() ).words()[ first_group_word_ + group % groups_per_directory() ];
+            }
+
+
+            /** Marks pages [first, last) as used or free, must be called under the guard
+
+            @throw details::runtime_error, std::bad_alloc
+            */
+            void assign( size_t first, size_t last, bool used )
+            {
+                while ( first < last )
+                {
+                    auto group = first / pages_per_group();
+                    auto group_last = std::min( last, ( group + 1 ) * pages_per_group() );
+                    auto& bits = bitmap( group );
+
+                    for ( auto page = first; page < group_last; )
+                    {
+                        auto bit = page % pages_per_group();
+                        auto shift = bit % 64;
+                        auto count = std::min< size_t >( 64 - shift, group_last - page );
+                        auto mask = ( count == 64 ? full_word_ : ( uint64_t{ 1 } << count ) - 1 ) << shift;
+
+                        auto& word = bits.words()[ bit / 64 ];
+                        word = used ? word | mask : word & ~mask;
+                        page += count;
+                    }
+
+                    file_.mark_dirty( bits.offset_ );
+                    first = group_last;
+                }
+            }
+
+
+            /** Takes all the pages below the file size as tracked, the untracked ones as used, must be called under
+                the guard
+
+            @throw details::runtime_error, std::bad_alloc
+            */
+            void adopt()
+            {
+                // creating a bitmap grows the file, so the new bitmap gets adopted by the next round
+                for ( auto size = file_.size() / File::page_size(); tracked_ < size; size = file_.size() / File::page_size() )
+                {
+                    assign( tracked_, size, true );
+                    tracked_ = size;
+                    store( directories_.front(), tracked_word_, tracked_ );
+                }
+            }
+
+
+            /** Checks if pages [first, last) include a page of the map itself, must be called under the guard
+
+            @throw details::runtime_error, std::bad_alloc
+            */
+            bool holds_map_page( size_t first, size_t last )
+            {
+                auto inside = [&]( uint64_t offset ) { return offset && first <= offset / File::page_size() && offset / File::page_size() < last; };
+
+                // walks the existing chain only, directory() never gets to create a page here
+                for ( size_t index = 0; index < directories_.size() || directories_.back().words()[ next_word_ ]; ++index )
+                {
+                    auto& dir = directory( index );
+                    if ( inside( dir.offset_ ) ) return true;
+
+                    for ( auto word = first_group_word_; word < File::page_size() / sizeof( uint64_t ); ++word )
+                    {
+                        if ( inside( dir.words()[ word ] ) ) return true;
+                    }
+                }
+
+                return false;
+            }
+
+
+            /** Looks for a run of free pages in [first, last), must be called under the guard
+
+            @param [in] first - the first page to look at
+            @param [in] last - the page to stop at
+            @param [in] count - the run length
+            @retval the first page of the run, npos if there is no such run
+            @throw details::runtime_error, std::bad_alloc
+            */
+            size_t find( size_t first, size_t last, size_t count )
+            {
+                size_t run = 0;
+
+                for ( auto page = first; page < last; )
+                {
+                    auto bit = page % pages_per_group();
+                    auto word = bitmap( page / pages_per_group() ).words()[ bit / 64 ];
+
+                    // skip whole used or free words
+                    if ( !( bit % 64 ) && page + 64 <= last && ( !word || full_word_ == word ) )
+                    {
+                        run = word ? 0 : run + 64;
+                        page += 64;
+                        if ( run >= count ) return page - run;
+                        continue;
+                    }
+
+                    run = ( word >> ( bit % 64 ) & 1 ) ? 0 : run + 1;
+                    ++page;
+                    if ( run == count ) return page - run;
+                }
+
+                return npos;
+            }
+
+
+            /** Grows the file by a run of pages, must be called under the guard
+
+            @param [in] count - the run length
+            @retval the first page of the run
+            @throw details::runtime_error, std::bad_alloc
+            */
+            size_t extend( size_t count )
+            {
+                while ( true )
+                {
+                    adopt();
+
+                    // make up bitmaps of the groups the run falls into first, so they do not split the run
+                    auto first = tracked_;
+                    auto created = false;
+                    for ( auto group = first / pages_per_group(); group <= ( first + count - 1 ) / pages_per_group(); ++group )
+                    {
+                        if ( !has_bitmap( group ) )
+                        {
+                            bitmap( group );
+                            created = true;
+                        }
+                    }
+                    if ( created ) continue;
+
+                    for ( size_t i = 0; i < count; ++i ) grow_page();
+
+                    // somebody else has grown the file, his pages are adopted as used and we try again
+                    if ( file_.size() / File::page_size() != first + count ) continue;
+
+                    assign( first, first + count, true );
+                    tracked_ = first + count;
+                    store( directories_.front(), tracked_word_, tracked_ );
+
+                    return first;
+                }
+            }
+
+
+            /** Takes a run of pages, must be called under the guard
+
+            @param [in] count - the run length
+            @param [in] fallback - length of a shorter run to take if there is no free run of the requested length
+            @retval the first page of the run and the run length
+            @throw details::runtime_error, std::bad_alloc
+            */
+            std::pair< size_t, size_t > take( size_t count, size_t fallback )
+            {
+                open();
+                adopt();
+
+                for ( auto length : { count, fallback } )
+                {
+                    // the 2nd search catches runs before the cursor and the run the cursor is in the middle of
+                    auto page = find( cursor_, tracked_, length );
+                    if ( npos == page ) page = find( 0, std::min( tracked_, cursor_ + length - 1 ), length );
+
+                    if ( npos != page )
+                    {
+                        assign( page, page + length, true );
+                        cursor_ = page + length;
+                        return { page, length };
+                    }
+                }
+
+                auto page = extend( count );
+                cursor_ = page + count;
+                return { page, count };
+            }
+
+        public:
+
+            free_space_map() = delete;
+            free_space_map( free_space_map&& ) = delete;
+
+
+            /** Constructor, reads nothing
+
+            @param [in] file - storage file
+            @throw nothing
+            */
+            explicit free_space_map( File& file ) noexcept : file_( file ) {}
+
+
+            /** Allocates a run of contiguous pages
+
+            @param [in] count - number of pages
+            @retval offset of the first page
+            @throw details::runtime_error, std::bad_alloc
+            */
+            size_t allocate( size_t count = 1 )
+            {
+                assert( count );
+
+                if ( 1 == count )
+                {
+                    auto& s = get_slot();
+                    slot_lock lock( s );
+
+                    if ( s.begin_ == s.end_ )
+                    {
+                        std::unique_lock map_lock( guard_ );
+                        auto [ page, length ] = take( Policies::free_space_run, 1 );
+                        s.begin_ = page;
+                        s.end_ = page + length;
+                    }
+
+                    return s.begin_++ * File::page_size();
+                }
+
+                std::unique_lock lock( guard_ );
+                return take( count, count ).first * File::page_size();
+            }
+
+
+            /** Returns a run of pages to the map
+
+            @param [in] offset - offset of the first page
+            @param [in] count - number of pages
+            @throw details::runtime_error, std::bad_alloc, std::logic_error if the run exceeds the file or includes the
+                   superblock or a page of the map
+            */
+            void deallocate( size_t offset, size_t count = 1 )
+            {
+                assert( offset % File::page_size() == 0 );
+
+                std::unique_lock lock( guard_ );
+                open();
+                adopt();
+
+                auto first = offset / File::page_size();
+                if ( first + count > tracked_ )
+                {
+                    throw std::logic_error( "Deallocated pages exceed the file" );
+                }
+
+                if ( !first || holds_map_page( first, first + count ) )
+                {
+                    throw std::logic_error( "Deallocated pages include the superblock or the free-space map" );
+                }
+
+                assign( first, first + count, false );
+            }
+
+
+            /** Returns the pages reserved by thread caches to the map
+
+            @throw details::runtime_error, std::bad_alloc
+            */
+            void drain()
+            {
+                for ( auto& s : slots_ )
+                {
+                    slot_lock lock( s );
+                    if ( s.begin_ == s.end_ ) continue;
+
+                    std::unique_lock map_lock( guard_ );
+                    assign( s.begin_, s.end_, false );
+                    s.begin_ = s.end_ = 0;
+                }
+            }
+        };
+    }
+}
+
+#endif
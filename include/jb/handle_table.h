@@ -0,0 +1,478 @@
+#ifndef __JB__HANDLE_TABLE__H__
+#define __JB__HANDLE_TABLE__H__
+
+
+#include "epoch.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <limits>
+#include <assert.h>
+
+
+namespace jb
+{
+    namespace details
+    {
+        template < typename T > class handle_table;
+
+
+        /** Keeps an object resolved from a handle alive for the time of life
+
+        Does not own the object: it pins the epoch of the handle table, so even if the handle gets closed meanwhile,
+        the object stays alive until the pin gets released. Pinning costs a single atomic increment of a cache line
+        the thread shares with nobody but hash collisions, so resolving a handle makes no writes to shared data.
+        Only a pin released after the object got closed reclaims it, so closing does not wait for another table
+        operation. An object resolved through a closed handle (see handle_table::erase()) is held by shared
+        ownership instead.
+
+        @tparam T - object type
+        */
+        template < typename T >
+        class pinned_ptr
+        {
+            friend class handle_table< T >;
+
+            using entry_t = typename handle_table< T >::entry;
+
+            typename epoch<>::guard pin_;
+            handle_table< T >* table_ = nullptr;
+            uint32_t index_ = 0;
+            const entry_t* entry_ = nullptr;
+            std::shared_ptr< T > owner_;
+
+            pinned_ptr( typename epoch<>::guard&& pin, handle_table< T >* table, uint32_t index, const entry_t* entry ) noexcept
+                : pin_( std::move( pin ) )
+                , table_( table )
+                , index_( index )
+                , entry_( entry )
+            {
+            }
+
+            explicit pinned_ptr( std::shared_ptr< T >&& owner ) noexcept : owner_( std::move( owner ) ) {}
+
+        public:
+
+            /** Default constructor, creates empty instance
+
+            @throw nothing
+            */
+            pinned_ptr() noexcept = default;
+
+
+            /** Move constructor
+
+            @param [in/out] other - instance to move from, becomes empty
+            @throw nothing
+            */
+            pinned_ptr( pinned_ptr&& other ) noexcept
+                : pin_( std::move( other.pin_ ) )
+                , table_( std::exchange( other.table_, nullptr ) )
+                , index_( other.index_ )
+                , entry_( std::exchange( other.entry_, nullptr ) )
+                , owner_( std::move( other.owner_ ) )
+            {
+            }
+
+
+            /** Move assignment, releases held pin if any
+
+            @param [in/out] other - instance to move from, becomes empty
+            @retval the instance
+            @throw nothing
+            */
+            pinned_ptr& operator = ( pinned_ptr&& other ) noexcept
+            {
+                if ( this != &other )
+                {
+                    reset();
+                    pin_ = std::move( other.pin_ );
+                    table_ = std::exchange( other.table_, nullptr );
+                    index_ = other.index_;
+                    entry_ = std::exchange( other.entry_, nullptr );
+                    owner_ = std::move( other.owner_ );
+                }
+                return *this;
+            }
+
+
+            /** Destructor, releases the pin
+            */
+            ~pinned_ptr() { reset(); }
+
+            /** Provides the object
+
+            @throw nothing
+            */
+            T* get() const noexcept { return entry_ ? entry_->object_.get() : owner_.get(); }
+            T* operator -> () const noexcept { assert( get() ); return get(); }
+            T& operator * () const noexcept { assert( get() ); return *get(); }
+            explicit operator bool() const noexcept { return get(); }
+
+
+            /** Takes shared ownership over the object, e.g. to keep it alive for longer than the pin lives
+
+            Increments shared reference counter, so it is not intended for hot paths
+
+            @retval owning pointer, empty if the instance is empty
+            @throw nothing
+            */
+            std::shared_ptr< T > shared() const noexcept { return entry_ ? entry_->object_ : owner_; }
+
+
+            /** Releases the pin, makes the instance empty
+
+            @throw nothing
+            */
+            void reset() noexcept
+            {
+                auto table = std::exchange( table_, nullptr );
+                auto entry = std::exchange( entry_, nullptr );
+                owner_.reset();
+                pin_ = typename epoch<>::guard();
+
+                // the slot is checked after unpinning: if the entry was replaced before, the closer could not see
+                // the pin gone, so the object would wait for another table operation unless we reclaim it
+                if ( table && table->replaced( index_, entry ) ) table->epoch_.reclaim();
+            }
+        };
+
+
+        /** Generation-tagged integer reference to an object in a handle table
+
+        Copying a handle or checking it does not touch the object's reference counter. A handle refers to slot index
+        and the generation the slot had at the moment the object got registered. Like a weak reference, the handle
+        and all its copies stay valid after the object got closed for as long as the object is in use (locked,
+        mounted, etc.) and become expired when the object gets released. The release is deferred by epoch-based
+        reclamation, i.e. until the threads that had objects of the same table locked at the moment of closing
+        unlock them.
+
+        @tparam T - object type
+        */
+        template < typename T >
+        class handle
+        {
+            friend class handle_table< T >;
+
+            handle_table< T >* table_ = nullptr;
+            uint64_t id_ = 0;
+
+            handle( handle_table< T >* table, uint64_t id ) noexcept : table_( table ), id_( id ) {}
+
+        public:
+
+            /** Default constructor, creates invalid handle
+
+            @throw nothing
+            */
+            handle() noexcept = default;
+
+
+            /** Provides integer representation of the handle, 0 for invalid handle
+
+            @throw nothing
+            */
+            uint64_t id() const noexcept { return id_; }
+
+
+            /** Resolves the handle
+
+            @retval pinned object, empty if the handle is expired
+            @throw nothing
+            */
+            pinned_ptr< T > lock() const noexcept
+            {
+                return table_ ? table_->resolve( id_ ) : pinned_ptr< T >();
+            }
+
+
+            /** Checks if the handle refers to released object, i.e. closed and not used anymore
+
+            @throw nothing
+            */
+            bool expired() const noexcept { return !lock(); }
+
+
+            bool operator == ( const handle& other ) const noexcept { return table_ == other.table_ && id_ == other.id_; }
+            bool operator != ( const handle& other ) const noexcept { return !( *this == other ); }
+        };
+
+
+        /** Registry of objects addressed by generation-tagged handles
+
+        Slots are allocated by chunks on demand and never relocated, so resolving a handle is a couple of atomic
+        loads under epoch pin without any lock. Closing an object replaces its slot entry with a closed one, that
+        holds the object by weak reference only, and retires the old entry to the epoch manager, so the object gets
+        released when nobody has it pinned or shared. Unpinning does not reclaim (see epoch): the table reclaims
+        right after retiring, and an entry still pinned at that moment gets reclaimed by the pin that finds the
+        entry replaced on release (or by the next table operation if that one loses the race). Until then the handles resolve through the weak reference (a
+        slow path taking shared ownership), the slot gets reused after the object died. Registration and closing
+        are serialized with a mutex, they are not expected to be frequent.
+
+        @tparam T - object type
+        */
+        template < typename T >
+        class handle_table
+        {
+            friend class pinned_ptr< T >;
+
+            struct entry
+            {
+                uint32_t generation_;
+                std::shared_ptr< T > object_;       // empty if the object is closed
+                std::weak_ptr< T > closed_;         // closed object, alive while used
+            };
+
+            static constexpr size_t slots_per_chunk_ = 256;
+            static constexpr size_t chunk_count_ = 4096;
+
+            struct chunk
+            {
+                std::array< std::atomic< entry* >, slots_per_chunk_ > entries_{};
+                std::array< uint32_t, slots_per_chunk_ > generations_{};
+            };
+
+            std::array< std::atomic< chunk* >, chunk_count_ > chunks_{};
+            epoch<> epoch_;
+            std::mutex guard_;
+            std::vector< uint32_t > free_;
+            std::vector< uint32_t > closed_;
+            uint32_t used_ = 0;
+
+
+            static uint32_t index_of( uint64_t id ) noexcept { return static_cast< uint32_t >( id ); }
+            static uint32_t generation_of( uint64_t id ) noexcept { return static_cast< uint32_t >( id >> 32 ); }
+
+
+            /** Checks if slot entry got replaced, compares pointers only, so the entry may be already reclaimed
+
+            @param [in] index - slot index
+            @param [in] e - the entry the slot held
+            @throw nothing
+            */
+            bool replaced( uint32_t index, const entry* e ) const noexcept
+            {
+                auto& c = *chunks_[ index / slots_per_chunk_ ].load( std::memory_order_acquire );
+                return c.entries_[ index % slots_per_chunk_ ].load( std::memory_order_seq_cst ) != e;
+            }
+
+
+            /** Replaces slot entry and retires the old one, must be called under the guard
+
+            @param [in] index - slot index
+            @param [in] replacement - new entry, nullptr to free the slot
+            @retval the old entry
+            @throw std::bad_alloc (the entry stays intact)
+            */
+            entry* replace( uint32_t index, entry* replacement )
+            {
+                auto& c = *chunks_[ index / slots_per_chunk_ ].load( std::memory_order_relaxed );
+                auto& slot = c.entries_[ index % slots_per_chunk_ ];
+
+                auto e = slot.load( std::memory_order_relaxed );
+                slot.store( replacement, std::memory_order_seq_cst );
+                try
+                {
+                    epoch_.retire( [e] { delete e; } );
+                }
+                catch ( ... )
+                {
+                    slot.store( e, std::memory_order_release );
+                    throw;
+                }
+
+                epoch_.reclaim();
+
+                return e;
+            }
+
+
+            /** Closes an object, must be called under the guard
+
+            @param [in] index - slot index
+            @retval true if the slot held an open object
+            @throw std::bad_alloc
+            */
+            bool unlink( uint32_t index )
+            {
+                auto& c = *chunks_[ index / slots_per_chunk_ ].load( std::memory_order_relaxed );
+
+                auto e = c.entries_[ index % slots_per_chunk_ ].load( std::memory_order_relaxed );
+                if ( !e || !e->object_ ) return false;
+
+                closed_.reserve( closed_.size() + 1 );
+
+                auto closed = std::make_unique< entry >( entry{ e->generation_, nullptr, e->object_ } );
+                replace( index, closed.get() );
+                closed.release();
+
+                closed_.push_back( index );
+
+                return true;
+            }
+
+
+            /** Frees the slots of closed objects that got released, must be called under the guard
+
+            @throw std::bad_alloc
+            */
+            void sweep()
+            {
+                // release the entries whose readers have left since, so their objects can expire
+                epoch_.reclaim();
+
+                for ( auto it = closed_.begin(); it != closed_.end(); )
+                {
+                    auto& c = *chunks_[ *it / slots_per_chunk_ ].load( std::memory_order_relaxed );
+                    if ( !c.entries_[ *it % slots_per_chunk_ ].load( std::memory_order_relaxed )->closed_.expired() )
+                    {
+                        ++it;
+                        continue;
+                    }
+
+                    free_.reserve( free_.size() + 1 );
+                    replace( *it, nullptr );
+                    free_.push_back( *it );
+                    it = closed_.erase( it );
+                }
+            }
+
+        public:
+
+            /** Default constructor, creates empty table
+
+            @throw nothing
+            */
+            handle_table() noexcept = default;
+
+
+            /** Explicitly deleted move constructor, makes the class non-copyable/movable
+            */
+            handle_table( handle_table&& ) = delete;
+
+
+            /** Destructor, releases all the objects
+            */
+            ~handle_table()
+            {
+                for ( auto& c : chunks_ )
+                {
+                    if ( auto p = c.load( std::memory_order_acquire ) )
+                    {
+                        for ( auto& e : p->entries_ ) delete e.load( std::memory_order_acquire );
+                        delete p;
+                    }
+                }
+            }
+
+
+            /** Registers an object
+
+            @param [in] object - the object
+            @retval handle to the object
+            @throw std::bad_alloc, std::length_error if the table is full
+            */
+            handle< T > insert( std::shared_ptr< T >&& object )
+            {
+                std::unique_lock lock( guard_ );
+
+                sweep();
+
+                uint32_t index;
+                if ( !free_.empty() )
+                {
+                    index = free_.back();
+                }
+                else if ( used_ < slots_per_chunk_ * chunk_count_ )
+                {
+                    index = used_;
+
+                    auto& c = chunks_[ index / slots_per_chunk_ ];
+                    if ( !c.load( std::memory_order_relaxed ) ) c.store( new chunk, std::memory_order_release );
+                }
+                else
+                {
+                    throw std::length_error( "Handle table is full" );
+                }
+
+                auto& c = *chunks_[ index / slots_per_chunk_ ].load( std::memory_order_relaxed );
+                auto& generation = c.generations_[ index % slots_per_chunk_ ];
+
+                // skip 0 generation, so 0 id is never valid
+                auto g = generation == std::numeric_limits< uint32_t >::max() ? 1 : generation + 1;
+
+                c.entries_[ index % slots_per_chunk_ ].store( new entry{ g, std::move( object ), {} }, std::memory_order_release );
+                generation = g;
+
+                if ( !free_.empty() ) free_.pop_back(); else ++used_;
+
+                return handle< T >( this, ( uint64_t{ g } << 32 ) | index );
+            }
+
+
+            /** Resolves a handle
+
+            @param [in] id - integer representation of the handle
+            @retval pinned object, empty if the handle is expired
+            @throw nothing
+            */
+            pinned_ptr< T > resolve( uint64_t id ) noexcept
+            {
+                auto index = index_of( id );
+                if ( index / slots_per_chunk_ >= chunk_count_ ) return pinned_ptr< T >();
+
+                auto c = chunks_[ index / slots_per_chunk_ ].load( std::memory_order_acquire );
+                if ( !c ) return pinned_ptr< T >();
+
+                auto pin = epoch_.pin();
+
+                auto e = c->entries_[ index % slots_per_chunk_ ].load( std::memory_order_seq_cst );
+                if ( !e || e->generation_ != generation_of( id ) ) return pinned_ptr< T >();
+
+                if ( e->object_ ) return pinned_ptr< T >( std::move( pin ), this, index, e );
+
+                // closed object is still reachable while somebody uses it
+                return pinned_ptr< T >( e->closed_.lock() );
+            }
+
+
+            /** Closes an object, the handles referring to it expire when the object gets released
+
+            @param [in] h - handle to the object
+            @retval true if the handle referred to an open object
+            @throw std::bad_alloc
+            */
+            bool erase( const handle< T >& h )
+            {
+                std::unique_lock lock( guard_ );
+
+                if ( h.table_ != this ) return false;
+
+                auto index = index_of( h.id_ );
+                if ( index >= used_ ) return false;
+
+                auto& c = *chunks_[ index / slots_per_chunk_ ].load( std::memory_order_relaxed );
+                if ( c.generations_[ index % slots_per_chunk_ ] != generation_of( h.id_ ) ) return false;
+
+                return unlink( index );
+            }
+
+
+            /** Closes all the objects
+
+            @throw std::bad_alloc
+            */
+            void clear()
+            {
+                std::unique_lock lock( guard_ );
+
+                for ( uint32_t index = 0; index < used_; ++index ) unlink( index );
+            }
+        };
+    }
+}
+
+#endif
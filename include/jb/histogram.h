@@ -0,0 +1,214 @@
+#ifndef __JB__HISTOGRAM__H__
+#define __JB__HISTOGRAM__H__
+
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+#if defined( _MSC_VER )
+#   include <intrin.h>
+#endif
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** HDR-style (log-linear) histogram layout: each power of two range [2^k, 2^(k+1)) splits into 2^SubBits
+            equal buckets, so any recorded value is known within relative error of 2^-SubBits whatever its magnitude
+
+        Values not less than 2^MaxBits fall into the last bucket
+
+        @tparam SubBits - bits of precision
+        @tparam MaxBits - bits of the greatest value tracked precisely
+        */
+        template < size_t SubBits = 5, size_t MaxBits = 44 >
+        struct histogram_layout
+        {
+            static_assert( SubBits < MaxBits && MaxBits < 64 );
+
+            static constexpr size_t sub_count = size_t{ 1 } << SubBits;
+            static constexpr size_t bucket_count = ( MaxBits - SubBits + 1 ) * sub_count;
+
+
+            /** Provides index of the most significant bit of non-zero value
+
+            @throw nothing
+            */
+            static size_t msb( uint64_t value ) noexcept
+            {
+#if defined( _MSC_VER )
+                unsigned long index;
+                _BitScanReverse64( &index, value );
+                return index;
+#else
+                return 63 - static_cast< size_t >( __builtin_clzll( value ) );
+#endif
+            }
+
+
+            /** Maps a value to its bucket
+
+            @throw nothing
+            */
+            static size_t bucket( uint64_t value ) noexcept
+            {
+                if ( value < sub_count ) return static_cast< size_t >( value );
+
+                auto shift = msb( value ) - SubBits;
+                auto index = ( shift + 1 ) * sub_count + static_cast< size_t >( ( value >> shift ) & ( sub_count - 1 ) );
+                return std::min( index, bucket_count - 1 );
+            }
+
+
+            /** Provides the greatest value falling into a bucket
+
+            @throw nothing
+            */
+            static uint64_t highest( size_t bucket ) noexcept
+            {
+                if ( bucket < sub_count ) return bucket;
+                if ( bucket == bucket_count - 1 ) return std::numeric_limits< uint64_t >::max();
+
+                auto shift = bucket / sub_count - 1;
+                return ( ( sub_count + bucket % sub_count + 1 ) << shift ) - 1;
+            }
+        };
+
+
+        /** Merged histogram, a plain value taken from one or several recording histograms
+
+        @tparam Layout - histogram layout
+        */
+        template < typename Layout = histogram_layout<> >
+        class histogram_snapshot
+        {
+            std::array< uint64_t, Layout::bucket_count > buckets_{};
+            uint64_t count_ = 0;
+            uint64_t sum_ = 0;
+            uint64_t min_ = std::numeric_limits< uint64_t >::max();
+            uint64_t max_ = 0;
+            double scale_ = 1;
+
+            template < typename > friend class histogram;
+
+        public:
+
+            /** Creates empty snapshot
+
+            @param [in] scale - multiplier converting recorded values to reported ones (e.g. ticks to ns)
+            @throw nothing
+            */
+            explicit histogram_snapshot( double scale = 1 ) noexcept : scale_( scale ) {}
+
+
+            /** Adds another snapshot, the scale stays unchanged
+
+            @throw nothing
+            */
+            histogram_snapshot& operator += ( const histogram_snapshot& other ) noexcept
+            {
+                for ( size_t i = 0; i < Layout::bucket_count; ++i ) buckets_[ i ] += other.buckets_[ i ];
+                count_ += other.count_;
+                sum_ += other.sum_;
+                min_ = std::min( min_, other.min_ );
+                max_ = std::max( max_, other.max_ );
+                return *this;
+            }
+
+
+            uint64_t count() const noexcept { return count_; }
+            double min() const noexcept { return count_ ? min_ * scale_ : 0; }
+            double max() const noexcept { return max_ * scale_; }
+            double mean() const noexcept { return count_ ? static_cast< double >( sum_ ) / count_ * scale_ : 0; }
+
+
+            /** Provides a percentile
+
+            @param [in] p - percentile, [0, 100]
+            @retval the greatest value of the bucket the percentile falls into, but not greater than max()
+            @throw nothing
+            */
+            double percentile( double p ) const noexcept
+            {
+                if ( !count_ ) return 0;
+
+                auto rank = static_cast< uint64_t >( std::clamp( p, 0.0, 100.0 ) / 100 * count_ + 0.5 );
+                rank = std::clamp< uint64_t >( rank, 1, count_ );
+
+                uint64_t seen = 0;
+                for ( size_t i = 0; i < Layout::bucket_count; ++i )
+                {
+                    seen += buckets_[ i ];
+                    if ( seen >= rank ) return std::min( Layout::highest( i ), max_ ) * scale_;
+                }
+
+                return max();
+            }
+        };
+
+
+        /** Recording histogram, written by a single thread and read by any
+
+        The owner thread updates counters by plain load/store (no read-modify-write, no lock prefix); a reader
+        merging the histogram sees each counter either before or after an update, so a snapshot is consistent up to
+        the records made while it was taken
+
+        @tparam Layout - histogram layout
+        */
+        template < typename Layout = histogram_layout<> >
+        class histogram
+        {
+            std::array< std::atomic< uint64_t >, Layout::bucket_count > buckets_{};
+            std::atomic< uint64_t > count_ = 0;
+            std::atomic< uint64_t > sum_ = 0;
+            std::atomic< uint64_t > min_ = std::numeric_limits< uint64_t >::max();
+            std::atomic< uint64_t > max_ = 0;
+
+
+            static void increase( std::atomic< uint64_t >& counter, uint64_t value ) noexcept
+            {
+                counter.store( counter.load( std::memory_order_relaxed ) + value, std::memory_order_relaxed );
+            }
+
+        public:
+
+            using snapshot_t = histogram_snapshot< Layout >;
+
+
+            /** Records a value, must be called by the owner thread only
+
+            @param [in] value - the value
+            @throw nothing
+            */
+            void record( uint64_t value ) noexcept
+            {
+                increase( buckets_[ Layout::bucket( value ) ], 1 );
+                increase( count_, 1 );
+                increase( sum_, value );
+                if ( value < min_.load( std::memory_order_relaxed ) ) min_.store( value, std::memory_order_relaxed );
+                if ( value > max_.load( std::memory_order_relaxed ) ) max_.store( value, std::memory_order_relaxed );
+            }
+
+
+            /** Adds the histogram to a snapshot
+
+            @param [in/out] snapshot - the snapshot
+            @throw nothing
+            */
+            void merge_to( snapshot_t& snapshot ) const noexcept
+            {
+                for ( size_t i = 0; i < Layout::bucket_count; ++i ) snapshot.buckets_[ i ] += buckets_[ i ].load( std::memory_order_relaxed );
+                snapshot.count_ += count_.load( std::memory_order_relaxed );
+                snapshot.sum_ += sum_.load( std::memory_order_relaxed );
+                snapshot.min_ = std::min( snapshot.min_, min_.load( std::memory_order_relaxed ) );
+                snapshot.max_ = std::max( snapshot.max_, max_.load( std::memory_order_relaxed ) );
+            }
+        };
+    }
+}
+
+#endif
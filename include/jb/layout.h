@@ -0,0 +1,55 @@
+#ifndef __JB__LAYOUT__H__
+#define __JB__LAYOUT__H__
+
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Memory layout of structures kept in large numbers, selected by Policies::layout
+
+        Fields of a page descriptor get grouped by the threads writing them, each group starts at group_alignment
+        boundary, and the whole descriptor is aligned to a cache line so that neighbour descriptors never share one.
+        The groups of mapped_page are:
+
+            walk - next_ (owned/released by every walker passing the page), offset_ (compared by the walkers) and
+                generation_ (read by thread cache hits, changed when the page leaves its bucket)
+            hold - ref_count_ (changed by every page reference taken or dropped) and shard_ (read on the last drop)
+            lock - lock_count_ and mapping_ (changed by lock/unlock) and file_ (read on the first lock)
+
+        Padded layout puts each group on its own cache line: a walker passing a page does not invalidate the line
+        the page holders update, and neither of them does that to lockers. That costs 3 cache lines per resident
+        page (192 bytes, 192MB per million pages). Compact layout packs the groups into a single line (64 bytes) at
+        the price of false sharing between walkers, holders and lockers of the same page, that matters only for a
+        page hot on several CPUs at once. benchmark/layout.cpp measures both and reports the overhead
+
+        rare_exclusive_frequent_shared_mutex takes the layout as a template argument and aligns each of its atomics
+        to group_alignment, i.e. padded takes 33 cache lines per mutex and compact takes 33 words. The other
+        cache-line padded atomics (epoch and snapshot registry counters, magazine_depot and free_space_map slots,
+        cache and dirty page map counters) are not per-page or per-lock: there is a fixed handful of them per
+        structure, so they stay padded whatever the layout
+
+        Layout concept:
+            group_alignment - alignment of a group of fields written together
+        */
+        struct padded_layout
+        {
+            static constexpr size_t group_alignment = std::hardware_destructive_interference_size;
+        };
+
+
+        /** Compact layout, see padded_layout
+        */
+        struct compact_layout
+        {
+            static constexpr size_t group_alignment = alignof( std::atomic< uintptr_t > );
+        };
+    }
+}
+
+#endif
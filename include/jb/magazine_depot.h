@@ -0,0 +1,262 @@
+#ifndef __JB__MAGAZINE_DEPOT__H__
+#define __JB__MAGAZINE_DEPOT__H__
+
+
+#include "backoff.h"
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#include <assert.h>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Keeps free objects in per-thread magazines backed by a global depot (Bonwick's magazine layer)
+
+        A magazine is a fixed-size stack of free objects. Each slot, chosen by thread id hash like the shared
+        locks of rare_exclusive_frequent_shared_mutex, holds two magazines: the loaded one serves allocations and
+        frees, the previous one absorbs ping-ponging between them. Only when both are empty (full) the slot
+        exchanges a whole magazine with the depot under the depot mutex, so the global lock is taken once per
+        MagazineSize operations at most. Slots lay in separate cache lines and contend only on hash collisions.
+
+        The depot does not create objects: allocate() returns nullptr on miss and the caller is expected to
+        create a batch of objects and free() the spare ones
+
+        @tparam T - object type
+        @tparam MagazineSize - number of objects in a magazine
+        @tparam SlotCount - number of slots
+        @tparam Backoff - waiting strategy for a busy slot
+        */
+        template < typename T, size_t MagazineSize = 16, size_t SlotCount = 31, typename Backoff = backoff<> >
+        class magazine_depot
+        {
+            static_assert( MagazineSize && SlotCount );
+
+            struct magazine
+            {
+                size_t count_ = 0;
+                std::array< T*, MagazineSize > items_;
+
+                bool empty() const noexcept { return !count_; }
+                bool full() const noexcept { return MagazineSize == count_; }
+            };
+
+            struct alignas( std::hardware_destructive_interference_size ) slot
+            {
+                std::atomic< bool > busy_ = false;
+                magazine* loaded_ = nullptr;
+                magazine* previous_ = nullptr;
+            };
+
+            std::array< slot, SlotCount > slots_;
+
+            std::mutex guard_;
+            std::vector< magazine* > full_;
+            std::vector< magazine* > empty_;
+            size_t magazine_count_ = 0;
+
+
+            /** Owns a slot for the time of life
+            */
+            class slot_lock
+            {
+                slot& slot_;
+
+            public:
+
+                explicit slot_lock( slot& s ) noexcept : slot_( s )
+                {
+                    for ( Backoff backoff; slot_.busy_.exchange( true, std::memory_order_acquire ); backoff() );
+                }
+
+                ~slot_lock() { slot_.busy_.store( false, std::memory_order_release ); }
+            };
+
+
+            /** Provides slot of calling thread
+            */
+            slot& get_slot() noexcept
+            {
+                return slots_[ std::hash< std::thread::id >()( std::this_thread::get_id() ) % SlotCount ];
+            }
+
+
+            /** Creates new magazine, must be called under the guard
+
+            Both depot lists get capacity for all the magazines, so moving a magazine to the depot never throws
+
+            @throw std::bad_alloc
+            */
+            magazine* new_magazine()
+            {
+                full_.reserve( magazine_count_ + 1 );
+                empty_.reserve( magazine_count_ + 1 );
+
+                auto m = new magazine;
+                ++magazine_count_;
+                return m;
+            }
+
+
+            /** Makes sure a slot has both magazines
+
+            @throw std::bad_alloc
+            */
+            void equip( slot& s )
+            {
+                if ( s.loaded_ && s.previous_ ) return;
+
+                std::unique_lock depot_lock( guard_ );
+                if ( !s.loaded_ ) s.loaded_ = new_magazine();
+                if ( !s.previous_ ) s.previous_ = new_magazine();
+            }
+
+        public:
+
+            /** Default constructor, creates empty depot
+
+            @throw nothing
+            */
+            magazine_depot() noexcept = default;
+
+
+            /** Explicitly deleted move constructor, makes the class non-copyable/movable
+            */
+            magazine_depot( magazine_depot&& ) = delete;
+
+
+            /** Destructor, releases magazines, not the objects
+            */
+            ~magazine_depot()
+            {
+                for ( auto& s : slots_ )
+                {
+                    delete s.loaded_;
+                    delete s.previous_;
+                }
+
+                for ( auto m : full_ ) delete m;
+                for ( auto m : empty_ ) delete m;
+            }
+
+
+            /** Takes a free object
+
+            @retval the object, nullptr if there is no free object
+            @throw nothing
+            */
+            T* allocate() noexcept
+            {
+                auto& s = get_slot();
+                slot_lock lock( s );
+
+                if ( s.loaded_ && !s.loaded_->empty() )
+                {
+                    return s.loaded_->items_[ --s.loaded_->count_ ];
+                }
+
+                if ( s.previous_ && !s.previous_->empty() )
+                {
+                    std::swap( s.loaded_, s.previous_ );
+                    return s.loaded_->items_[ --s.loaded_->count_ ];
+                }
+
+                // both magazines are empty: exchange the loaded one for a full one from the depot
+                {
+                    std::unique_lock depot_lock( guard_ );
+
+                    if ( full_.empty() ) return nullptr;
+
+                    auto m = full_.back();
+                    full_.pop_back();
+
+                    if ( s.loaded_ ) empty_.push_back( s.loaded_ );
+
+                    s.loaded_ = m;
+                }
+
+                return s.loaded_->items_[ --s.loaded_->count_ ];
+            }
+
+
+            /** Puts a free object
+
+            @param [in] item - the object
+            @throw std::bad_alloc (the object did not get accepted)
+            */
+            void free( T* item )
+            {
+                assert( item );
+
+                auto& s = get_slot();
+                slot_lock lock( s );
+
+                equip( s );
+
+                if ( !s.loaded_->full() )
+                {
+                    s.loaded_->items_[ s.loaded_->count_++ ] = item;
+                    return;
+                }
+
+                if ( !s.previous_->full() )
+                {
+                    std::swap( s.loaded_, s.previous_ );
+                    s.loaded_->items_[ s.loaded_->count_++ ] = item;
+                    return;
+                }
+
+                // both magazines are full: exchange the loaded one for an empty one from the depot
+                {
+                    std::unique_lock depot_lock( guard_ );
+
+                    magazine* m = nullptr;
+                    if ( !empty_.empty() )
+                    {
+                        m = empty_.back();
+                        empty_.pop_back();
+                    }
+                    else
+                    {
+                        m = new_magazine();
+                    }
+
+                    full_.push_back( s.loaded_ );
+
+                    s.loaded_ = m;
+                }
+
+                s.loaded_->items_[ s.loaded_->count_++ ] = item;
+            }
+
+
+            /** Visits all the objects kept by the depot, not thread-safe
+
+            @param [in] fn - callable( T* )
+            */
+            template < typename Fn >
+            void for_each( Fn&& fn )
+            {
+                auto visit = [&]( magazine* m ) {
+                    if ( m ) for ( size_t i = 0; i < m->count_; ++i ) fn( m->items_[ i ] );
+                };
+
+                for ( auto& s : slots_ )
+                {
+                    visit( s.loaded_ );
+                    visit( s.previous_ );
+                }
+
+                for ( auto m : full_ ) visit( m );
+            }
+        };
+    }
+}
+
+#endif
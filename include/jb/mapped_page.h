@@ -1,4 +1,5 @@
-#include "aligned_atomic.h"
+#include <atomic>
+#include <new>
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 
 
@@ -6,72 +7,139 @@ namespace jb
 {
     namespace details
     {
+        /** Page descriptor, fields are grouped by the threads writing them, see layout.h
+        */
         template < typename Policies >
-        class storage_file< Policies >::cache::mapped_page
+        class alignas( std::hardware_destructive_interference_size ) storage_file< Policies >::cache::mapped_page
         {
             friend class cache;
+            friend class cache::shard;
 
             using safe_mapped_area = typename storage_file::safe_mapped_area;
 
-            storage_file& file_;
+            static constexpr size_t group_alignment_ = Policies::layout::group_alignment;
+
+            // walk group
+            alignas( group_alignment_ ) std::atomic< uintptr_t > next_ = 0;
             size_t offset_ = 0;
-            aligned_atomic< uintptr_t > next_ = nullptr;
-            aligned_atomic< size_t > ref_count_ = 0;
-            aligned_atomic< int > lock_count_ = -1;
+            std::atomic< uint32_t > generation_ = 0;    // changes each time the page gets unlinked
+
+            // hold group
+            alignas( group_alignment_ ) std::atomic< size_t > ref_count_ = 0;
+            shard& shard_;
+
+            // lock group
+            alignas( group_alignment_ ) std::atomic< int > lock_count_ = -1;
+            storage_file& file_;
             safe_mapped_area mapping_;
 
             static constexpr int unlocked_ = -1;
             static constexpr int under_locking_ = 0;
             static constexpr int once_locked_ = 1;
 
+
+            /** Drops a reference, the last one lets the cache to recycle the page
+            */
+            void release() noexcept
+            {
+                // the page must not be recycled before we are done with it
+                auto pin = shard_.epoch_.pin();
+
+                if ( 1 == ref_count_.fetch_sub( 1, std::memory_order_acq_rel ) )
+                {
+                    shard_.try_release_mapped_page( this );
+                }
+            }
+
         public:
 
             using mapped_page_ptr = boost::intrusive_ptr< mapped_page >;
 
-            void intrusive_ptr_add_ref( mapped_page* page )
+            mapped_page( storage_file& file, shard& s ) noexcept : shard_( s ), file_( file ) {}
+
+            friend void intrusive_ptr_add_ref( mapped_page* page ) noexcept
             {
                 assert( page );
-                page->ref_count_.fetch_add( 1 );
+                page->ref_count_.fetch_add( 1, std::memory_order_acq_rel );
             }
 
-            void intrusive_ptr_release( mapped_page* page )
+            friend void intrusive_ptr_release( mapped_page* page ) noexcept
             {
                 assert( page );
-                if ( 1 == page->ref_count_.fetch_sub( 1 ) )
-                {
-                    page->file_.mark_page_as_unused( page );
-                }
+                page->release();
             }
 
             void lock()
             {
-                if ( auto lock_count = lock_count_.fetch_add( 1, std::memory_order_acq_rel ); unlocked_ == lock_count )
-                {
-                    mapping_ = std::move( file_.map_page( offset_ ) );
-                    lock_count_.store( once_locked_, std::memory_order_release );
-                }
-                else for ( size_t spin = 1; lock_count == under_locking_; ++spin )
+                typename Policies::tracer::scope trace( trace_event::page_lock, offset_ );
+
+                for ( typename Policies::backoff backoff; ; backoff() )
                 {
-                    static constexpr size_t spin_count = 1 << 16;
-                    if ( spin % spin_count == 0 ) std::this_thread::yield();
+                    auto lock_count = lock_count_.load( std::memory_order_acquire );
+
+                    if ( unlocked_ == lock_count )
+                    {
+                        if ( lock_count_.compare_exchange_weak( lock_count, under_locking_, std::memory_order_acq_rel ) )
+                        {
+                            try
+                            {
+                                mapping_ = file_.map_page( offset_ );
+                            }
+                            catch ( ... )
+                            {
+                                lock_count_.store( unlocked_, std::memory_order_release );
+                                throw;
+                            }
+
+                            lock_count_.store( once_locked_, std::memory_order_release );
+                            return;
+                        }
+                    }
+                    else if ( under_locking_ != lock_count )
+                    {
+                        if ( lock_count_.compare_exchange_weak( lock_count, lock_count + 1, std::memory_order_acq_rel ) ) return;
+                    }
                 }
             }
 
             void unlock() noexcept
             {
-                if ( once_locked_ == lock_count_.fetch_sub( 1, std::memory_order_acq_rel ) )
+                for ( typename Policies::backoff backoff; ; backoff() )
                 {
-                    data_ = nullptr;
-                    mapping_.swap( safe_mapped_area{} );
-                    lock_count_.store( unlocked_ );
+                    auto lock_count = lock_count_.load( std::memory_order_acquire );
+                    assert( lock_count >= once_locked_ );
+
+                    if ( once_locked_ == lock_count )
+                    {
+                        if ( lock_count_.compare_exchange_weak( lock_count, under_locking_, std::memory_order_acq_rel ) )
+                        {
+                            mapping_.reset();
+                            lock_count_.store( unlocked_, std::memory_order_release );
+                            return;
+                        }
+                    }
+                    else if ( lock_count_.compare_exchange_weak( lock_count, lock_count - 1, std::memory_order_acq_rel ) )
+                    {
+                        return;
+                    }
                 }
             }
 
-            void* data() const
+            void mark_dirty()
+            {
+                file_.mark_dirty( offset_ );
+            }
+
+            size_t offset() const noexcept
+            {
+                return offset_;
+            }
+
+            void* data() const noexcept
             {
-                return nullptr;
+                return mapping_.get();
             }
         };
 
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,365 @@
+#ifndef __JB__MERGED_CURSOR__H__
+#define __JB__MERGED_CURSOR__H__
+
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <assert.h>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Implements K-way merge of ordered key streams coming from different mount points into the single
+
+        ordered stream of logical keys
+
+        Every stream (lane) iterates physical keys of a physical volume under some physical path. The cursor translates
+        physical keys into logical ones on the fly (replacing physical prefix with logical one) and merges the lanes
+        using loser tree, so each step costs O(log K) comparisons. If the same logical key comes from several lanes
+        the one from the lane with the highest priority wins and the others are skipped (shadowed) without being
+        materialized. If the winner is a deletion mark the key is omitted entirely. The only key being materialized
+        is the current one, so memory consumption does not depend on number of the keys being iterated.
+
+        Source concept:
+            bool valid() const - true if the source is not exhausted
+            key() const - current physical key, must be convertible to basic_string_view
+            bool deleted() const - true if current key is a deletion mark
+            value() const - current value
+            void next() - moves the source forward
+
+        @tparam Policies - compile-time settings
+        @tparam Source - ordered stream of physical keys
+        */
+        template < typename Policies, typename Source >
+        class merged_cursor
+        {
+        public:
+
+            using key_t = std::basic_string< typename Policies::key_char_t, typename Policies::key_traits_t >;
+            using key_view_t = std::basic_string_view< typename Policies::key_char_t, typename Policies::key_traits_t >;
+
+        private:
+
+            using traits_t = typename Policies::key_traits_t;
+
+            struct lane
+            {
+                Source source_;
+                key_t physical_prefix_;
+                size_t physical_path_length_;
+                key_t logical_path_;
+                int priority_;
+                bool exhausted_;
+            };
+
+            static constexpr size_t none_ = std::numeric_limits< size_t >::max();
+
+            std::vector< lane > lanes_;
+            std::vector< size_t > tree_;
+            key_t current_;
+            bool valid_ = false;
+
+
+            /** Compares two keys represented as concatenation of two segments each
+
+            @param [in] a1, a2 - segments of the 1st key
+            @param [in] b1, b2 - segments of the 2nd key
+            @retval negative, zero or positive value like std::char_traits<>::compare() does
+            @throw nothing
+            */
+            static int compare( key_view_t a1, key_view_t a2, key_view_t b1, key_view_t b2 ) noexcept
+            {
+                while ( true )
+                {
+                    if ( a1.empty() ) { a1 = a2; a2 = key_view_t{}; }
+                    if ( b1.empty() ) { b1 = b2; b2 = key_view_t{}; }
+
+                    if ( a1.empty() || b1.empty() )
+                    {
+                        return a1.empty() ? ( b1.empty() ? 0 : -1 ) : 1;
+                    }
+
+                    auto chunk = std::min( a1.size(), b1.size() );
+                    if ( auto rc = traits_t::compare( a1.data(), b1.data(), chunk ); rc )
+                    {
+                        return rc;
+                    }
+
+                    a1.remove_prefix( chunk );
+                    b1.remove_prefix( chunk );
+                }
+            }
+
+
+            /** Provides suffix of current physical key in given lane, i.e. the part to be appended to the logical path
+
+            @param [in] l - lane
+            @retval suffix of current physical key
+            @throw nothing
+            */
+            static key_view_t suffix( const lane& l ) noexcept
+            {
+                return key_view_t( l.source_.key() ).substr( l.physical_path_length_ );
+            }
+
+
+            /** Checks if given lane exhausted, i.e. source exhausted or left requested physical subtree
+
+            @param [in/out] l - lane
+            @retval true if the lane exhausted
+            @throw nothing
+            */
+            static bool exhausted( lane& l ) noexcept
+            {
+                if ( !l.exhausted_ )
+                {
+                    if ( !l.source_.valid() )
+                    {
+                        l.exhausted_ = true;
+                    }
+                    else
+                    {
+                        key_view_t key( l.source_.key() );
+                        l.exhausted_ = key.substr( 0, l.physical_prefix_.size() ) != key_view_t( l.physical_prefix_ );
+                    }
+                }
+
+                return l.exhausted_;
+            }
+
+
+            /** Defines order of lanes in the tournament: exhausted lanes go last, lower logical key goes first,
+
+            for equal keys higher priority goes first, for equal priorities lane added earlier goes first
+
+            @param [in] a, b - lane indices
+            @retval true if lane a precedes lane b
+            @throw nothing
+            */
+            bool less( size_t a, size_t b ) noexcept
+            {
+                if ( a == none_ || exhausted( lanes_[ a ] ) ) return false;
+                if ( b == none_ || exhausted( lanes_[ b ] ) ) return true;
+
+                const auto& la = lanes_[ a ];
+                const auto& lb = lanes_[ b ];
+
+                if ( auto rc = compare( la.logical_path_, suffix( la ), lb.logical_path_, suffix( lb ) ); rc )
+                {
+                    return rc < 0;
+                }
+
+                return la.priority_ != lb.priority_ ? la.priority_ > lb.priority_ : a < b;
+            }
+
+
+            /** Checks if the winner of the tournament exists and bears given logical key
+
+            @param [in] key - logical key
+            @retval true if the top lane holds the key
+            @throw nothing
+            */
+            bool top_equals( key_view_t key ) noexcept
+            {
+                auto top = tree_[ 0 ];
+                if ( exhausted( lanes_[ top ] ) ) return false;
+
+                const auto& l = lanes_[ top ];
+                return !compare( l.logical_path_, suffix( l ), key, key_view_t{} );
+            }
+
+
+            /** Moves forward the lane won the tournament and replays the tournament from the lane's leaf to the root
+
+            @throw nothing (unless Source::next() throws)
+            */
+            void advance_top()
+            {
+                auto winner = tree_[ 0 ];
+                lanes_[ winner ].source_.next();
+
+                for ( auto node = ( winner + lanes_.size() ) / 2; node > 0; node /= 2 )
+                {
+                    if ( less( tree_[ node ], winner ) ) std::swap( tree_[ node ], winner );
+                }
+
+                tree_[ 0 ] = winner;
+            }
+
+
+            /** Builds loser tree over the lanes
+
+            Leaves are not stored explicitly: leaf of lane i is node (K + i), internal nodes 1...(K - 1) keep losers
+            and node 0 keeps the overall winner
+
+            @throw std::bad_alloc
+            */
+            void build()
+            {
+                auto count = lanes_.size();
+                tree_.assign( count, none_ );
+
+                std::vector< size_t > winners( 2 * count, none_ );
+                for ( size_t i = 0; i < count; ++i ) winners[ count + i ] = i;
+
+                for ( auto node = count - 1; node > 0; --node )
+                {
+                    auto a = winners[ 2 * node ], b = winners[ 2 * node + 1 ];
+                    if ( less( a, b ) )
+                    {
+                        winners[ node ] = a;
+                        tree_[ node ] = b;
+                    }
+                    else
+                    {
+                        winners[ node ] = b;
+                        tree_[ node ] = a;
+                    }
+                }
+
+                tree_[ 0 ] = count > 1 ? winners[ 1 ] : 0;
+            }
+
+
+            /** Positions the cursor onto the first non-deleted key starting from the tournament winner
+
+            Takes the winner, materializes its logical key, skips all shadowed lanes holding the same key, and if
+            the winner is deletion mark repeats the procedure
+
+            @throw std::bad_alloc
+            */
+            void settle()
+            {
+                while ( !exhausted( lanes_[ tree_[ 0 ] ] ) )
+                {
+                    const auto& top = lanes_[ tree_[ 0 ] ];
+                    if ( !top.source_.deleted() )
+                    {
+                        current_.assign( top.logical_path_ );
+                        current_.append( suffix( top ) );
+                        valid_ = true;
+                        return;
+                    }
+
+                    // the key deleted by the most prioritized lane: drop it from all the lanes
+                    current_.assign( top.logical_path_ );
+                    current_.append( suffix( top ) );
+                    do advance_top(); while ( top_equals( current_ ) );
+                }
+
+                valid_ = false;
+            }
+
+        public:
+
+            /** Default constructor, creates exhausted cursor
+
+            @throw nothing
+            */
+            merged_cursor() noexcept = default;
+
+
+            /** Explicitly deleted copy constructor, the cursor is move only
+            */
+            merged_cursor( const merged_cursor& ) = delete;
+            merged_cursor( merged_cursor&& ) noexcept = default;
+            merged_cursor& operator = ( merged_cursor&& ) noexcept = default;
+
+
+            /** Adds another lane to the cursor, must be called before start()
+
+            @param [in] source - ordered source positioned onto the first key to be iterated
+            @param [in] physical_path - physical path of mount point, replaced with logical path in the output
+            @param [in] physical_prefix - the lane ends as soon as source key leaves the prefix
+            @param [in] logical_path - logical path of mount point
+            @param [in] priority - lane priority, the greatest wins when keys collide
+            @throw std::bad_alloc
+            */
+            void add_lane( Source&& source, key_view_t physical_path, key_view_t physical_prefix, key_view_t logical_path, int priority )
+            {
+                assert( physical_prefix.substr( 0, physical_path.size() ) == physical_path );
+                lanes_.push_back( lane{ std::move( source ), key_t( physical_prefix ), physical_path.size(), key_t( logical_path ), priority, false } );
+            }
+
+
+            /** Builds the tournament and positions the cursor onto the first key
+
+            @throw std::bad_alloc
+            */
+            void start()
+            {
+                if ( lanes_.empty() )
+                {
+                    valid_ = false;
+                    return;
+                }
+
+                build();
+                settle();
+            }
+
+
+            /** Checks if the cursor points to a key
+
+            @retval true if the cursor is not exhausted
+            @throw nothing
+            */
+            bool valid() const noexcept { return valid_; }
+
+
+            /** Provides current logical key
+
+            @retval current logical key
+            @throw nothing
+            */
+            const key_t& key() const noexcept
+            {
+                assert( valid_ );
+                return current_;
+            }
+
+
+            /** Provides current value from the lane won the key
+
+            @retval value as the source provides it
+            */
+            decltype( auto ) value() const
+            {
+                assert( valid_ );
+                return lanes_[ tree_[ 0 ] ].source_.value();
+            }
+
+
+            /** Provides priority of the lane won the key
+
+            @retval priority
+            @throw nothing
+            */
+            int priority() const noexcept
+            {
+                assert( valid_ );
+                return lanes_[ tree_[ 0 ] ].priority_;
+            }
+
+
+            /** Moves the cursor to the next logical key skipping shadowed and deleted ones
+
+            @throw std::bad_alloc
+            */
+            void next()
+            {
+                assert( valid_ );
+
+                do advance_top(); while ( top_equals( current_ ) );
+                settle();
+            }
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef __JB__METRICS__H__
+#define __JB__METRICS__H__
+
+
+#include "histogram.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined( _MSC_VER )
+#   include <intrin.h>
+#elif defined( __i386__ ) || defined( __x86_64__ )
+#   include <x86intrin.h>
+#endif
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Public storage operations measured by Policies::metrics
+        */
+        enum class operation : uint8_t
+        {
+            open_virtual_volume,
+            open_physical_volume,
+            close,
+            mount,
+            unmount,
+            scan,
+            count
+        };
+
+
+        /** Cheap monotonic clock for latency measurement
+
+        Reads time stamp counter on x86 (invariant TSC is assumed, that holds for CPUs of the last decade), that
+        costs a few nanoseconds against tens for steady_clock. Ticks get converted to nanoseconds only when a
+        histogram is reported, the ratio is calibrated against steady_clock once
+        */
+        struct tick_clock
+        {
+            static uint64_t now() noexcept
+            {
+#if defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) ) || defined( __i386__ ) || defined( __x86_64__ )
+                return __rdtsc();
+#else
+                return static_cast< uint64_t >( std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+#endif
+            }
+
+
+            /** Provides nanoseconds per tick, the first call takes about 10ms to calibrate
+
+            @throw nothing
+            */
+            static double ns_per_tick() noexcept
+            {
+#if defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) ) || defined( __i386__ ) || defined( __x86_64__ )
+                static const double ratio = [] {
+                    auto time_0 = std::chrono::steady_clock::now();
+                    auto ticks_0 = now();
+                    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+                    auto ticks_1 = now();
+                    auto time_1 = std::chrono::steady_clock::now();
+
+                    auto ns = std::chrono::duration< double, std::nano >( time_1 - time_0 ).count();
+                    return ticks_1 > ticks_0 ? ns / ( ticks_1 - ticks_0 ) : 1.0;
+                }();
+                return ratio;
+#else
+                return 1.0;
+#endif
+            }
+        };
+
+
+        /** Metrics concept implementation that measures nothing, the calls compile away
+
+        Metrics concept:
+            scope( operation ) - RAII object measuring an operation from construction to destruction
+        */
+        struct null_metrics
+        {
+            struct scope
+            {
+                constexpr explicit scope( operation ) noexcept {}
+            };
+        };
+
+
+        /** Keeps latency histogram of each operation per thread
+
+        Recording touches only histograms of the calling thread, so it's lock-free and does not share cache lines
+        between threads: two clock readings and a handful of relaxed loads/stores. The histograms of a thread get
+        registered on its first record and get folded into retired totals when the thread exits. snapshot() merges
+        the histograms of all the threads on demand
+
+        @tparam Clock - clock of now() and ns_per_tick() static methods
+        @tparam Layout - histogram layout
+        */
+        template < typename Clock = tick_clock, typename Layout = histogram_layout<> >
+        class latency_metrics
+        {
+        public:
+
+            using snapshot_t = histogram_snapshot< Layout >;
+
+        private:
+
+            static constexpr size_t operation_count_ = static_cast< size_t >( operation::count );
+
+            using histograms_t = std::array< histogram< Layout >, operation_count_ >;
+
+
+            /** Histograms of all the threads
+            */
+            struct registry
+            {
+                std::mutex guard_;
+                std::vector< std::shared_ptr< histograms_t > > live_;
+                std::array< snapshot_t, operation_count_ > retired_;
+            };
+
+
+            /** Registers histograms of a thread and retires them at thread exit
+            */
+            struct thread_histograms
+            {
+                std::shared_ptr< histograms_t > histograms_ = std::make_shared< histograms_t >();
+
+                thread_histograms()
+                {
+                    auto& r = instance();
+                    std::unique_lock lock( r.guard_ );
+                    r.live_.push_back( histograms_ );
+                }
+
+                ~thread_histograms()
+                {
+                    auto& r = instance();
+                    std::unique_lock lock( r.guard_ );
+
+                    for ( size_t op = 0; op < operation_count_; ++op ) ( *histograms_ )[ op ].merge_to( r.retired_[ op ] );
+                    r.live_.erase( std::find( r.live_.begin(), r.live_.end(), histograms_ ) );
+                }
+            };
+
+
+            static registry& instance()
+            {
+                static registry r;
+                return r;
+            }
+
+
+            static histograms_t& local()
+            {
+                static thread_local thread_histograms h;
+                return *h.histograms_;
+            }
+
+        public:
+
+            /** Measures an operation from construction to destruction
+            */
+            class scope
+            {
+                operation operation_;
+                uint64_t start_;
+
+            public:
+
+                explicit scope( operation op ) noexcept
+                    : operation_( op )
+                    , start_( Clock::now() )
+                {}
+
+                scope( scope&& ) = delete;
+
+                ~scope()
+                {
+                    auto duration = Clock::now() - start_;
+
+                    // registration of the thread might fail only on memory exhaustion, then the record is lost
+                    try
+                    {
+                        local()[ static_cast< size_t >( operation_ ) ].record( duration );
+                    }
+                    catch ( ... )
+                    {
+                    }
+                }
+            };
+
+
+            /** Merges histograms of all the threads for an operation
+
+            @param [in] op - the operation
+            @retval histogram snapshot, values in nanoseconds
+            @throw nothing
+            */
+            static snapshot_t snapshot( operation op ) noexcept
+            {
+                auto index = static_cast< size_t >( op );
+                auto& r = instance();
+
+                snapshot_t result( Clock::ns_per_tick() );
+                std::unique_lock lock( r.guard_ );
+
+                result += r.retired_[ index ];
+                for ( const auto& h : r.live_ ) ( *h )[ index ].merge_to( result );
+
+                return result;
+            }
+        };
+    }
+}
+
+#endif
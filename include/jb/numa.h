@@ -0,0 +1,119 @@
+#ifndef __JB__NUMA__H__
+#define __JB__NUMA__H__
+
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if defined( WIN32 )
+#   include <windows.h>
+#elif defined( __linux__ )
+#   include <sched.h>
+#endif
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Provides NUMA topology of the machine
+
+        The topology is read once: on Linux from sysfs (/sys/devices/system/node/nodeN/cpuM), on Windows from
+        the system. Looking up the node of calling thread costs one sched_getcpu() call, that glibc serves without
+        a syscall. On other platforms (and if the topology is unavailable) the machine looks as a single node
+        */
+        class numa
+        {
+            size_t node_count_ = 1;
+            std::vector< uint16_t > cpu_nodes_;
+
+
+            numa()
+            {
+#if defined( WIN32 )
+                ULONG highest = 0;
+                if ( ::GetNumaHighestNodeNumber( &highest ) ) node_count_ = static_cast< size_t >( highest ) + 1;
+#elif defined( __linux__ )
+                namespace fs = std::filesystem;
+
+                auto index = []( const std::string& name, const char* prefix ) -> long {
+                    auto len = std::char_traits< char >::length( prefix );
+                    if ( name.compare( 0, len, prefix ) || name.size() == len ) return -1;
+                    if ( !std::all_of( name.begin() + len, name.end(), []( char c ) { return c >= '0' && c <= '9'; } ) ) return -1;
+                    return std::stol( name.substr( len ) );
+                };
+
+                std::error_code ec;
+                for ( auto& node : fs::directory_iterator( "/sys/devices/system/node", ec ) )
+                {
+                    auto n = index( node.path().filename().string(), "node" );
+                    if ( n < 0 ) continue;
+
+                    node_count_ = std::max( node_count_, static_cast< size_t >( n ) + 1 );
+
+                    std::error_code cpu_ec;
+                    for ( auto& cpu : fs::directory_iterator( node.path(), cpu_ec ) )
+                    {
+                        auto c = index( cpu.path().filename().string(), "cpu" );
+                        if ( c < 0 ) continue;
+
+                        if ( cpu_nodes_.size() <= static_cast< size_t >( c ) ) cpu_nodes_.resize( c + 1, 0 );
+                        cpu_nodes_[ c ] = static_cast< uint16_t >( n );
+                    }
+                }
+#endif
+            }
+
+
+            static const numa& instance()
+            {
+                static const numa topology;
+                return topology;
+            }
+
+        public:
+
+            /** Provides number of NUMA nodes, at least 1
+
+            @throw std::bad_alloc
+            */
+            static size_t node_count()
+            {
+                return instance().node_count_;
+            }
+
+
+            /** Provides NUMA node the calling thread currently runs on
+
+            The thread could migrate right after the call, so the result is a hint
+
+            @retval node index less than node_count()
+            @throw std::bad_alloc
+            */
+            static size_t current_node()
+            {
+                [[maybe_unused]] auto& topology = instance();
+
+#if defined( WIN32 )
+                PROCESSOR_NUMBER processor;
+                USHORT node = 0;
+                ::GetCurrentProcessorNumberEx( &processor );
+                if ( !::GetNumaProcessorNodeEx( &processor, &node ) ) return 0;
+                return std::min< size_t >( node, topology.node_count_ - 1 );
+#elif defined( __linux__ )
+                auto cpu = ::sched_getcpu();
+                if ( cpu < 0 || static_cast< size_t >( cpu ) >= topology.cpu_nodes_.size() ) return 0;
+                return topology.cpu_nodes_[ cpu ];
+#else
+                return 0;
+#endif
+            }
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef __JB__PAGE_FLUSHER__H__
+#define __JB__PAGE_FLUSHER__H__
+
+
+#include "dirty_page_map.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Writes dirty pages of a storage file back in background
+
+        Every Policies::flush_interval the flusher takes dirty pages from dirty_page_map, coalesces them into
+        runs of contiguous pages (up to Policies::flush_max_run pages each) and initiates write-back of the runs
+        pacing them so that the write-back rate does not exceed Policies::flush_rate bytes per second. Thus dirty
+        data gets trickled to the disk instead of being written by the kernel in storms.
+
+        checkpoint() flushes all dirty pages at once (ignoring the rate) and makes them durable, so after it
+        returns recovery does not need anything logged before the checkpoint began. A read-only target never gets
+        dirty pages, so no thread is started for it
+
+        Target concept:
+            static size_t page_size() - page size
+            bool read_only() - true if the target cannot be modified
+            void flush( size_t offset, size_t size ) - initiates write-back of a range
+            void sync() - makes all initiated write-backs durable
+
+        @tparam Policies - compile-time settings
+        @tparam Target - storage file
+        */
+        template < typename Policies, typename Target >
+        class page_flusher
+        {
+            using run_t = std::pair< size_t, size_t >;
+
+            Target& target_;
+            dirty_page_map& dirty_;
+            std::mutex guard_;
+            std::deque< run_t > runs_;
+            std::mutex stop_guard_;
+            std::condition_variable stop_cv_;
+            bool stop_ = false;
+            std::thread thread_;
+
+
+            /** Number of pages that can be written back during one interval
+            */
+            static size_t pages_per_pass() noexcept
+            {
+                auto bytes = static_cast< size_t >( Policies::flush_rate * std::chrono::duration< double >( Policies::flush_interval ).count() );
+                return std::max< size_t >( 1, bytes / Target::page_size() );
+            }
+
+
+            /** Initiates write-back of the first taken run, must be called under the guard
+
+            @retval number of bytes written back
+            @throw whatever Target::flush() throws, the run stays taken
+            */
+            size_t flush_front()
+            {
+                auto [ first, count ] = runs_.front();
+                target_.flush( first * Target::page_size(), count * Target::page_size() );
+                runs_.pop_front();
+
+                return count * Target::page_size();
+            }
+
+
+            /** Sleeps for given time or until the flusher gets stopped
+
+            @param [in] duration - time to sleep
+            @retval true if the flusher was stopped
+            @throw nothing
+            */
+            template < typename Duration >
+            bool sleep( const Duration& duration ) noexcept
+            {
+                std::unique_lock lock( stop_guard_ );
+                return stop_cv_.wait_for( lock, duration, [&] { return stop_; } );
+            }
+
+
+            /** Takes dirty pages for one interval and writes them back at configured rate
+
+            @throw nothing
+            */
+            void pass() noexcept
+            {
+                try
+                {
+                    {
+                        std::unique_lock lock( guard_ );
+                        if ( runs_.empty() )
+                        {
+                            dirty_.collect( Policies::flush_max_run, pages_per_pass(), [&]( size_t first, size_t count ) {
+                                runs_.emplace_back( first, count );
+                            } );
+                        }
+                    }
+
+                    while ( true )
+                    {
+                        size_t bytes = 0;
+                        {
+                            std::unique_lock lock( guard_ );
+                            if ( runs_.empty() ) break;
+                            bytes = flush_front();
+                        }
+
+                        auto delay = std::chrono::duration< double >( static_cast< double >( bytes ) / Policies::flush_rate );
+                        if ( sleep( delay ) ) break;
+                    }
+                }
+                catch ( ... )
+                {
+                    // failed run stays taken and will be retried by the next pass or checkpoint
+                }
+            }
+
+
+            /** Background thread routine
+
+            @throw nothing
+            */
+            void run() noexcept
+            {
+                while ( !sleep( Policies::flush_interval ) )
+                {
+                    pass();
+                }
+            }
+
+        public:
+
+            page_flusher() = delete;
+            page_flusher( page_flusher&& ) = delete;
+
+
+            /** Constructor, starts background thread for a writable target
+
+            @param [in] target - storage file
+            @param [in] dirty - dirty page map of the file
+            @throw std::system_error if the thread cannot be started
+            */
+            page_flusher( Target& target, dirty_page_map& dirty )
+                : target_( target )
+                , dirty_( dirty )
+            {
+                if ( !target_.read_only() ) thread_ = std::thread( &page_flusher::run, this );
+            }
+
+
+            /** Destructor, stops background thread
+            */
+            ~page_flusher()
+            {
+                {
+                    std::unique_lock lock( stop_guard_ );
+                    stop_ = true;
+                }
+                stop_cv_.notify_all();
+
+                if ( thread_.joinable() ) thread_.join();
+            }
+
+
+            /** Writes back all dirty pages and makes them durable
+
+            A page modified (and marked) before the call is durable once the call returns
+
+            @throw whatever Target::flush()/sync() throw, std::bad_alloc
+            */
+            void checkpoint()
+            {
+                std::unique_lock lock( guard_ );
+
+                dirty_.collect( Policies::flush_max_run, dirty_page_map::capacity(), [&]( size_t first, size_t count ) {
+                    runs_.emplace_back( first, count );
+                } );
+
+                while ( !runs_.empty() ) flush_front();
+
+                target_.sync();
+            }
+        };
+    }
+}
+
+#endif
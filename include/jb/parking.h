@@ -0,0 +1,66 @@
+#ifndef __JB__PARKING__H__
+#define __JB__PARKING__H__
+
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#if defined( WIN32 )
+#   include <windows.h>
+#elif defined( __linux__ )
+#   include <linux/futex.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif
+
+
+namespace jb
+{
+    namespace details
+    {
+        static_assert( sizeof( std::atomic< uint32_t > ) == sizeof( uint32_t ) );
+
+
+        /** Blocks calling thread while the word holds expected value (substitutes C++20 std::atomic<>::wait)
+
+        The thread sleeps in the kernel (futex on Linux, WaitOnAddress on Windows) instead of burning CPU. On other
+        platforms it merely yields. The call could return spuriously, so a caller must re-check its condition
+
+        @param [in] word - the word to wait on
+        @param [in] expected - the value to wait while
+        @throw nothing
+        */
+        inline void park( const std::atomic< uint32_t >& word, uint32_t expected ) noexcept
+        {
+            if ( word.load( std::memory_order_acquire ) != expected ) return;
+
+#if defined( WIN32 )
+            ::WaitOnAddress( const_cast< std::atomic< uint32_t >* >( &word ), &expected, sizeof( expected ), INFINITE );
+#elif defined( __linux__ )
+            ::syscall( SYS_futex, &word, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0 );
+#else
+            std::this_thread::yield();
+#endif
+        }
+
+
+        /** Wakes up all the threads parked on the word (substitutes C++20 std::atomic<>::notify_all)
+
+        @param [in] word - the word
+        @throw nothing
+        */
+        inline void unpark_all( std::atomic< uint32_t >& word ) noexcept
+        {
+#if defined( WIN32 )
+            ::WakeByAddressAll( &word );
+#elif defined( __linux__ )
+            ::syscall( SYS_futex, &word, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0 );
+#else
+            ( void )word;
+#endif
+        }
+    }
+}
+
+#endif
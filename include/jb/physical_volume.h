@@ -4,7 +4,9 @@
 
 #include "ret_codes.h"
 #include "exception.h"
+#include "seqlock.h"
 #include <filesystem>
+#include <type_traits>
 
 namespace jb
 {
@@ -13,17 +15,36 @@ namespace jb
 
     namespace details
     {
+        /** Represents physical volume
+
+        The path never changes after the volume is opened, so it's read without any coordination. Mutable metadata
+        is kept in a seqlock-protected block: hot paths take a consistent snapshot of it without a store, and a
+        change is a rare version bump
+        */
         template < typename Policies >
         class physical_volume
         {
+        public:
+
+            /** Mutable metadata of the volume, kept trivial as seqlock copies it word by word
+            */
+            struct metadata
+            {
+                int priority_;
+            };
+
+            static_assert( std::is_trivial_v< metadata > );
+
+        private:
+
             std::filesystem::path path_;
-            int priority_;
+            seqlock< metadata, typename Policies::backoff > metadata_;
 
             friend class storage< Policies >;
 
             explicit physical_volume( const std::filesystem::path& path, int priority ) try
                 : path_( std::move( std::filesystem::absolute( path ) ) )
-                , priority_( priority )
+                , metadata_( metadata{ priority } )
             {
             }
             catch ( const std::filesystem::filesystem_error & e )
@@ -37,7 +58,32 @@ namespace jb
             physical_volume( physical_volume&& ) = delete;
 
             const std::filesystem::path& path() const noexcept { return path_; }
-            int priority() const noexcept { return priority_; }
+            int priority() const noexcept { return metadata_.load().priority_; }
+
+
+            /** Takes consistent snapshot of the metadata
+
+            @throw nothing
+            */
+            metadata info() const noexcept { return metadata_.load(); }
+
+
+            /** Provides metadata version, changes with each metadata modification
+
+            @throw nothing
+            */
+            uint64_t version() const noexcept { return metadata_.version(); }
+
+
+            /** Changes volume priority
+
+            @param [in] priority - new priority
+            @throw nothing
+            */
+            void set_priority( int priority ) noexcept
+            {
+                metadata_.update( [&]( metadata& m ) noexcept { m.priority_ = priority; } );
+            }
         };
     }
 }
@@ -3,11 +3,23 @@
 
 
 #include "aligned_atomic.h"
+#include "backoff.h"
+#include "tracer.h"
+#include "layout.h"
+#include <algorithm>
 #include <array>
+#include <memory>
 #include <functional>
 #include <thread>
+#include <type_traits>
 #include <assert.h>
 
+#if defined( WIN32 )
+#   include <windows.h>
+#elif defined( __linux__ )
+#   include <sched.h>
+#endif
+
 
 namespace jb
 {
@@ -30,107 +42,265 @@ namespace jb
 
         The cost of this optimization is extremely heavy exclusive lock, cuz it requires to exam all shared lock atomics
 
-        @tparam SharedLockCount - number of atomics to represent shared lock
+        Hashing locker ids spreads threads over the atomics by chance, so two threads running on different cores
+        still could share a cache line. Zero SharedLockCount turns per-CPU mode on: the number of atomics equals
+        the number of CPUs, determined at runtime, and shared_lock picks the atomic of the CPU the thread runs on.
+        A thread could migrate while holding the lock, so the lock is released through the same atomic it was
+        taken on (shared_lock remembers it), the only effect of migration is a rare cache line sharing.
+
+        Writers are not starved by steady read load: as soon as a writer signals exclusive lock no new shared lock
+        gets through, a reader backs its atomic off and waits for the writer to leave, so the writer waits only for
+        readers that already are inside. Both sides spin for a while and then park (futex on Linux, WaitOnAddress
+        on Windows) instead of yielding in a loop: parked readers and writers wait on the exclusive lock word, a
+        writer waiting for a reader to leave parks on the draining word that the leaving reader clears.
+
+        Padded layout (see layout.h) spends a cache line per atomic, i.e. 33 lines (2112 bytes) with default 31 atomics.
+        Compact layout packs the atomics into adjacent words (264 bytes) for mutexes kept in large numbers, giving up
+        the whole point of splitting: readers hashed to different atomics share cache lines again
+
+        @tparam SharedLockCount - number of atomics to represent shared lock, 0 - one atomic per CPU
+        @tparam Backoff - waiting strategy, a thread having to wait parks as soon as the strategy stops spinning
+        @tparam Tracer - receives lock waits that end up parking the thread, see tracer.h
+        @tparam Layout - padded_layout or compact_layout, see layout.h
         */
-        template < size_t SharedLockCount = 31 >
+        template < size_t SharedLockCount = 31, typename Backoff = backoff<>, typename Tracer = null_tracer, typename Layout = padded_layout >
         class rare_exclusive_frequent_shared_mutex
         {
-            static_assert( SharedLockCount );
+            static constexpr bool per_cpu_ = !SharedLockCount;
 
-            aligned_atomic< bool > exclusive_lock_;
-            std::array< aligned_atomic< size_t >, SharedLockCount > shared_locks_;
-            static constexpr size_t spin_count_per_lock = 0x1000;
+            template < typename T >
+            using atomic_t = aligned_atomic< T, std::atomic< T >, Layout::group_alignment >;
 
-        public:
+            using shared_locks_t = std::conditional_t< per_cpu_,
+                std::unique_ptr< atomic_t< size_t >[] >,
+                std::array< atomic_t< size_t >, SharedLockCount > >;
 
-            static constexpr size_t shared_lock_count() noexcept { return SharedLockCount; }
+            static constexpr uint32_t free_ = 0;
+            static constexpr uint32_t locked_ = 1;
+            static constexpr uint32_t contended_ = 2;
+
+            atomic_t< uint32_t > exclusive_lock_ = free_;
+            atomic_t< uint32_t > draining_ = 0;
+            shared_locks_t shared_locks_;
+            static constexpr size_t spin_count_per_lock = 0x1000;
 
-            /** Default constructor, initializes an instance to unlocked state
+
+            /** Provides number of CPUs, at least 1
 
             @throw nothing
             */
-            rare_exclusive_frequent_shared_mutex() noexcept = default;
+            static size_t cpu_count() noexcept
+            {
+                static const size_t count = std::max< size_t >( std::thread::hardware_concurrency(), 1 );
+                return count;
+            }
 
 
-            /** Explicitly deleted moving constructor, makes the class to be non-copyable/movable
+            /** Wakes up a writer waiting for shared locks to be released, if any
+
+            Must be called after a shared lock atomic was decremented. Touches the draining word for writing only
+            if a writer really waits, so leaving readers do not bounce its cache line
+
+            @throw nothing
             */
-            rare_exclusive_frequent_shared_mutex( rare_exclusive_frequent_shared_mutex&& ) = delete;
+            void notify_drained() noexcept
+            {
+                if ( draining_.load( std::memory_order_seq_cst ) && draining_.exchange( 0, std::memory_order_seq_cst ) )
+                {
+                    draining_.notify_all();
+                }
+            }
 
 
-            /** Tries to take EXCLUSIVE lock over the mutex, returns immediately
+            /** Signals exclusive lock
 
-            @retval true if the operation succeeded
+            @param [in] spin_count - number of tries
+            @param [in] park - if the thread should park after spins exhausted, otherwise fail
+            @retval true if the exclusive lock signalled
             @throw nothing
             */
-            bool try_lock( size_t spin_count = 0 ) noexcept
+            bool acquire_exclusive( size_t spin_count, bool park ) noexcept
             {
-                size_t spin = 0;
-                spin_count = spin_count ? spin_count : spin_count_per_lock * SharedLockCount;
-
-                // try to signal exclusive lock
-                while ( true )
+                Backoff backoff;
+                for ( size_t spin = 1; spin <= spin_count && ( !park || backoff.spinning() ); ++spin )
                 {
-                    if ( !exclusive_lock_.exchange( true, std::memory_order_acq_rel ) ) break;
+                    auto expected = free_;
+                    if ( exclusive_lock_.compare_exchange_weak( expected, locked_, std::memory_order_seq_cst ) ) return true;
 
-                    // if spins exhausted - fail
-                    if ( 0 == ++spin % spin_count ) return false;
+                    if ( park ) backoff(); else Backoff::pause();
                 }
-                // exclusive lock signalled!
 
-                // mark all shared locks as taken
-                std::array< bool, SharedLockCount > shared_released;
-                shared_released.fill( false );
+                if ( !park ) return false;
 
-                // wait until all shared locks get released
-                while ( true )
+                typename Tracer::scope trace( trace_event::exclusive_lock_wait );
+
+                // mark the lock contended, so the owner wakes us up on unlock()
+                while ( exclusive_lock_.exchange( contended_, std::memory_order_seq_cst ) != free_ )
                 {
-                    // throught all shared locks
-                    auto sl_it = shared_locks_.begin();
-                    auto sr_it = shared_released.begin();
-                    for ( ; sl_it != shared_locks_.end(); ++sl_it, ++sr_it )
+                    exclusive_lock_.wait( contended_ );
+                }
+
+                return true;
+            }
+
+
+            /** Waits until all shared locks get released, must be called with exclusive lock signalled
+
+            Once we've seen a shared lock released we never check it again: it could not have been taken again
+            cuz we had signalled exclusive lock
+
+            @param [in] spin_count - number of tries before to park (or to fail)
+            @param [in] park - if the thread should park after spins exhausted, otherwise fail
+            @retval true if all shared locks released
+            @throw nothing
+            */
+            bool drain( size_t spin_count, bool park ) noexcept
+            {
+                Backoff backoff;
+                size_t spin = 0;
+                for ( size_t i = 0; i < shared_lock_count(); )
+                {
+                    // check if shared lock got released
+                    if ( 0 == shared_locks_[ i ].load( std::memory_order_seq_cst ) )
                     {
-                        //
-                        // if we've already seen that shared lock released -- simply skip it, 
-                        // it could not have been taken again cuz we had signalled exclusive lock
-                        //
-                        if ( *sr_it ) continue;
-
-                        // check if shared lock got released
-                        if ( 0 != sl_it->load( std::memory_order_acquire ) )
-                        {
-                            // the lock still taken -> yeild other threads if spins exhausted 
-                            if ( 0 == ++spin % spin_count )
-                            {
-                                exclusive_lock_.store( false, std::memory_order_release );
-                                return false;
-                            }
-                        }
-                        else
+                        ++i;
+                    }
+                    // the lock still taken -> park or fail if spins exhausted
+                    else if ( 0 == ++spin % spin_count || ( park && !backoff.spinning() ) )
+                    {
+                        if ( !park ) return false;
+
+                        // ask leaving readers to wake us up and re-check before to fall asleep
+                        draining_.store( 1, std::memory_order_seq_cst );
+                        if ( shared_locks_[ i ].load( std::memory_order_seq_cst ) )
                         {
-                            // mark lock as released
-                            *sr_it = true;
+                            typename Tracer::scope trace( trace_event::exclusive_lock_wait );
+                            draining_.wait( 1 );
                         }
+                        backoff.reset();
+                    }
+                    else if ( park )
+                    {
+                        backoff();
+                    }
+                    else
+                    {
+                        Backoff::pause();
                     }
+                }
 
-                    //
-                    // if there is not taken shared locks anymore - succeeded, the last sync operation on the
-                    // control flow was sl_it->load( std::memory_order_acquire ), so the whole function guaratnies
-                    // ACQUIRE semantic
-                    //
-                    if ( std::find( shared_released.begin(), shared_released.end(), false ) == shared_released.end() ) return true;
+                draining_.store( 0, std::memory_order_relaxed );
+                return true;
+            }
+
+
+            /** Provides shared lock atomic for given locker
+
+            @param [in] locker_id - an identifier of the locker
+            @throw nothing
+            */
+            atomic_t< size_t >& shared_lock_for( size_t locker_id ) noexcept
+            {
+                return shared_locks_[ locker_id % shared_lock_count() ];
+            }
+
+        public:
+
+            /** Provides number of atomics to represent shared lock, known at run time only in per-CPU mode
+
+            @throw nothing
+            */
+            static size_t shared_lock_count() noexcept
+            {
+                if constexpr ( per_cpu_ )
+                {
+                    return cpu_count();
+                }
+                else
+                {
+                    return SharedLockCount;
                 }
             }
 
 
+            /** Provides an identifier that maps the calling thread to the atomic of its current CPU
+
+            Falls back to thread id hash if the platform does not tell current CPU
+
+            @throw nothing
+            */
+            static size_t current_cpu() noexcept
+            {
+#if defined( WIN32 )
+                return static_cast< size_t >( ::GetCurrentProcessorNumber() );
+#elif defined( __linux__ )
+                if ( auto cpu = ::sched_getcpu(); cpu >= 0 ) return static_cast< size_t >( cpu );
+                return std::hash< std::thread::id >()( std::this_thread::get_id() );
+#else
+                return std::hash< std::thread::id >()( std::this_thread::get_id() );
+#endif
+            }
+
+            /** Default constructor, initializes an instance to unlocked state
+
+            @throw std::bad_alloc in per-CPU mode
+            */
+            rare_exclusive_frequent_shared_mutex() noexcept( !per_cpu_ )
+            {
+                if constexpr ( per_cpu_ )
+                {
+                    shared_locks_ = std::make_unique< atomic_t< size_t >[] >( cpu_count() );
+                }
+            }
+
+
+            /** Explicitly deleted moving constructor, makes the class to be non-copyable/movable
+            */
+            rare_exclusive_frequent_shared_mutex( rare_exclusive_frequent_shared_mutex&& ) = delete;
+
+
+            /** Tries to take EXCLUSIVE lock over the mutex, returns immediately
+
+            @param [in] spin_count - number of tries before to fail
+            @retval true if the operation succeeded
+            @throw nothing
+            */
+            bool try_lock( size_t spin_count = 0 ) noexcept
+            {
+                spin_count = spin_count ? spin_count : spin_count_per_lock * shared_lock_count();
+
+                // try to signal exclusive lock
+                if ( !acquire_exclusive( spin_count, false ) ) return false;
+
+                // exclusive lock signalled! wait until all shared locks get released
+                if ( !drain( spin_count, false ) )
+                {
+                    unlock();
+                    return false;
+                }
+
+                //
+                // there is not taken shared locks anymore - succeeded, the last sync operation on the control flow
+                // was load( std::memory_order_seq_cst ), so the whole function guaratnies ACQUIRE semantic
+                //
+                return true;
+            }
+
+
             /** Takes EXCLUSIVE lock over the mutex
 
-            @param [in] spin_count - number of tries before to yeild other threads
+            Never gives signalled exclusive lock up, so the wait is bounded by the longest shared lock that was
+            already taken when the writer came
+
+            @param [in] spin_count - number of tries before to park
             @throw nothing
             */
             void lock( size_t spin_count = 0 ) noexcept
             {
-                spin_count = spin_count ? spin_count : spin_count_per_lock * SharedLockCount;
-                while ( !try_lock( spin_count ) ) std::this_thread::yield();
+                spin_count = spin_count ? spin_count : spin_count_per_lock;
+
+                acquire_exclusive( spin_count, true );
+                drain( spin_count, true );
             }
 
 
@@ -140,57 +310,74 @@ namespace jb
             */
             void unlock() noexcept
             {
-                // release exclusive lock using RELEASE semantic
-                exclusive_lock_.store( false, std::memory_order_release );
+                // release exclusive lock using RELEASE semantic and wake up parked threads if any
+                if ( contended_ == exclusive_lock_.exchange( free_, std::memory_order_release ) )
+                {
+                    exclusive_lock_.notify_all();
+                }
             }
 
 
             /** Tries to get SHARED lock over the mutex, returns immediately
 
             @param [in] locker_id - an identifier of the object requesting shared lock (uniqueness NOT required)
+            @param [in] spin_count - number of tries before to fail
             @retval true if succeeded
             @throw nothing
             */
             bool try_lock_shared( size_t locker_id, size_t spin_count = 0 ) noexcept
             {
-                size_t spin = 0;
                 spin_count = spin_count ? spin_count : spin_count_per_lock;
 
                 // hash shared lock by locker id
-                auto& shared_lock = shared_locks_[ locker_id % SharedLockCount ];
-
-                // acquire shared lock
-                shared_lock.fetch_add( 1, std::memory_order_acq_rel );
+                auto& shared_lock = shared_lock_for( locker_id );
 
-                // spin while exclusive lock taken
-                for ( size_t spin = 1; exclusive_lock_.load( std::memory_order_acquire ); ++spin )
+                for ( size_t spin = 1; ; )
                 {
-                    // if spin count exhausted
-                    if ( 0 == ++spin % spin_count )
+                    // acquire shared lock
+                    shared_lock.fetch_add( 1, std::memory_order_seq_cst );
+
+                    //
+                    // succeeded if there is no exclusive lock, the last sync operation on the control flow was
+                    // exclusive_lock_.load( std::memory_order_seq_cst ), therefore the function guaranties ACQUIRE
+                    // semantic
+                    //
+                    if ( free_ == exclusive_lock_.load( std::memory_order_seq_cst ) ) return true;
+
+                    // back off: release shared lock, so the writer does not wait for us
+                    shared_lock.fetch_sub( 1, std::memory_order_seq_cst );
+                    notify_drained();
+
+                    // spin while exclusive lock taken, if spin count exhausted - fail
+                    for ( ; free_ != exclusive_lock_.load( std::memory_order_acquire ); ++spin )
                     {
-                        // release shared lock and fail
-                        shared_lock.fetch_sub( 1, std::memory_order_acq_rel );
-                        return false;
+                        if ( 0 == spin % spin_count ) return false;
+                        Backoff::pause();
                     }
                 }
-
-                //
-                // succeeded, the last sync operation on the control flow was exclusive_lock_.load( std::memory_order_acquire ),
-                // therefore the function guaranties ACQUIRE semantic
-                return true;
             }
 
 
             /** Takes SHARED lock over the mutex
 
             @param [in] locker_id - an identifier of the object requesting shared lock (uniqueness NOT required)
-            @param [in] spin_count - number of tries before to yeild other threads
+            @param [in] spin_count - number of tries before to park
             @throw nothing
             */
             void lock_shared( size_t locker_id, size_t spin_count = 0 ) noexcept
             {
                 spin_count = spin_count ? spin_count : spin_count_per_lock;
-                while ( !try_lock_shared( locker_id, spin_count ) ) std::this_thread::yield();
+
+                while ( !try_lock_shared( locker_id, spin_count ) )
+                {
+                    // mark the lock contended, so the writer wakes us up on unlock()
+                    auto state = exclusive_lock_.load( std::memory_order_acquire );
+                    if ( free_ == state ) continue;
+                    if ( locked_ == state && !exclusive_lock_.compare_exchange_strong( state, contended_, std::memory_order_acq_rel ) ) continue;
+
+                    typename Tracer::scope trace( trace_event::shared_lock_wait );
+                    exclusive_lock_.wait( contended_ );
+                }
             }
 
 
@@ -201,8 +388,9 @@ namespace jb
             */
             void unlock_shared( size_t locker_id ) noexcept
             {
-                // simply clear shared lock
-                shared_locks_[ locker_id % SharedLockCount ].fetch_sub( 1, std::memory_order_acq_rel ) ;
+                // clear shared lock and let a waiting writer know
+                shared_lock_for( locker_id ).fetch_sub( 1, std::memory_order_seq_cst );
+                notify_drained();
             }
 
 
@@ -345,14 +533,14 @@ namespace jb
                 /** Creates new instance, associates it with given mutex, and takes SHARED lock on it
 
                 @param [in/out] mtx - mutex to be locked
-                @param [in] locker - id of the object requesting lock
+                @param [in] locker - id of the object requesting lock, ignored in per-CPU mode
                 @param [in] spin_count - number of lock tries before to yeild other threads
                 @throw nothing
                 */
                 template < typename Locker >
                 explicit shared_lock( rare_exclusive_frequent_shared_mutex& mtx, const Locker& locker, size_t spin_count = 0 ) noexcept
                     : mtx_( &mtx )
-                    , id_( std::hash< Locker >{}( locker ) )
+                    , id_( per_cpu_ ? current_cpu() : std::hash< Locker >{}( locker ) )
                     , spin_count_( spin_count )
                     , taken_( true )
                 {
@@ -421,6 +609,7 @@ namespace jb
                 void lock() noexcept
                 {
                     assert( mtx_ && !taken_ );
+                    if constexpr ( per_cpu_ ) id_ = current_cpu();
                     mtx_->lock_shared( id_, spin_count_ );
                     taken_ = true;
                 }
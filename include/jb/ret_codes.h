@@ -13,7 +13,10 @@ namespace jb
         CannotOpenFile,
         AlreadyInUse,
         IoError,
-        Overloaded
+        Overloaded,
+        LimitReached,
+        ReadOnly,
+        IncompatibleFile
     };
 }
 
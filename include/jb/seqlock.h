@@ -0,0 +1,180 @@
+#ifndef __JB__SEQLOCK__H__
+#define __JB__SEQLOCK__H__
+
+
+#include "backoff.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Keeps rarely modified, frequently read value under sequence lock
+
+        The sequence counter is odd while a writer modifies the value. A reader takes a consistent snapshot with
+        two loads of the counter around the copy and no stores, so readers never invalidate each other's cache
+        lines and never wait for each other; a reader overlapping a write simply retries. Writers serialize on the
+        counter itself (even -> odd CAS).
+
+        The value is kept as an array of atomic words read with relaxed semantic, that makes racy copying of the
+        value well defined
+
+        @tparam T - trivially copyable value type
+        @tparam Backoff - waiting strategy for a concurrent writer
+        */
+        template < typename T, typename Backoff = backoff<> >
+        class seqlock
+        {
+            static_assert( std::is_trivially_copyable_v< T > );
+
+            using word_t = uintptr_t;
+            static constexpr size_t word_count_ = ( sizeof( T ) + sizeof( word_t ) - 1 ) / sizeof( word_t );
+
+            std::atomic< uint64_t > sequence_ = 0;
+            std::array< std::atomic< word_t >, word_count_ > words_;
+
+
+            /** Copies words into a value, must be followed by sequence check
+
+            @throw nothing
+            */
+            T load_words() const noexcept
+            {
+                std::array< word_t, word_count_ > words;
+                for ( size_t i = 0; i < word_count_; ++i ) words[ i ] = words_[ i ].load( std::memory_order_relaxed );
+
+                T value;
+                std::memcpy( &value, words.data(), sizeof( T ) );
+                return value;
+            }
+
+
+            /** Copies a value into words, must be called by the writer
+
+            @throw nothing
+            */
+            void store_words( const T& value ) noexcept
+            {
+                std::array< word_t, word_count_ > words{};
+                std::memcpy( words.data(), &value, sizeof( T ) );
+                for ( size_t i = 0; i < word_count_; ++i ) words_[ i ].store( words[ i ], std::memory_order_relaxed );
+            }
+
+
+            /** Makes the counter odd, waits for concurrent writer if necessary
+
+            @retval the counter value before the write
+            @throw nothing
+            */
+            uint64_t begin_write() noexcept
+            {
+                for ( Backoff backoff; ; backoff() )
+                {
+                    auto sequence = sequence_.load( std::memory_order_relaxed );
+                    if ( !( sequence & 1 ) && sequence_.compare_exchange_weak( sequence, sequence + 1, std::memory_order_acquire ) )
+                    {
+                        // word stores must not become visible before the counter gets odd
+                        std::atomic_thread_fence( std::memory_order_release );
+                        return sequence;
+                    }
+                }
+            }
+
+        public:
+
+            /** Initializes the value
+
+            @param [in] value - initial value
+            @throw nothing
+            */
+            explicit seqlock( const T& value = T{} ) noexcept
+            {
+                store_words( value );
+            }
+
+
+            /** Explicitly deleted move constructor, makes the class non-copyable/movable
+            */
+            seqlock( seqlock&& ) = delete;
+
+
+            /** Takes consistent snapshot of the value
+
+            @retval the value
+            @throw nothing
+            */
+            T load() const noexcept
+            {
+                for ( Backoff backoff; ; backoff() )
+                {
+                    auto before = sequence_.load( std::memory_order_acquire );
+                    if ( before & 1 ) continue;
+
+                    auto value = load_words();
+
+                    // word loads must not be reordered after the check
+                    std::atomic_thread_fence( std::memory_order_acquire );
+                    if ( before == sequence_.load( std::memory_order_relaxed ) ) return value;
+                }
+            }
+
+
+            /** Provides version of the value, changes with each modification
+
+            @throw nothing
+            */
+            uint64_t version() const noexcept
+            {
+                return sequence_.load( std::memory_order_acquire ) >> 1;
+            }
+
+
+            /** Replaces the value
+
+            @param [in] value - new value
+            @throw nothing
+            */
+            void store( const T& value ) noexcept
+            {
+                auto sequence = begin_write();
+                store_words( value );
+                sequence_.store( sequence + 2, std::memory_order_release );
+            }
+
+
+            /** Modifies the value exclusively
+
+            @param [in] fn - callable( T& ) noexcept, could return a result
+            @retval the result of fn
+            @throw nothing
+            */
+            template < typename Fn >
+            auto update( Fn&& fn ) noexcept
+            {
+                auto sequence = begin_write();
+                auto value = load_words();
+
+                if constexpr ( std::is_void_v< decltype( fn( value ) ) > )
+                {
+                    fn( value );
+                    store_words( value );
+                    sequence_.store( sequence + 2, std::memory_order_release );
+                }
+                else
+                {
+                    auto result = fn( value );
+                    store_words( value );
+                    sequence_.store( sequence + 2, std::memory_order_release );
+                    return result;
+                }
+            }
+        };
+    }
+}
+
+#endif
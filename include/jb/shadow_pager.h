@@ -0,0 +1,424 @@
+#ifndef __JB__SHADOW_PAGER__H__
+#define __JB__SHADOW_PAGER__H__
+
+
+#include "ret_codes.h"
+#include "exception.h"
+#include "superblock.h"
+#include "coordination_region.h"
+#include <limits>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <assert.h>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Implements crash-consistent copy-on-write page updates (shadow paging) over a storage file
+
+        Users address pages by logical numbers; the page table translates them to physical offsets. A modified page
+        is never written in place: write() relocates it to a freshly allocated physical page (copying committed
+        content) and all further modifications within the batch go there. commit() writes new versions of touched
+        page table pages to fresh locations as well, makes everything durable and then atomically switches the
+        superblock to the new page table. A crash at any moment leaves the file in the state of the last commit,
+        and opening the file reads nothing but the superblock, i.e. recovery is O(1).
+
+        The page table is two-level: the directory page refers to table pages, a table page refers to data pages.
+        Both are loaded lazily on first access. Physical pages come from the file's free-space map (see
+        free_space_map), superseded ones are given back to it by recycle() once nobody refers to them.
+
+        The pager serializes its operations with a mutex, writes are expected to be batched by the caller
+
+        If the file is shared between the writer process and reader processes (see AccessMode), the writer publishes
+        each commit into coordination region, and a reader pins the sequence it reads at and moves to newer commits
+        by refresh(). A superseded page is recycled only when no reader could still read it.
+
+        The page table root lives in page_table_ field of the file's superblock, the pager shares the superblock with
+        the other structures of the file
+
+        @tparam File - storage file (see superblock for the concept, plus allocate(), deallocate(), read_only(),
+                       coordination(), process_id(), process_alive() and superblock())
+        */
+        template < typename File >
+        class shadow_pager
+        {
+        public:
+
+            using safe_mapped_area = typename File::safe_mapped_area;
+
+        private:
+
+            using table_t = std::vector< uint64_t >;
+
+
+            /** Keeps reader slot of coordination region for the time of life, pins the sequence the reader reads at
+            */
+            class reader_pin
+            {
+                coordination_region* region_ = nullptr;
+                size_t slot_ = 0;
+
+            public:
+
+                explicit reader_pin( File& file )
+                {
+                    if ( file.read_only() && file.coordination() )
+                    {
+                        slot_ = file.coordination()->acquire_reader( File::process_id() );
+                        region_ = file.coordination();
+                        region_->pin( slot_ );
+                    }
+                }
+
+                reader_pin( reader_pin&& ) = delete;
+
+                ~reader_pin()
+                {
+                    if ( region_ ) region_->release_reader( slot_ );
+                }
+
+                void repin() noexcept
+                {
+                    if ( region_ ) region_->pin( slot_ );
+                }
+            };
+
+
+            File& file_;
+            reader_pin reader_pin_;
+            std::mutex guard_;
+            table_t directory_;
+            std::unordered_map< size_t, table_t > tables_;
+            std::unordered_map< size_t, uint64_t > shadow_;
+            std::vector< std::pair< uint64_t, uint64_t > > released_; // superseding sequence, offset
+
+
+            /** Number of page references a page table page holds
+            */
+            static size_t entries_per_page() noexcept { return File::page_size() / sizeof( uint64_t ); }
+
+
+            /** Reads page table page from the file
+
+            @param [in] offset - physical offset of the page, 0 means empty table
+            @param [out] table - page content
+            @throw details::runtime_error
+            */
+            void load( uint64_t offset, table_t& table )
+            {
+                table.assign( entries_per_page(), 0 );
+                if ( offset )
+                {
+                    auto page = file_.map_page( offset );
+                    std::memcpy( table.data(), page.get(), File::page_size() );
+                }
+            }
+
+
+            /** Provides committed page table page, loads it if needed, must be called under the guard
+
+            @param [in] index - index of table page
+            @retval table page
+            @throw details::runtime_error, std::bad_alloc
+            */
+            const table_t& table( size_t index )
+            {
+                if ( directory_.empty() ) load( file_.superblock().current().page_table_, directory_ );
+
+                auto it = tables_.find( index );
+                if ( it == tables_.end() )
+                {
+                    table_t t;
+                    load( directory_[ index ], t );
+                    it = tables_.emplace( index, std::move( t ) ).first;
+                }
+
+                return it->second;
+            }
+
+
+            /** Translates logical page number into physical offset, must be called under the guard
+
+            @param [in] page - logical page number
+            @retval physical offset, 0 if the page was never written
+            @throw details::runtime_error, std::bad_alloc, std::logic_error
+            */
+            uint64_t translate( size_t page )
+            {
+                if ( page >= capacity() )
+                {
+                    throw std::logic_error( "Logical page number exceeds page table capacity" );
+                }
+
+                if ( auto it = shadow_.find( page ); it != shadow_.end() )
+                {
+                    return it->second;
+                }
+
+                return table( page / entries_per_page() )[ page % entries_per_page() ];
+            }
+
+
+            /** Writes page table page to new physical location
+
+            @param [in] t - page content
+            @retval offset of the page
+            @throw details::runtime_error, std::bad_alloc
+            */
+            uint64_t store( const table_t& t )
+            {
+                auto offset = file_.allocate();
+                auto page = file_.map_page( offset );
+                std::memcpy( page.get(), t.data(), File::page_size() );
+                return offset;
+            }
+
+        public:
+
+            shadow_pager() = delete;
+            shadow_pager( shadow_pager&& ) = delete;
+
+
+            /** Opens the pager over a file, reads nothing but the superblock
+
+            @param [in] file - storage file
+            @throw details::runtime_error, std::logic_error
+            */
+            explicit shadow_pager( File& file )
+                : file_( file )
+                , reader_pin_( file )
+            {
+                if ( !file_.coordination() ) return;
+
+                // a reader must read the superblock after the sequence got pinned
+                if ( file_.read_only() )
+                {
+                    file_.superblock().reload();
+                }
+                else
+                {
+                    file_.coordination()->publish( file_.superblock().current().sequence_ );
+                }
+            }
+
+
+            /** Maximum number of logical pages
+            */
+            static size_t capacity() noexcept { return entries_per_page() * entries_per_page(); }
+
+
+            /** Provides sequence number of the last commit
+
+            @throw nothing
+            */
+            uint64_t sequence() noexcept
+            {
+                std::unique_lock lock( guard_ );
+                return file_.superblock().current().sequence_;
+            }
+
+
+            /** Maps a page for reading
+
+            Within a batch returns modified version of the page, committed version otherwise
+
+            @param [in] page - logical page number
+            @retval mapped page, empty if the page was never written
+            @throw details::runtime_error, std::bad_alloc, std::logic_error
+            */
+            safe_mapped_area read( size_t page )
+            {
+                std::unique_lock lock( guard_ );
+
+                auto offset = translate( page );
+                return offset ? file_.map_page( offset ) : safe_mapped_area{};
+            }
+
+
+            /** Maps a page for writing
+
+            The first write of a page within a batch relocates the page to a new physical location copying its
+            committed content, the committed version stays untouched. A page never written before comes zeroed
+
+            @param [in] page - logical page number
+            @retval mapped page
+            @throw details::runtime_error, std::bad_alloc, std::logic_error
+            */
+            safe_mapped_area write( size_t page )
+            {
+                std::unique_lock lock( guard_ );
+
+                if ( auto it = shadow_.find( page ); it != shadow_.end() )
+                {
+                    return file_.map_page( it->second );
+                }
+
+                auto committed = translate( page );
+                auto offset = file_.allocate();
+
+                // a recycled page keeps whatever it held before
+                auto target = file_.map_page( offset );
+                if ( committed )
+                {
+                    auto source = file_.map_page( committed );
+                    std::memcpy( target.get(), source.get(), File::page_size() );
+                }
+                else
+                {
+                    std::memset( target.get(), 0, File::page_size() );
+                }
+
+                shadow_.emplace( page, offset );
+
+                return target;
+            }
+
+
+            /** Atomically makes all the modifications of current batch durable
+
+            @throw details::runtime_error, std::bad_alloc; if the call failed, the file stays in the state of the
+                   previous commit and the batch stays uncommitted
+            */
+            void commit()
+            {
+                std::unique_lock lock( guard_ );
+
+                if ( shadow_.empty() ) return;
+
+                std::vector< uint64_t > written, superseded;
+                written.reserve( shadow_.size() );
+
+                // build new versions of touched table pages
+                std::unordered_map< size_t, table_t > tables;
+                for ( auto [ page, offset ] : shadow_ )
+                {
+                    auto index = page / entries_per_page();
+
+                    auto it = tables.find( index );
+                    if ( it == tables.end() ) it = tables.emplace( index, table( index ) ).first;
+
+                    auto& entry = it->second[ page % entries_per_page() ];
+                    if ( entry ) superseded.push_back( entry );
+                    entry = offset;
+
+                    written.push_back( offset );
+                }
+
+                // write them and new directory to new locations
+                auto directory = directory_;
+                for ( auto& [ index, t ] : tables )
+                {
+                    if ( directory[ index ] ) superseded.push_back( directory[ index ] );
+                    directory[ index ] = store( t );
+                    written.push_back( directory[ index ] );
+                }
+
+                auto directory_offset = store( directory );
+                written.push_back( directory_offset );
+                if ( auto committed = file_.superblock().current().page_table_ ) superseded.push_back( committed );
+
+                // make new pages durable coalescing contiguous ones
+                std::sort( written.begin(), written.end() );
+                for ( size_t i = 0; i < written.size(); )
+                {
+                    auto j = i + 1;
+                    while ( j < written.size() && written[ j ] == written[ j - 1 ] + File::page_size() ) ++j;
+                    file_.flush( written[ i ], ( j - i ) * File::page_size() );
+                    i = j;
+                }
+                file_.sync();
+
+                // switch to the new page table
+                auto sequence = file_.superblock().commit( [&]( auto& h ) { h.page_table_ = directory_offset; } ).sequence_;
+                if ( auto region = file_.coordination() ) region->publish( sequence );
+
+                directory_.swap( directory );
+                for ( auto& [ index, t ] : tables ) tables_[ index ].swap( t );
+                shadow_.clear();
+                for ( auto offset : superseded ) released_.emplace_back( sequence, offset );
+            }
+
+
+            /** Discards all the modifications of current batch
+
+            @throw nothing
+            */
+            void rollback() noexcept
+            {
+                std::unique_lock lock( guard_ );
+
+                try
+                {
+                    // nobody has ever seen the pages
+                    for ( auto [ page, offset ] : shadow_ ) released_.emplace_back( 0, offset );
+                }
+                catch ( ... )
+                {
+                    // the pages just leak
+                }
+
+                shadow_.clear();
+            }
+
+
+            /** Gives physical pages not referred by committed page table anymore back to the free-space map
+
+            Pages that a reader process still could read are kept until the reader moves to a newer commit. Pages the
+            pager has not recycled before the file is closed leak
+
+            @retval number of recycled pages
+            @throw details::runtime_error, std::bad_alloc; the pages not recycled yet are kept for the next call
+            */
+            size_t recycle()
+            {
+                std::unique_lock lock( guard_ );
+
+                auto oldest = std::numeric_limits< uint64_t >::max();
+                if ( auto region = file_.coordination() ) oldest = region->oldest( &File::process_alive );
+
+                // a page superseded by sequence S could be read by readers pinned at sequences less than S
+                auto kept = std::partition( released_.begin(), released_.end(), [&]( const auto& r ) { return r.first > oldest; } );
+                auto count = static_cast< size_t >( released_.end() - kept );
+
+                while ( released_.end() != kept )
+                {
+                    file_.deallocate( released_.back().second );
+                    released_.pop_back();
+                }
+
+                return count;
+            }
+
+
+            /** Moves a reader to the last commit of the writer process
+
+            Pages mapped by read() before the call must not be used after it, the writer could recycle them
+
+            @throw details::runtime_error, std::logic_error
+            */
+            void refresh()
+            {
+                std::unique_lock lock( guard_ );
+
+                auto sequence = file_.superblock().current().sequence_;
+
+                reader_pin_.repin();
+                file_.superblock().reload();
+
+                if ( sequence != file_.superblock().current().sequence_ )
+                {
+                    directory_.clear();
+                    tables_.clear();
+                }
+            }
+        };
+    }
+}
+
+#endif
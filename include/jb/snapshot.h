@@ -0,0 +1,367 @@
+#ifndef __JB__SNAPSHOT__H__
+#define __JB__SNAPSHOT__H__
+
+
+#include "aligned_atomic.h"
+#include "backoff.h"
+#include <array>
+#include <limits>
+#include <thread>
+#include <assert.h>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Maintains global commit sequence and the set of active snapshots
+
+        Writers tag new record versions with the sequence number of a commit ticket obtained by begin_commit(), the
+        versions become visible when the ticket is published. Readers open a snapshot that pins the last published sequence number and see
+        only versions tagged with numbers not greater than pinned one, thus long reads neither block writers nor
+        get blocked by them. A version may be reclaimed as soon as it gets older than oldest() sequence, i.e.
+        when there is no a snapshot that could see it.
+
+        Active snapshots are spread over SlotCount atomics each laying in different cache line (see
+        rare_exclusive_frequent_shared_mutex for the reasoning), so opening/closing snapshots from different
+        threads does not collide on the same cache line
+
+        @tparam SlotCount - max number of simultaneously active snapshots
+        @tparam Backoff - waiting strategy for preceding commits
+        */
+        template < size_t SlotCount = 64, typename Backoff = backoff<> >
+        class snapshot_registry
+        {
+            static_assert( SlotCount );
+
+            static constexpr uint64_t free_ = 0;
+
+            aligned_atomic< uint64_t > next_;
+            aligned_atomic< uint64_t > committed_;
+            std::array< aligned_atomic< uint64_t >, SlotCount > slots_;
+
+
+            /** Publishes a commit, waits for all the preceding commits to be published
+
+            @param [in] sequence - sequence number of the commit ticket
+            @throw nothing
+            */
+            void end_commit( uint64_t sequence ) noexcept
+            {
+                for ( Backoff backoff; committed_.load( std::memory_order_acquire ) != sequence - 1; backoff() );
+
+                committed_.store( sequence, std::memory_order_seq_cst );
+            }
+
+        public:
+
+            /** Snapshot handle, pins commit sequence number for its life-time
+            */
+            class snapshot
+            {
+                friend class snapshot_registry;
+
+                snapshot_registry* registry_ = nullptr;
+                size_t slot_ = 0;
+                uint64_t sequence_ = 0;
+
+                snapshot( snapshot_registry* registry, size_t slot, uint64_t sequence ) noexcept
+                    : registry_( registry )
+                    , slot_( slot )
+                    , sequence_( sequence )
+                {}
+
+            public:
+
+                /** Default constructor, creates dummy snapshot
+
+                @throw nothing
+                */
+                snapshot() noexcept = default;
+
+
+                /** Move constructor, makes origin dummy
+
+                @param [in/out] other - an instance to move from
+                @throw nothing
+                */
+                snapshot( snapshot&& other ) noexcept
+                {
+                    swap( other );
+                }
+
+
+                /** Destructor, releases pinned sequence
+                */
+                ~snapshot()
+                {
+                    release();
+                }
+
+
+                /** Move assignment, releases currently pinned sequence
+
+                @param [in/out] other - an instance to move from
+                @retval target instance as lvalue
+                @throw nothing
+                */
+                snapshot& operator = ( snapshot&& other ) noexcept
+                {
+                    snapshot dummy;
+                    swap( dummy );
+                    swap( other );
+                    //
+                    return *this;
+                }
+
+
+                /** Swaps the instance with another one
+
+                @param [in/out] other - an instance to be swapped with
+                @throw nothing
+                */
+                void swap( snapshot& other ) noexcept
+                {
+                    std::swap( registry_, other.registry_ );
+                    std::swap( slot_, other.slot_ );
+                    std::swap( sequence_, other.sequence_ );
+                }
+
+
+                /** Checks if the snapshot is not dummy
+
+                @throw nothing
+                */
+                explicit operator bool() const noexcept { return registry_ != nullptr; }
+
+
+                /** Provides pinned commit sequence number
+
+                @retval the greatest sequence number visible through the snapshot
+                @throw nothing
+                */
+                uint64_t sequence() const noexcept { return sequence_; }
+
+
+                /** Releases pinned sequence and makes the snapshot dummy
+
+                @throw nothing
+                */
+                void release() noexcept
+                {
+                    if ( registry_ )
+                    {
+                        registry_->slots_[ slot_ ].store( free_, std::memory_order_release );
+                        registry_ = nullptr;
+                    }
+                }
+            };
+
+
+            /** Commit ticket, holds sequence number of a commit in progress and publishes the commit on destruction
+
+            Commits get published in order of their sequence numbers, so a ticket that was never published would
+            stall all the following commits: whatever way the commit ends (an exception included) the ticket gets
+            published, versions that did not make it just are not there
+            */
+            class commit
+            {
+                friend class snapshot_registry;
+
+                snapshot_registry* registry_ = nullptr;
+                uint64_t sequence_ = 0;
+
+                commit( snapshot_registry* registry, uint64_t sequence ) noexcept
+                    : registry_( registry )
+                    , sequence_( sequence )
+                {}
+
+            public:
+
+                /** Default constructor, creates dummy ticket
+
+                @throw nothing
+                */
+                commit() noexcept = default;
+
+
+                /** Move constructor, makes origin dummy
+
+                @param [in/out] other - an instance to move from
+                @throw nothing
+                */
+                commit( commit&& other ) noexcept
+                {
+                    swap( other );
+                }
+
+
+                /** Destructor, publishes the commit
+                */
+                ~commit()
+                {
+                    publish();
+                }
+
+
+                /** Move assignment, publishes currently held commit
+
+                @param [in/out] other - an instance to move from
+                @retval target instance as lvalue
+                @throw nothing
+                */
+                commit& operator = ( commit&& other ) noexcept
+                {
+                    commit dummy;
+                    swap( dummy );
+                    swap( other );
+                    //
+                    return *this;
+                }
+
+
+                /** Swaps the instance with another one
+
+                @param [in/out] other - an instance to be swapped with
+                @throw nothing
+                */
+                void swap( commit& other ) noexcept
+                {
+                    std::swap( registry_, other.registry_ );
+                    std::swap( sequence_, other.sequence_ );
+                }
+
+
+                /** Checks if the ticket is not dummy
+
+                @throw nothing
+                */
+                explicit operator bool() const noexcept { return registry_ != nullptr; }
+
+
+                /** Provides commit sequence number
+
+                @retval sequence number to tag new versions with
+                @throw nothing
+                */
+                uint64_t sequence() const noexcept { return sequence_; }
+
+
+                /** Publishes the commit and makes the ticket dummy, makes versions tagged with the sequence number
+                    visible to new snapshots
+
+                Waits for all the preceding commits to be published
+
+                @throw nothing
+                */
+                void publish() noexcept
+                {
+                    if ( registry_ )
+                    {
+                        registry_->end_commit( sequence_ );
+                        registry_ = nullptr;
+                    }
+                }
+            };
+
+
+            /** Default constructor
+
+            Sequence numbers start from 1, 0 marks free snapshot slot
+
+            @throw nothing
+            */
+            snapshot_registry() noexcept
+            {
+                next_.store( 1, std::memory_order_relaxed );
+                committed_.store( 1, std::memory_order_relaxed );
+            }
+
+
+            /** Explicitly deleted move constructor, makes the class non-copyable/movable
+            */
+            snapshot_registry( snapshot_registry&& ) = delete;
+
+
+            /** Provides the last published commit sequence number
+
+            @throw nothing
+            */
+            uint64_t committed() const noexcept { return committed_.load( std::memory_order_acquire ); }
+
+
+            /** Opens a snapshot over the last published commit
+
+            @param [in] hint - preferable slot, e.g. hash of calling thread id (uniqueness NOT required)
+            @retval snapshot handle, dummy if all slots are busy
+            @throw nothing
+            */
+            snapshot open( size_t hint ) noexcept
+            {
+                for ( size_t i = 0; i < SlotCount; ++i )
+                {
+                    auto slot = ( hint + i ) % SlotCount;
+                    auto& s = slots_[ slot ];
+
+                    auto sequence = committed_.load( std::memory_order_seq_cst );
+                    auto expected = free_;
+                    if ( !s.compare_exchange_strong( expected, sequence, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+                    {
+                        continue;
+                    }
+
+                    //
+                    // oldest() might have sampled committed sequence and scanned the slot before we published the
+                    // pin, so make sure the pin is still not behind the last committed sequence
+                    //
+                    for ( auto actual = committed_.load( std::memory_order_seq_cst ); actual != sequence; actual = committed_.load( std::memory_order_seq_cst ) )
+                    {
+                        sequence = actual;
+                        s.store( sequence, std::memory_order_seq_cst );
+                    }
+
+                    return snapshot( this, slot, sequence );
+                }
+
+                return snapshot();
+            }
+
+
+            /** Allocates commit sequence number for a new commit
+
+            @retval commit ticket, the commit gets published when the ticket is published or destroyed
+            @throw nothing
+            */
+            commit begin_commit() noexcept
+            {
+                return commit( this, next_.fetch_add( 1, std::memory_order_acq_rel ) + 1 );
+            }
+
+
+            /** Provides the oldest sequence number that still can be seen by a snapshot
+
+            Any version superseded by a version with sequence number not greater than returned one is not visible
+            to anybody and can be reclaimed
+
+            @retval the oldest visible sequence number
+            @throw nothing
+            */
+            uint64_t oldest() const noexcept
+            {
+                auto oldest = committed_.load( std::memory_order_seq_cst );
+
+                for ( const auto& s : slots_ )
+                {
+                    if ( auto sequence = s.load( std::memory_order_seq_cst ); sequence != free_ && sequence < oldest )
+                    {
+                        oldest = sequence;
+                    }
+                }
+
+                return oldest;
+            }
+        };
+    }
+}
+
+#endif
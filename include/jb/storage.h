@@ -3,19 +3,25 @@
 
 
 #include "ret_codes.h"
+#include "backoff.h"
+#include "tracer.h"
+#include "metrics.h"
+#include "layout.h"
 #include "virtual_volume.h"
 #include "physical_volume.h"
 #include "mount_point.h"
+#include "handle_table.h"
 #include "exception.h"
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
-#include <unordered_set>
+#include <stdexcept>
 #include <tuple>
 #include <filesystem>
 #include <type_traits>
 #include <variant>
 #include <string>
+#include <chrono>
 
 #if defined( WIN32 )
 #   include "win32_api.h"
@@ -43,11 +49,30 @@ namespace jb
 
         using key_hash_fn = std::hash < std::basic_string< key_char_t, key_traits_t > >;
         using shared_mutex = std::shared_mutex;
+        using backoff = details::backoff<>;
+        using tracer = details::null_tracer;
+        using metrics = details::latency_metrics<>;
+        using layout = details::padded_layout;
 
+#if defined( WIN32 )
         using api = win32::api;
+#else
+        using api = posix::api;
+#endif
 
         static constexpr size_t chunk_size = 256;
         static constexpr size_t cache_size = 1 << 20;
+        static constexpr size_t thread_page_cache_size = 16;
+        static constexpr size_t free_space_run = 32;
+        static constexpr size_t snapshot_slot_count = 64;
+
+        static constexpr std::chrono::microseconds wal_group_commit_window{ 0 };
+        static constexpr size_t wal_group_commit_size = 1 << 20;
+        static constexpr size_t wal_segment_size = 1 << 26;
+
+        static constexpr size_t flush_rate = 64 << 20;
+        static constexpr std::chrono::milliseconds flush_interval{ 1000 };
+        static constexpr size_t flush_max_run = 256;
     };
 
 
@@ -63,15 +88,13 @@ namespace jb
         /** Provides abstract volume collection
 
         @tparam VolumeType - volume type
-        @retval reference to volume collection guard
         @retval reference to volume collection
         */
         template< typename VolumeType >
-        static auto singleton()
+        static details::handle_table< VolumeType >& singleton() noexcept
         {
-            static std::mutex guard;
-            static std::unordered_set< std::shared_ptr< VolumeType > > volumes;
-            return std::forward_as_tuple( guard, volumes );
+            static details::handle_table< VolumeType > volumes;
+            return volumes;
         }
 
 
@@ -91,39 +114,36 @@ namespace jb
         @tparam Args... - volume parameters
         @param args [in] - volume parameters
         @retval error code
-        @retval volume handler
+        @retval volume handle
         @throw nothing
         */
         template< typename VolumeType, typename... Args >
-        static std::tuple< RetCode, std::weak_ptr< VolumeType > > open( Args&&... args ) noexcept
+        static std::tuple< RetCode, details::handle< VolumeType > > open( Args&&... args ) noexcept
         {
+            typename Policies::metrics::scope measure( std::is_same_v< VolumeType, details::virtual_volume< Policies > >
+                ? details::operation::open_virtual_volume
+                : details::operation::open_physical_volume );
+
             try
             {
-                auto [ guard, volumes ] = singleton< VolumeType >();
-                auto volume = std::make_shared< private_construction< VolumeType > >( std::forward< Args >( args )... );
-
-                std::unique_lock lock( guard );
-
-                if ( auto ok = volumes.insert( volume ).second )
-                {
-                    return { RetCode::Ok, std::weak_ptr< VolumeType >( volume ) };
-                }
-                else
-                {
-                    return { RetCode::UnknownError, std::weak_ptr< VolumeType >() };
-                }
+                std::shared_ptr< VolumeType > volume = std::make_shared< private_construction< VolumeType > >( std::forward< Args >( args )... );
+                return { RetCode::Ok, singleton< VolumeType >().insert( std::move( volume ) ) };
             }
             catch ( const details::runtime_error & e )
             {
-                return { e.error_code(), std::weak_ptr< VolumeType >() };
+                return { e.error_code(), details::handle< VolumeType >() };
             }
             catch ( const std::bad_alloc& )
             {
-                return { RetCode::InsufficientMemory, std::weak_ptr< VolumeType >() };
+                return { RetCode::InsufficientMemory, details::handle< VolumeType >() };
+            }
+            catch ( const std::length_error& )
+            {
+                return { RetCode::LimitReached, details::handle< VolumeType >() };
             }
             catch ( ... )
             {
-                return { RetCode::UnknownError, std::weak_ptr< VolumeType >() };
+                return { RetCode::UnknownError, details::handle< VolumeType >() };
             }
         }
     
@@ -143,7 +163,7 @@ namespace jb
         @throw nothing
         */
         [[nodiscard]]
-        static std::tuple< RetCode, std::weak_ptr< virtual_volume_t > >
+        static std::tuple< RetCode, details::handle< virtual_volume_t > >
         open_virtual_volume() noexcept
         {
             return open< virtual_volume_t >();
@@ -159,7 +179,7 @@ namespace jb
         @throw nothing
         */
         [[nodiscard]]
-        static std::tuple< RetCode, std::weak_ptr< physical_volume_t > >
+        static std::tuple< RetCode, details::handle< physical_volume_t > >
         open_physical_volume( std::filesystem::path&& path, int priority = 0 ) noexcept
         {
             return open< physical_volume_t >( path, priority );
@@ -168,32 +188,25 @@ namespace jb
 
         /** Closes given volume
 
+        The volume gets released as soon as nobody has it locked or mounted, until then the handle and its copies
+        stay valid, after that they expire
+
         @tparam VolumeType - volume type (virtual or physical)
         @param [in] volume - volume to be closed
         @retval error code
         @throw nothing
         */
         template< typename VolumeType >
-        static RetCode close( std::weak_ptr< VolumeType > volume ) noexcept
+        static RetCode close( const details::handle< VolumeType >& volume ) noexcept
         {
             static_assert(  std::is_same_v< VolumeType, virtual_volume_t > || 
                             std::is_same_v< VolumeType, physical_volume_t > );
 
+            typename Policies::metrics::scope measure( details::operation::close );
+
             try
             {
-                auto [guard, volumes] = singleton< VolumeType >();
-
-                std::unique_lock lock( guard );
-
-                if ( auto it = volumes.find( volume.lock() ); it != volumes.end() )
-                {
-                    volumes.erase( it );
-                    return RetCode::Ok;
-                }
-                else
-                {
-                    return RetCode::InvalidHandle;
-                }
+                return singleton< VolumeType >().erase( volume ) ? RetCode::Ok : RetCode::InvalidHandle;
             }
             catch ( ... )
             {
@@ -210,18 +223,8 @@ namespace jb
         {
             try
             {
-                {
-                    auto [guard, volumes] = singleton< virtual_volume_t >();
-
-                    std::unique_lock lock( guard );
-                    volumes.clear();
-                }
-                {
-                    auto [guard, volumes] = singleton< physical_volume_t >();
-
-                    std::unique_lock lock( guard );
-                    volumes.clear();
-                }
+                singleton< virtual_volume_t >().clear();
+                singleton< physical_volume_t >().clear();
 
                 return RetCode::Ok;
             }
@@ -230,6 +233,18 @@ namespace jb
                 return RetCode::UnknownError;
             }
         }
+
+
+        /** Provides latency histogram of a public operation, merged over all the threads
+
+        @param [in] op - the operation
+        @retval histogram snapshot, values in nanoseconds
+        @throw nothing
+        */
+        static auto latency( details::operation op ) noexcept
+        {
+            return Policies::metrics::snapshot( op );
+        }
     };
 }
 
@@ -4,40 +4,237 @@
 
 #include "ret_codes.h"
 #include "exception.h"
+#include "access_mode.h"
+#include "dirty_page_map.h"
+#include "page_flusher.h"
+#include "superblock.h"
+#include "free_space_map.h"
 #include <filesystem>
+#include <tuple>
 
 
 namespace jb
 {
     namespace details
     {
+        /** Paged storage file, page #0 holds the superblock
+
+        Opening reads nothing but the superblock whatever the file size: the structures it refers to (page table,
+        free-space map, indices) get loaded lazily by their owners. A writer clears the clean-shutdown flag of the
+        superblock on open and sets it back on close after everything got written back, so the next opener learns
+        from clean_shutdown() if the structures could be trusted or have to be recovered
+        */
         template < typename Policies >
         class storage_file : public Policies::api
         {
             class cache;
             class chunk;
 
+            using api = typename Policies::api;
+
+        public:
+
             using mapped_page = typename cache::mapped_page;
-            using mapped_page_ptr = typename mapped_page::mapped_page_ptr;
+            using mapped_page_ptr = typename cache::mapped_page_ptr;
+            using cached_page = typename cache::cached_page;
+            using superblock_t = details::superblock< storage_file >;
+            using free_space_map_t = details::free_space_map< Policies, storage_file >;
+
+        private:
 
+            dirty_page_map dirty_pages_;
             cache cache_;
+            page_flusher< Policies, storage_file > flusher_;
+            superblock_t superblock_;
+            free_space_map_t free_space_;
+            bool clean_shutdown_ = true;
 
         public:
 
             storage_file() = delete;
             storage_file( storage_file&& ) = delete;
 
-            explicit storage_file( std::filesystem::path&& path ) try
-                : api( std::filesystem::absolute( path ) )
+            explicit storage_file( std::filesystem::path&& path, AccessMode mode = AccessMode::Exclusive ) try
+                : api( std::filesystem::absolute( path ), mode )
+                , dirty_pages_()
                 , cache_( *this )
+                , flusher_( *this, dirty_pages_ )
+                , superblock_( *this )
+                , free_space_( *this )
             {
-                if ( !size() ) grow( 0 );
+                if ( !api::size() && !api::read_only() ) grow( 0 );
+
+                // a file that was never committed has nothing to recover
+                auto header = superblock_.current();
+                clean_shutdown_ = !header.sequence_ || header.clean_;
+
+                if ( !api::read_only() && clean_shutdown_ )
+                {
+                    superblock_.commit( []( auto& h ) { h.clean_ = 0; } );
+                }
             }
             catch ( const std::filesystem::filesystem_error & e )
             {
                 throw runtime_error( RetCode::InvalidFilePath, "Invalid file path" );
             }
 
+
+            /** Closes the file, a writer marks it clean if all modified pages could be written back
+            */
+            ~storage_file()
+            {
+                if ( api::read_only() ) return;
+
+                try
+                {
+                    free_space_.drain();
+                    checkpoint();
+
+                    superblock_.commit( []( auto& h ) { h.clean_ = 1; } );
+                }
+                catch ( ... )
+                {
+                    // the file stays marked as not closed cleanly
+                }
+            }
+
+
+            /** Provides the superblock, the only one of the file (see superblock for how commits of different
+                structures are combined)
+
+            @throw nothing
+            */
+            superblock_t& superblock() noexcept
+            {
+                return superblock_;
+            }
+
+
+            /** Checks if the last writer closed the file cleanly
+
+            @retval false if the writer crashed, so the structures the superblock refers to have to be recovered
+            @throw nothing
+            */
+            bool clean_shutdown() const noexcept
+            {
+                return clean_shutdown_;
+            }
+
+
+            /** Allocates contiguous pages through the free-space map, see free_space_map
+
+            @param [in] count - number of pages
+            @retval offset of the first page
+            @throw details::runtime_error, std::bad_alloc
+            */
+            size_t allocate( size_t count = 1 )
+            {
+                return free_space_.allocate( count );
+            }
+
+
+            /** Returns pages to the free-space map, no committed state may refer to them
+
+            @param [in] offset - offset of the first page
+            @param [in] count - number of pages
+            @throw details::runtime_error, std::bad_alloc, std::logic_error
+            */
+            void deallocate( size_t offset, size_t count = 1 )
+            {
+                free_space_.deallocate( offset, count );
+            }
+
+
+            /** Grows the file by a page, reports the growth to Policies::tracer
+
+            @param [in] current_size - the file size the caller saw, the file grows only if it did not change
+            @retval true if the file grew
+            @throw details::runtime_error
+            */
+            bool grow( size_t current_size )
+            {
+                typename Policies::tracer::scope trace( trace_event::grow, current_size );
+                return api::grow( current_size );
+            }
+
+
+            /** Maps a page into memory, reports the mapping to Policies::tracer
+
+            @param [in] offset - page offset
+            @retval mapped area
+            @throw details::runtime_error, std::logic_error
+            */
+            auto map_page( size_t offset )
+            {
+                typename Policies::tracer::scope trace( trace_event::map_page, offset );
+                return api::map_page( offset );
+            }
+
+
+            /** Provides cached page
+
+            @param [in] offset - page offset
+            @retval the page, lock() it to get the data mapped
+            @throw std::bad_alloc
+            */
+            mapped_page_ptr get_page( size_t offset )
+            {
+                assert( offset % api::page_size() == 0 );
+                return cache_.get_mapped_page( offset );
+            }
+
+
+            /** Provides cached page through per-thread cache of recently used pages, intended for hot pages
+
+            @param [in] offset - page offset
+            @retval the page, keeps the page's shard from recycling unused pages while it lives (see cache.h)
+            @throw std::bad_alloc
+            */
+            cached_page get_cached_page( size_t offset )
+            {
+                assert( offset % api::page_size() == 0 );
+                return cache_.get_cached_page( offset );
+            }
+
+
+            /** Provides memory usage of the page cache
+
+            @retval number of allocated page descriptors (they are reused, not freed while the file is open),
+                number of them currently bound to pages
+            @throw nothing
+            */
+            std::tuple< size_t, size_t > cache_usage() const noexcept
+            {
+                return { cache_.size(), cache_.used() };
+            }
+
+
+            /** Marks a page as modified, so background flusher writes it back
+
+            Must be called after the page was modified
+
+            @param [in] offset - page offset
+            @throw std::bad_alloc, std::logic_error
+            */
+            void mark_dirty( size_t offset )
+            {
+                assert( offset % api::page_size() == 0 );
+                dirty_pages_.mark( offset / api::page_size() );
+            }
+
+
+            /** Writes back all modified pages and makes them durable
+
+            Bounds recovery work: together with write-ahead log the checkpoint goes as
+                lsn = log.rotate(); file.checkpoint(); log.truncate( lsn );
+
+            @throw details::runtime_error, std::bad_alloc
+            */
+            void checkpoint()
+            {
+                flusher_.checkpoint();
+            }
+
         };
     }
 }
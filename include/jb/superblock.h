@@ -0,0 +1,239 @@
+#ifndef __JB__SUPERBLOCK__H__
+#define __JB__SUPERBLOCK__H__
+
+
+#include "ret_codes.h"
+#include "exception.h"
+#include <boost/crc.hpp>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+#include <assert.h>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Keeps the root of persistent state of a storage file in the file's page #0
+
+        The page holds two copies (slots) of the header, each in its own 512-byte sector and protected with CRC32.
+        A commit writes the slot that is NOT active with incremented sequence number and syncs the file, so a crash
+        at any moment leaves at least one valid slot. On open the valid slot with the greatest sequence number
+        wins, i.e. recovery costs reading a single page regardless of the file size.
+
+        Each slot records format version and page size of the file. A file of newer format or of another page size
+        is refused
+
+        The header is shared by all the structures of the file, each of them owns its own fields. A commit modifies
+        the current header under the superblock mutex, so commits of different structures are serialized and never
+        overwrite each other's fields with stale values
+
+        File concept:
+            static size_t page_size() - page size
+            size_t size() - file size, a file without page #0 has empty header
+            safe_mapped_area map_page( size_t offset ) - maps a page into memory
+            void flush( size_t offset, size_t size ) - initiates write-back of a range
+            void sync() - makes all initiated write-backs durable
+
+        @tparam File - storage file
+        */
+        template < typename File >
+        class superblock
+        {
+        public:
+
+            static constexpr size_t root_count = 8;
+
+            /** Persistent root, offsets of 0 refer to nothing
+            */
+            struct header
+            {
+                uint64_t sequence_ = 0;
+                uint64_t page_table_ = 0;                       // directory page of shadow page table
+                uint64_t free_space_ = 0;                       // root page of free-space map
+                std::array< uint64_t, root_count > roots_{};    // roots of persistent structures (e.g. indices)
+                uint64_t clean_ = 0;                            // not 0 if the writer closed the file cleanly
+            };
+
+            static constexpr uint32_t version = 1;
+
+        private:
+
+            static constexpr uint64_t magic_ = 0x4b434f4c4250424aULL; // "JBPBLOCK"
+            static constexpr size_t slot_size_ = 512;
+
+            struct slot
+            {
+                uint64_t magic_;
+                uint32_t version_;
+                uint32_t page_size_;
+                header header_;
+                uint32_t crc_;
+                uint32_t reserved_;
+            };
+
+            static_assert( sizeof( slot ) <= slot_size_ );
+            static_assert( std::has_unique_object_representations_v< slot >, "The slot must have no padding" );
+            static_assert( std::has_unique_object_representations_v< header >, "The header must have no padding" );
+
+            File& file_;
+            mutable std::mutex guard_;
+            header current_;
+            size_t active_ = 1;
+
+
+            /** Calculates CRC32 of a slot
+
+            @param [in] s - slot
+            @retval checksum
+            @throw nothing
+            */
+            static uint32_t checksum( const slot& s ) noexcept
+            {
+                boost::crc_32_type crc;
+                crc.process_bytes( &s, offsetof( slot, crc_ ) );
+                return crc.checksum();
+            }
+
+
+            /** Parses a slot
+
+            @param [in] data - slot content
+            @param [out] h - the header
+            @retval true if the slot is valid
+            @throw details::runtime_error( IncompatibleFile ) if the slot is valid but the file is not compatible
+            */
+            static bool parse( const char* data, header& h )
+            {
+                slot s;
+                std::memcpy( &s, data, sizeof( s ) );
+
+                if ( s.magic_ == magic_ && s.version_ && s.crc_ == checksum( s ) )
+                {
+                    if ( s.version_ > version )
+                    {
+                        throw runtime_error( RetCode::IncompatibleFile, "The file has newer format" );
+                    }
+                    if ( s.page_size_ != File::page_size() )
+                    {
+                        throw runtime_error( RetCode::IncompatibleFile, "The file has another page size" );
+                    }
+
+                    h = s.header_;
+                    return true;
+                }
+
+                return false;
+            }
+
+        public:
+
+            superblock() = delete;
+            superblock( superblock&& ) = delete;
+
+
+            /** Reads the superblock
+
+            If there is no valid slot (e.g. the file is new) the superblock gets initialized with empty header
+
+            @param [in] file - storage file
+            @throw details::runtime_error, std::logic_error
+            */
+            explicit superblock( File& file ) : file_( file )
+            {
+                static_assert( 2 * slot_size_ <= 0x1000, "The superblock must fit the smallest page" );
+
+                reload();
+            }
+
+
+            /** Re-reads the superblock, lets a reader process see commits of the writer process
+
+            A slot being written concurrently fails CRC check and gets ignored
+
+            @throw details::runtime_error, std::logic_error
+            */
+            void reload()
+            {
+                std::unique_lock lock( guard_ );
+
+                if ( file_.size() < File::page_size() ) return;
+
+                auto page = file_.map_page( 0 );
+                auto data = static_cast< const char* >( page.get() );
+
+                //
+                // if there is no valid slot pretend slot #1 is active, so the 1st commit goes to slot #0
+                //
+                bool found = false;
+                for ( size_t i = 0; i < 2; ++i )
+                {
+                    header h;
+                    if ( parse( data + i * slot_size_, h ) && ( !found || h.sequence_ > current_.sequence_ ) )
+                    {
+                        current_ = h;
+                        active_ = i;
+                        found = true;
+                    }
+                }
+            }
+
+
+            /** Provides current header
+
+            @throw nothing
+            */
+            header current() const noexcept
+            {
+                std::unique_lock lock( guard_ );
+                return current_;
+            }
+
+
+            /** Atomically modifies the header
+
+            All the pages the modified header refers to must be durable before the call
+
+            @param [in] fn - callable( header& ) modifying a copy of current header, sequence number gets assigned
+                             automatically
+            @retval the committed header
+            @throw details::runtime_error
+            */
+            template < typename Fn >
+            header commit( Fn&& fn )
+            {
+                std::unique_lock lock( guard_ );
+
+                auto h = current_;
+                fn( h );
+                h.sequence_ = current_.sequence_ + 1;
+
+                slot s{};
+                s.magic_ = magic_;
+                s.version_ = version;
+                s.page_size_ = static_cast< uint32_t >( File::page_size() );
+                s.header_ = h;
+                s.crc_ = checksum( s );
+
+                auto target = active_ ^ 1;
+                {
+                    auto page = file_.map_page( 0 );
+                    std::memcpy( static_cast< char* >( page.get() ) + target * slot_size_, &s, sizeof( s ) );
+                }
+
+                file_.flush( 0, file_.page_size() );
+                file_.sync();
+
+                current_ = h;
+                active_ = target;
+
+                return h;
+            }
+        };
+    }
+}
+
+#endif
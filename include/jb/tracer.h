@@ -0,0 +1,242 @@
+#ifndef __JB__TRACER__H__
+#define __JB__TRACER__H__
+
+
+#include "ret_codes.h"
+#include "exception.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Hot-path events reported to Policies::tracer
+        */
+        enum class trace_event : uint8_t
+        {
+            map_page,               // a page gets mapped into memory, argument - page offset
+            grow,                   // the file grows, argument - file size before the growth
+            cache_miss,             // the page cache has no requested page, argument - page offset
+            page_lock,              // mapped page gets locked, argument - page offset
+            exclusive_lock_wait,    // a writer parks on rare_exclusive_frequent_shared_mutex
+            shared_lock_wait,       // a reader parks on rare_exclusive_frequent_shared_mutex
+            count
+        };
+
+
+        /** Provides event name as it appears in a trace
+
+        @param [in] event - the event
+        @throw nothing
+        */
+        inline const char* trace_event_name( trace_event event ) noexcept
+        {
+            static constexpr const char* names[] = { "map_page", "grow", "cache_miss", "page_lock", "exclusive_lock_wait", "shared_lock_wait" };
+            static_assert( std::size( names ) == static_cast< size_t >( trace_event::count ) );
+
+            return static_cast< size_t >( event ) < std::size( names ) ? names[ static_cast< size_t >( event ) ] : "unknown";
+        }
+
+
+        /** Tracer concept implementation that does nothing, the calls compile away
+
+        Tracer concept:
+            scope( trace_event, uint64_t argument ) - RAII object measuring an event from construction to destruction
+            static void instant( trace_event, uint64_t argument ) - reports an event without duration
+        */
+        struct null_tracer
+        {
+            struct scope
+            {
+                constexpr explicit scope( trace_event, uint64_t = 0 ) noexcept {}
+            };
+
+            static constexpr void instant( trace_event, uint64_t = 0 ) noexcept {}
+        };
+
+
+        /** Tracer keeping the last Capacity events in process-wide ring buffer, dumps them as Chrome trace JSON
+
+        Recording an event costs two clock readings and a fetch_add on the ring position, the oldest events get
+        overwritten. Each ring entry is guarded by its own sequence number written last, so dump() may run while
+        the events are recorded: it skips entries being overwritten. Open the dump in chrome://tracing or Perfetto
+
+        @tparam Capacity - number of events kept, power of 2
+        */
+        template < size_t Capacity = 1 << 16 >
+        class ring_tracer
+        {
+            static_assert( Capacity && !( Capacity & ( Capacity - 1 ) ), "Capacity must be power of 2" );
+
+            struct entry
+            {
+                std::atomic< uint64_t > sequence_;  // position + 1 when the entry is complete, 0 while it's written
+                std::atomic< uint64_t > start_;
+                std::atomic< uint64_t > duration_;
+                std::atomic< uint64_t > argument_;
+                std::atomic< uint64_t > kind_;      // event | instant flag << 8 | thread << 16
+            };
+
+            static constexpr uint64_t instant_flag_ = 1 << 8;
+
+            inline static std::array< entry, Capacity > ring_;
+            inline static std::atomic< uint64_t > position_ = 0;
+            inline static std::atomic< uint64_t > thread_count_ = 0;
+            inline static const auto origin_ = std::chrono::steady_clock::now();
+
+
+            static uint64_t now() noexcept
+            {
+                return static_cast< uint64_t >( std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - origin_ ).count() );
+            }
+
+
+            static uint64_t thread() noexcept
+            {
+                static thread_local const uint64_t id = thread_count_.fetch_add( 1, std::memory_order_relaxed ) + 1;
+                return id;
+            }
+
+
+            static void record( trace_event event, uint64_t argument, uint64_t start, uint64_t duration, bool instant ) noexcept
+            {
+                auto position = position_.fetch_add( 1, std::memory_order_relaxed );
+                auto& e = ring_[ position % Capacity ];
+
+                e.sequence_.store( 0, std::memory_order_relaxed );
+                std::atomic_thread_fence( std::memory_order_release );
+
+                e.start_.store( start, std::memory_order_relaxed );
+                e.duration_.store( duration, std::memory_order_relaxed );
+                e.argument_.store( argument, std::memory_order_relaxed );
+                e.kind_.store( static_cast< uint64_t >( event ) | ( instant ? instant_flag_ : 0 ) | thread() << 16, std::memory_order_relaxed );
+
+                e.sequence_.store( position + 1, std::memory_order_release );
+            }
+
+        public:
+
+            /** Measures an event from construction to destruction
+            */
+            class scope
+            {
+                trace_event event_;
+                uint64_t argument_;
+                uint64_t start_;
+
+            public:
+
+                explicit scope( trace_event event, uint64_t argument = 0 ) noexcept
+                    : event_( event )
+                    , argument_( argument )
+                    , start_( now() )
+                {}
+
+                scope( scope&& ) = delete;
+
+                ~scope()
+                {
+                    record( event_, argument_, start_, now() - start_, false );
+                }
+            };
+
+
+            /** Reports an event without duration
+
+            @param [in] event - the event
+            @param [in] argument - event argument
+            @throw nothing
+            */
+            static void instant( trace_event event, uint64_t argument = 0 ) noexcept
+            {
+                record( event, argument, now(), 0, true );
+            }
+
+
+            /** Drops all recorded events
+
+            Must not run concurrently with recording
+
+            @throw nothing
+            */
+            static void clear() noexcept
+            {
+                for ( auto& e : ring_ ) e.sequence_.store( 0, std::memory_order_relaxed );
+                position_.store( 0, std::memory_order_release );
+            }
+
+
+            /** Writes recorded events to a file in Chrome trace event format
+
+            @param [in] path - file path
+            @retval number of written events
+            @throw details::runtime_error( IoError ) if the file cannot be written, std::bad_alloc
+            */
+            static size_t dump( const std::filesystem::path& path )
+            {
+                std::ofstream out( path, std::ios::trunc );
+                if ( !out )
+                {
+                    throw runtime_error( RetCode::IoError, "Unable to open trace file" );
+                }
+
+                auto end = position_.load( std::memory_order_acquire );
+                auto begin = end > Capacity ? end - Capacity : 0;
+                size_t written = 0;
+
+                out << "{\"traceEvents\":[";
+
+                for ( auto position = begin; position < end; ++position )
+                {
+                    auto& e = ring_[ position % Capacity ];
+
+                    if ( e.sequence_.load( std::memory_order_acquire ) != position + 1 ) continue;
+
+                    auto start = e.start_.load( std::memory_order_relaxed );
+                    auto duration = e.duration_.load( std::memory_order_relaxed );
+                    auto argument = e.argument_.load( std::memory_order_relaxed );
+                    auto kind = e.kind_.load( std::memory_order_relaxed );
+
+                    // skip the entry if it got overwritten while we were reading it
+                    std::atomic_thread_fence( std::memory_order_acquire );
+                    if ( e.sequence_.load( std::memory_order_relaxed ) != position + 1 ) continue;
+
+                    out << ( written++ ? ",\n" : "\n" )
+                        << "{\"name\":\"" << trace_event_name( static_cast< trace_event >( kind & 0xff ) ) << "\""
+                        << ",\"cat\":\"jb\""
+                        << ",\"ph\":\"" << ( kind & instant_flag_ ? "i" : "X" ) << "\""
+                        << ",\"ts\":" << start / 1000 << "." << start % 1000 / 100 << start % 100 / 10 << start % 10;
+
+                    if ( kind & instant_flag_ )
+                    {
+                        out << ",\"s\":\"t\"";
+                    }
+                    else
+                    {
+                        out << ",\"dur\":" << duration / 1000 << "." << duration % 1000 / 100 << duration % 100 / 10 << duration % 10;
+                    }
+
+                    out << ",\"pid\":1,\"tid\":" << ( kind >> 16 ) << ",\"args\":{\"arg\":" << argument << "}}";
+                }
+
+                out << "\n]}\n";
+
+                if ( !out )
+                {
+                    throw runtime_error( RetCode::IoError, "Unable to write trace file" );
+                }
+
+                return written;
+            }
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,450 @@
+#ifndef __JB__UNIX_API__H__
+#define __JB__UNIX_API__H__
+
+
+#include "ret_codes.h"
+#include "exception.h"
+#include "access_mode.h"
+#include "coordination_region.h"
+#include "seqlock.h"
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <assert.h>
+
+
+namespace jb
+{
+    //
+    // the namespace is not called "unix" cuz GCC predefines such macro in GNU mode
+    //
+    namespace posix
+    {
+        /** Owns file descriptor, closes it on destruction
+        */
+        class safe_fd
+        {
+            int fd_ = -1;
+
+        public:
+
+            safe_fd() noexcept = default;
+            explicit safe_fd( int fd ) noexcept : fd_( fd ) {}
+            safe_fd( safe_fd&& other ) noexcept { std::swap( fd_, other.fd_ ); }
+            ~safe_fd() { if ( fd_ >= 0 ) ::close( fd_ ); }
+
+            safe_fd& operator = ( safe_fd&& other ) noexcept
+            {
+                safe_fd dummy;
+                std::swap( fd_, dummy.fd_ );
+                std::swap( fd_, other.fd_ );
+                return *this;
+            }
+
+            int get() const noexcept { return fd_; }
+            explicit operator bool() const noexcept { return fd_ >= 0; }
+        };
+
+
+        /** Provides storage file operations
+
+        In AccessMode::Exclusive the file is locked exclusively (BSD lock). Writer and reader processes lock it
+        shared, so an exclusive opener fails while they are there and vice versa; the only writer additionally
+        locks "<file>.shm" exclusively. The same file keeps coordination_region all of them map, so the writer
+        publishes commits to readers. Readers map the data read-only, i.e. all the processes share a single copy
+        of the data in the OS page cache
+        */
+        class api
+        {
+            struct unmap_area
+            {
+                void operator()( void* p ) noexcept { ::munmap( p, page_size() ); }
+            };
+
+            struct unmap_region
+            {
+                void operator()( void* p ) noexcept { ::munmap( p, details::coordination_region::size() ); }
+            };
+
+            static size_t get_page_size() noexcept
+            {
+                return static_cast< size_t >( ::sysconf( _SC_PAGESIZE ) );
+            }
+
+            /** Takes BSD lock over a file
+
+            BSD lock belongs to open file description, so it prevents the file from being opened twice even within
+            the same process
+
+            @throw details::runtime_error
+            */
+            static void lock_file( const safe_fd& file, int operation )
+            {
+                if ( ::flock( file.get(), operation | LOCK_NB ) )
+                {
+                    if ( EWOULDBLOCK == errno )
+                    {
+                        throw details::runtime_error( RetCode::AlreadyInUse, "The file is already in use" );
+                    }
+                    else
+                    {
+                        throw details::runtime_error( RetCode::UnknownError, "Unable to lock storage file" );
+                    }
+                }
+            }
+
+            std::filesystem::path path_;
+            AccessMode mode_;
+            bool newly_created_ = false;
+            inline static const size_t page_size_ = get_page_size();
+            std::mutex resize_guard_;
+            details::seqlock< size_t > size_;   // must precede file_, cuz open_file() sets it
+            safe_fd region_file_;   // must precede file_, cuz writer lock must be taken before to check the size
+            safe_fd file_;
+            std::unique_ptr< void, unmap_region > region_memory_;
+            details::coordination_region* region_ = nullptr;
+
+            safe_fd open_region_file()
+            {
+                if ( AccessMode::Exclusive == mode_ ) return safe_fd{};
+
+                auto path = path_;
+                path += ".shm";
+
+                safe_fd file( ::open( path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 ) );
+                if ( !file )
+                {
+                    throw details::runtime_error( RetCode::CannotOpenFile, "Unable to open/create coordination file" );
+                }
+
+                // there is the only writer
+                if ( AccessMode::Writer == mode_ ) lock_file( file, LOCK_EX );
+
+                return file;
+            }
+
+            safe_fd open_file()
+            {
+                auto read_only = AccessMode::Reader == mode_;
+
+                safe_fd file( ::open( path_.c_str(), read_only ? O_RDONLY | O_CLOEXEC : O_RDWR | O_CREAT | O_CLOEXEC, 0644 ) );
+                if ( !file )
+                {
+                    throw details::runtime_error( RetCode::CannotOpenFile, "Unable to open/create storage file" );
+                }
+
+                lock_file( file, AccessMode::Exclusive == mode_ ? LOCK_EX : LOCK_SH );
+
+                struct stat st;
+                if ( ::fstat( file.get(), &st ) )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to get size of storage file" );
+                }
+
+                // an empty file could be created by us only cuz we hold the (writer) lock
+                if ( !st.st_size && !read_only )
+                {
+                    newly_created_ = true;
+
+                    if ( ::ftruncate( file.get(), static_cast< off_t >( page_size() ) ) )
+                    {
+                        throw details::runtime_error( RetCode::IoError, "Unable to resize file" );
+                    }
+
+                    size_.store( page_size() );
+                }
+                else
+                {
+                    size_.store( static_cast< size_t >( st.st_size ) );
+                }
+
+                return file;
+            }
+
+            void map_region()
+            {
+                if ( !region_file_ ) return;
+
+                struct stat st;
+                if ( ::fstat( region_file_.get(), &st ) )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to get size of coordination file" );
+                }
+
+                // extending the file zeroes new space, so concurrent openers agree on initial content
+                if ( static_cast< size_t >( st.st_size ) < details::coordination_region::size() &&
+                    ::ftruncate( region_file_.get(), static_cast< off_t >( details::coordination_region::size() ) ) )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to resize coordination file" );
+                }
+
+                auto p = ::mmap( nullptr, details::coordination_region::size(), PROT_READ | PROT_WRITE, MAP_SHARED, region_file_.get(), 0 );
+                if ( MAP_FAILED == p )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to map coordination file into memory" );
+                }
+
+                region_memory_.reset( p );
+                region_ = details::coordination_region::attach( p );
+            }
+
+        public:
+
+            api() = delete;
+            api( api&& ) = delete;
+
+            explicit api( std::filesystem::path&& path, AccessMode mode = AccessMode::Exclusive )
+                : path_( std::move( path ) )
+                , mode_( mode )
+                , region_file_( open_region_file() )
+                , file_( open_file() )
+            {
+                map_region();
+            }
+
+            AccessMode access_mode() const noexcept
+            {
+                return mode_;
+            }
+
+            bool read_only() const noexcept
+            {
+                return AccessMode::Reader == mode_;
+            }
+
+            /** Provides region coordinating writer and reader processes, nullptr in exclusive mode
+            */
+            details::coordination_region* coordination() const noexcept
+            {
+                return region_;
+            }
+
+            static uint64_t process_id() noexcept
+            {
+                return static_cast< uint64_t >( ::getpid() );
+            }
+
+            static bool process_alive( uint64_t id ) noexcept
+            {
+                return !::kill( static_cast< pid_t >( id ), 0 ) || EPERM == errno;
+            }
+
+            static size_t page_size() noexcept
+            {
+                return page_size_;
+            }
+
+            bool newly_created() const noexcept
+            {
+                return newly_created_;
+            }
+
+            /** Provides file size
+
+            Only we change the size of the file we write, so the size is taken from seqlock, i.e. without a syscall
+            and without a store. A reader process asks the system, cuz the writer process grows the file
+            */
+            size_t size() const
+            {
+                if ( !read_only() ) return size_.load();
+
+                struct stat st;
+                if ( ::fstat( file_.get(), &st ) )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to get size of storage file" );
+                }
+
+                return static_cast< size_t >( st.st_size );
+            }
+
+            bool grow( size_t current_size )
+            {
+                assert( file_ );
+
+                if ( read_only() )
+                {
+                    throw details::runtime_error( RetCode::ReadOnly, "The file is opened for reading only" );
+                }
+
+                // growers serialize on the mutex, size readers never touch it
+                std::unique_lock lock( resize_guard_ );
+                {
+                    if ( auto size = size_.load(); size == current_size )
+                    {
+                        if ( ::ftruncate( file_.get(), static_cast< off_t >( size + page_size() ) ) )
+                        {
+                            throw details::runtime_error( RetCode::IoError, "Unable to resize file" );
+                        }
+
+                        size_.store( size + page_size() );
+
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            using safe_mapped_area = std::unique_ptr< void, unmap_area >;
+
+            safe_mapped_area map_page( size_t offset )
+            {
+                assert( file_ );
+
+                // check offset
+                if ( offset % page_size() )
+                {
+                    throw std::logic_error( "Requested mapping offset conflicts with memory granuarity" );
+                }
+                else if ( offset + page_size() > size() )
+                {
+                    throw std::logic_error( "Requested mapping offset exceeds file size" );
+                }
+
+                auto protection = read_only() ? PROT_READ : PROT_READ | PROT_WRITE;
+                auto p = ::mmap( nullptr, page_size(), protection, MAP_SHARED, file_.get(), static_cast< off_t >( offset ) );
+                if ( MAP_FAILED == p )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to map file into memory" );
+                }
+
+                return safe_mapped_area{ p, unmap_area{} };
+            }
+
+            void flush( size_t offset, size_t size )
+            {
+                assert( file_ );
+                assert( offset % page_size() == 0 );
+
+                // nothing to write back
+                if ( read_only() ) return;
+
+#if defined( __linux__ )
+                // initiate write-back of dirty pages in the range without waiting for completion
+                if ( ::sync_file_range( file_.get(), static_cast< off_t >( offset ), static_cast< off_t >( size ), SYNC_FILE_RANGE_WRITE ) )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to flush file range" );
+                }
+#else
+                auto p = ::mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_.get(), static_cast< off_t >( offset ) );
+                if ( MAP_FAILED == p )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to map file into memory" );
+                }
+
+                auto rc = ::msync( p, size, MS_ASYNC );
+                ::munmap( p, size );
+
+                if ( rc )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to flush file range" );
+                }
+#endif
+            }
+
+            void sync()
+            {
+                assert( file_ );
+
+                if ( ::fdatasync( file_.get() ) )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to flush storage file" );
+                }
+            }
+
+
+            /** Append-only file with explicit durability control, used as write-ahead log segment
+            */
+            class log_file
+            {
+                safe_fd file_;
+
+            public:
+
+                log_file() = delete;
+                log_file( log_file&& ) = delete;
+
+                explicit log_file( const std::filesystem::path& path )
+                    : file_( ::open( path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644 ) )
+                {
+                    if ( !file_ )
+                    {
+                        throw details::runtime_error( RetCode::CannotOpenFile, "Unable to open/create log file" );
+                    }
+                }
+
+                size_t size() const
+                {
+                    struct stat st;
+                    if ( ::fstat( file_.get(), &st ) )
+                    {
+                        throw details::runtime_error( RetCode::IoError, "Unable to get size of log file" );
+                    }
+
+                    return static_cast< size_t >( st.st_size );
+                }
+
+                void append( const void* data, size_t size )
+                {
+                    auto p = static_cast< const char* >( data );
+
+                    while ( size )
+                    {
+                        auto written = ::write( file_.get(), p, size );
+                        if ( written < 0 )
+                        {
+                            if ( EINTR == errno ) continue;
+                            throw details::runtime_error( RetCode::IoError, "Unable to write log file" );
+                        }
+
+                        p += written;
+                        size -= static_cast< size_t >( written );
+                    }
+                }
+
+                void sync()
+                {
+                    if ( ::fdatasync( file_.get() ) )
+                    {
+                        throw details::runtime_error( RetCode::IoError, "Unable to flush log file" );
+                    }
+                }
+
+                size_t read( size_t offset, void* buffer, size_t size ) const
+                {
+                    auto p = static_cast< char* >( buffer );
+                    size_t total = 0;
+
+                    while ( total < size )
+                    {
+                        auto got = ::pread( file_.get(), p + total, size - total, static_cast< off_t >( offset + total ) );
+                        if ( got < 0 )
+                        {
+                            if ( EINTR == errno ) continue;
+                            throw details::runtime_error( RetCode::IoError, "Unable to read log file" );
+                        }
+                        else if ( !got )
+                        {
+                            break;
+                        }
+
+                        total += static_cast< size_t >( got );
+                    }
+
+                    return total;
+                }
+            };
+        };
+    }
+}
+
+#endif
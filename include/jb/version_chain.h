@@ -0,0 +1,184 @@
+#ifndef __JB__VERSION_CHAIN__H__
+#define __JB__VERSION_CHAIN__H__
+
+
+#include <atomic>
+#include <memory>
+#include <assert.h>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Keeps versions of a record ordered from the newest to the oldest one
+
+        Each version is tagged with commit sequence number (see snapshot_registry). Reading is lock-free: a reader
+        walks the chain from the newest version and takes the first one not newer than its snapshot. Versions are
+        immutable once published, so writers never wait for readers.
+
+        Modifying operations (put(), erase(), collect()) must be serialized by the caller, e.g. by the lock
+        protecting the record owner; get() may run concurrently with any of them
+
+        @tparam Value - value type
+        */
+        template < typename Value >
+        class version_chain
+        {
+            struct version
+            {
+                uint64_t sequence_;
+                bool deleted_;
+                Value value_;
+                std::atomic< version* > older_;
+            };
+
+            std::atomic< version* > newest_ = nullptr;
+
+
+            /** Deletes given version and all the older ones
+
+            @param [in] v - the newest version to be deleted
+            @retval number of deleted versions
+            @throw nothing
+            */
+            static size_t destroy( version* v ) noexcept
+            {
+                size_t count = 0;
+
+                while ( v )
+                {
+                    auto older = v->older_.load( std::memory_order_relaxed );
+                    delete v;
+                    v = older;
+                    ++count;
+                }
+
+                return count;
+            }
+
+
+            /** Publishes new version at the head of the chain
+
+            @param [in] sequence - commit sequence number, must be greater than one of the newest version
+            @param [in] deleted - true for deletion mark
+            @param [in] value - value
+            @throw std::bad_alloc
+            */
+            void push( uint64_t sequence, bool deleted, Value&& value )
+            {
+                auto newest = newest_.load( std::memory_order_relaxed );
+                assert( !newest || newest->sequence_ < sequence );
+
+                auto v = new version{ sequence, deleted, std::move( value ), { newest } };
+                newest_.store( v, std::memory_order_release );
+            }
+
+        public:
+
+            /** Default constructor, creates empty chain
+
+            @throw nothing
+            */
+            version_chain() noexcept = default;
+
+
+            /** Explicitly deleted move constructor, makes the class non-copyable/movable
+            */
+            version_chain( version_chain&& ) = delete;
+
+
+            /** Destructor, releases all the versions
+            */
+            ~version_chain()
+            {
+                destroy( newest_.load( std::memory_order_acquire ) );
+            }
+
+
+            /** Adds new version of the record
+
+            @param [in] sequence - commit sequence number
+            @param [in] value - new value
+            @throw std::bad_alloc
+            */
+            void put( uint64_t sequence, Value&& value )
+            {
+                push( sequence, false, std::move( value ) );
+            }
+
+
+            /** Adds deletion mark
+
+            @param [in] sequence - commit sequence number
+            @throw std::bad_alloc
+            */
+            void erase( uint64_t sequence )
+            {
+                push( sequence, true, Value{} );
+            }
+
+
+            /** Finds version visible from a snapshot
+
+            @param [in] sequence - snapshot sequence number
+            @retval pointer to the value or nullptr if the record did not exist or was deleted at that moment,
+                    the pointer stays valid until the snapshot is released
+            @throw nothing
+            */
+            const Value* get( uint64_t sequence ) const noexcept
+            {
+                for ( auto v = newest_.load( std::memory_order_acquire ); v; v = v->older_.load( std::memory_order_acquire ) )
+                {
+                    if ( v->sequence_ <= sequence )
+                    {
+                        return v->deleted_ ? nullptr : &v->value_;
+                    }
+                }
+
+                return nullptr;
+            }
+
+
+            /** Reclaims versions that cannot be seen by any snapshot
+
+            Keeps the newest version visible from the oldest snapshot and drops all the older ones. Readers with
+            snapshot not older than given sequence stop at the kept version at the latest, so they never touch
+            the dropped ones
+
+            @param [in] oldest - the oldest visible sequence number, see snapshot_registry::oldest()
+            @retval number of reclaimed versions
+            @throw nothing
+            */
+            size_t collect( uint64_t oldest ) noexcept
+            {
+                for ( auto v = newest_.load( std::memory_order_relaxed ); v; v = v->older_.load( std::memory_order_relaxed ) )
+                {
+                    if ( v->sequence_ <= oldest )
+                    {
+                        return destroy( v->older_.exchange( nullptr, std::memory_order_acq_rel ) );
+                    }
+                }
+
+                return 0;
+            }
+
+
+            /** Checks if the chain holds nothing but a deletion mark visible to everybody, i.e. the record
+
+            itself can be dropped
+
+            @param [in] oldest - the oldest visible sequence number
+            @retval true if the record can be dropped
+            @throw nothing
+            */
+            bool dead( uint64_t oldest ) const noexcept
+            {
+                auto newest = newest_.load( std::memory_order_acquire );
+                return !newest || ( newest->deleted_ && newest->sequence_ <= oldest );
+            }
+        };
+    }
+}
+
+#endif
@@ -3,8 +3,19 @@
 
 #include "ret_codes.h"
 #include "mount_point.h"
+#include "physical_volume.h"
+#include "merged_cursor.h"
+#include "snapshot.h"
+#include "metrics.h"
+#include "handle_table.h"
 #include <tuple>
 #include <memory>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+#include <algorithm>
+#include <thread>
 
 namespace jb
 {
@@ -18,8 +29,17 @@ namespace jb
         {
             friend class storage< Policies >;
 
+        public:
+
             using key_t = std::basic_string< typename Policies::key_char_t, typename Policies::key_traits_t >;
+            using value_t = typename Policies::value_t;
             using mount_point_t = mount_point< Policies >;
+            using physical_volume_t = physical_volume< Policies >;
+            using snapshot_registry_t = snapshot_registry< Policies::snapshot_slot_count, typename Policies::backoff >;
+            using snapshot_t = typename snapshot_registry_t::snapshot;
+
+        private:
+
             using mount_point_ptr = std::shared_ptr< mount_point_t >;
 
             struct private_construction : public mount_point_t
@@ -28,11 +48,24 @@ namespace jb
                 private_construction( Args&&... args ) : mount_point_t( std::forward< Args >( args )... ) {}
             };
 
-        public:
+            mutable typename Policies::shared_mutex guard_;
+            std::vector< mount_point_ptr > mounts_;
+            snapshot_registry_t snapshots_;
 
-            using key_t = std::basic_string< typename Policies::key_char_t, typename Policies::key_traits_t >;
-            using value_t = typename Policies::value_t;
-            using mount_point_t = mount_point< Policies >;
+
+            /** Checks if one path is a prefix of another one
+
+            @param [in] prefix - supposed prefix
+            @param [in] path - path to be checked
+            @retval true if the path starts with the prefix
+            @throw nothing
+            */
+            static bool starts_with( const key_t& path, const key_t& prefix ) noexcept
+            {
+                return path.size() >= prefix.size() && !path.compare( 0, prefix.size(), prefix );
+            }
+
+        public:
 
             /** Default constructor
 
@@ -47,14 +80,176 @@ namespace jb
             virtual_volume( virtual_volume&& ) = delete;
 
 
-            std::tuple< RetCode, std::weak_ptr< mount_point_t > > mount() noexcept
+            /** Mounts physical path of physical volume to logical path of the virtual volume
+
+            The mount point gets parented to the deepest existing mount point whose logical path is a prefix of
+            requested logical path
+
+            @param [in] physical_volume - physical volume handle
+            @param [in] physical_path - physical path to be mounted
+            @param [in] logical_path - logical path to mount to
+            @retval error code
+            @retval mount point handle
+            @throw nothing
+            */
+            std::tuple< RetCode, std::weak_ptr< mount_point_t > > mount(
+                const handle< physical_volume_t >& physical_volume,
+                key_t&& physical_path,
+                key_t&& logical_path ) noexcept
             {
-                return { RetCode::UnknownError, std::weak_ptr< mount_point_t > >() };
+                typename Policies::metrics::scope measure( operation::mount );
+
+                try
+                {
+                    auto volume = physical_volume.lock().shared();
+                    if ( !volume )
+                    {
+                        return { RetCode::InvalidHandle, std::weak_ptr< mount_point_t >() };
+                    }
+
+                    std::unique_lock lock( guard_ );
+
+                    mount_point_ptr parent;
+                    for ( const auto& mp : mounts_ )
+                    {
+                        if ( starts_with( logical_path, mp->logical_path() ) && ( !parent || parent->logical_path().size() < mp->logical_path().size() ) )
+                        {
+                            parent = mp;
+                        }
+                    }
+
+                    mount_point_ptr mp = std::make_shared< private_construction >( volume, std::move( physical_path ), parent, std::move( logical_path ) );
+                    mounts_.push_back( mp );
+
+                    return { RetCode::Ok, std::weak_ptr< mount_point_t >( mp ) };
+                }
+                catch ( const std::bad_alloc& )
+                {
+                    return { RetCode::InsufficientMemory, std::weak_ptr< mount_point_t >() };
+                }
+                catch ( ... )
+                {
+                    return { RetCode::UnknownError, std::weak_ptr< mount_point_t >() };
+                }
             }
 
+
+            /** Unmounts given mount point
+
+            @param [in] mp - mount point handle
+            @retval error code
+            @throw nothing
+            */
             RetCode unmount( const std::weak_ptr< mount_point_t > & mp ) noexcept
             {
-                return RetCode::UnknownError;
+                typename Policies::metrics::scope measure( operation::unmount );
+
+                try
+                {
+                    std::unique_lock lock( guard_ );
+
+                    if ( auto it = std::find( mounts_.begin(), mounts_.end(), mp.lock() ); it != mounts_.end() )
+                    {
+                        mounts_.erase( it );
+                        return RetCode::Ok;
+                    }
+                    else
+                    {
+                        return RetCode::InvalidHandle;
+                    }
+                }
+                catch ( ... )
+                {
+                    return RetCode::UnknownError;
+                }
+            }
+
+
+            /** Opens a snapshot of the volume
+
+            Registry infrastructure only: the snapshot pins the last committed sequence of the volume's registry, but
+            the volume has no write path taking commit tickets or keeping versions (see snapshot_registry and
+            version_chain) yet, so the sequence never moves and the snapshot isolates nothing. Once writes go through
+            the registry, reads through the snapshot will see no commits made after it was taken. The snapshot must
+            not outlive the volume
+
+            @retval error code (RetCode::Overloaded if there are too many active snapshots)
+            @retval snapshot handle
+            @throw nothing
+            */
+            std::tuple< RetCode, snapshot_t > snapshot() noexcept
+            {
+                if ( auto s = snapshots_.open( std::hash< std::thread::id >{}( std::this_thread::get_id() ) ) )
+                {
+                    return { RetCode::Ok, std::move( s ) };
+                }
+                else
+                {
+                    return { RetCode::Overloaded, snapshot_t{} };
+                }
+            }
+
+
+            /** Opens merged cursor over all the keys starting with given logical path
+
+            Each mount point covering the logical path (either mounted under the path or mounted to one of the
+            path's prefixes) contributes an ordered stream of its physical keys; the streams are merged with
+            priority shadowing and deletion marks applied, see merged_cursor
+
+            @tparam SourceFactory - callable( const mount_point_t&, const key_t& physical_prefix ) returning
+                    an ordered source positioned onto the first physical key not less than the prefix
+            @param [in] logical_path - logical path to be listed
+            @param [in] factory - source factory
+            @retval error code
+            @retval positioned cursor
+            @throw nothing
+            */
+            template < typename SourceFactory >
+            auto list( const key_t& logical_path, SourceFactory&& factory ) const noexcept
+            {
+                using source_t = std::invoke_result_t< SourceFactory, const mount_point_t&, const key_t& >;
+                using cursor_t = merged_cursor< Policies, source_t >;
+
+                typename Policies::metrics::scope measure( operation::scan );
+
+                try
+                {
+                    cursor_t cursor;
+
+                    std::shared_lock lock( guard_ );
+
+                    for ( const auto& mp : mounts_ )
+                    {
+                        if ( starts_with( mp->logical_path(), logical_path ) )
+                        {
+                            // mount point lies under the logical path - the whole physical path to be listed
+                            cursor.add_lane( factory( *mp, mp->physical_path() ), mp->physical_path(), mp->physical_path(), mp->logical_path(), mp->priority() );
+                        }
+                        else if ( starts_with( logical_path, mp->logical_path() ) )
+                        {
+                            // mount point covers the logical path - list the corresponding physical subpath only
+                            key_t physical_prefix = mp->physical_path();
+                            physical_prefix.append( logical_path, mp->logical_path().size() );
+                            cursor.add_lane( factory( *mp, physical_prefix ), mp->physical_path(), physical_prefix, mp->logical_path(), mp->priority() );
+                        }
+                    }
+
+                    cursor.start();
+
+                    return std::tuple< RetCode, cursor_t >{ RetCode::Ok, std::move( cursor ) };
+                }
+                catch ( const details::runtime_error& e )
+                {
+                    return std::tuple< RetCode, cursor_t >{ e.error_code(), cursor_t{} };
+                }
+                catch ( const std::bad_alloc& )
+                {
+                    return std::tuple< RetCode, cursor_t >{ RetCode::InsufficientMemory, cursor_t{} };
+                }
+                catch ( ... )
+                {
+                    return std::tuple< RetCode, cursor_t >{ RetCode::UnknownError, cursor_t{} };
+                }
             }
         };
     }
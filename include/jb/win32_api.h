@@ -4,10 +4,15 @@
 
 #include "ret_codes.h"
 #include "exception.h"
-#include "rare_exclusive_frequent_shared_mutex.h"
+#include "access_mode.h"
+#include "coordination_region.h"
+#include "seqlock.h"
 #include <filesystem>
 #include <cstdio>
 #include <exception>
+#include <algorithm>
+#include <memory>
+#include <mutex>
 #include <windows.h>
 
 
@@ -15,6 +20,14 @@ namespace jb
 {
     namespace win32
     {
+        /** Provides storage file operations
+
+        In AccessMode::Exclusive the file is opened without sharing and guarded by a named mutex. Writer and reader
+        processes open it with sharing, so an exclusive opener fails while they are there and vice versa; the only
+        writer is guarded by its own named mutex. Named shared memory keeps coordination_region all of them map, so
+        the writer publishes commits to readers. Readers map the data read-only, i.e. all the processes share a
+        single copy of the data in the system cache
+        */
         class api
         {
             struct close_handle
@@ -32,6 +45,16 @@ namespace jb
 
             using safe_handle = std::unique_ptr < void, close_handle >;
 
+            /** Mapping object together with the file size it covers, a file of zero size has no mapping object
+            */
+            struct mapping
+            {
+                safe_handle handle_;
+                size_t size_ = 0;
+            };
+
+            using mapping_ptr = std::shared_ptr< const mapping >;
+
             static size_t get_page_size() noexcept
             {
                 SYSTEM_INFO info;
@@ -40,19 +63,26 @@ namespace jb
             }
 
             std::filesystem::path path_;
+            AccessMode mode_;
             bool newly_created_ = false;
             inline static const size_t page_size_ = get_page_size();
             safe_handle interprocess_lock_;
             safe_handle file_;
-            safe_handle mapping_;
-            details::rare_exclusive_frequent_shared_mutex<> resize_guard_;
-            size_t size_;
+            mapping_ptr mapping_;       // accessed through std::atomic_load/std::atomic_store
+            std::mutex resize_guard_;
+            details::seqlock< size_t > size_;
+            safe_handle region_mapping_;
+            std::unique_ptr< void, unmap_area > region_memory_;
+            details::coordination_region* region_ = nullptr;
 
             safe_handle get_interprocess_lock()
             {
-                // make-up unique mutex name of stack
-                std::array< char, 20 > mutex_name;
-                snprintf( mutex_name.data(), 20, "jb_%zx", std::filesystem::hash_value( path_ ) );
+                // readers are limited by file sharing only
+                if ( AccessMode::Reader == mode_ ) return safe_handle{};
+
+                // make-up unique mutex name of stack, the exclusive owner and the writer take different names
+                std::array< char, 24 > mutex_name;
+                snprintf( mutex_name.data(), mutex_name.size(), AccessMode::Writer == mode_ ? "jb_w_%zx" : "jb_%zx", std::filesystem::hash_value( path_ ) );
 
                 // try to create named mutex
                 safe_handle lock( ::CreateMutexA( NULL, FALSE, mutex_name.data() ), close_handle() );
@@ -72,13 +102,23 @@ namespace jb
 
             safe_handle open_file()
             {
-                safe_handle file( ::CreateFileW( path_.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL ), close_handle() );
-                if ( INVALID_HANDLE_VALUE == file_.get() )
+                auto read_only = AccessMode::Reader == mode_;
+                auto access = read_only ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE;
+                auto share = AccessMode::Exclusive == mode_ ? 0 : FILE_SHARE_READ | FILE_SHARE_WRITE;
+                auto disposition = read_only ? OPEN_EXISTING : OPEN_ALWAYS;
+
+                safe_handle file( ::CreateFileW( path_.c_str(), access, share, NULL, disposition, FILE_ATTRIBUTE_NORMAL, NULL ), close_handle() );
+                if ( INVALID_HANDLE_VALUE == file.get() )
                 {
+                    if ( ERROR_SHARING_VIOLATION == ::GetLastError() )
+                    {
+                        throw details::runtime_error( RetCode::AlreadyInUse, "The file is already in use" );
+                    }
+
                     throw details::runtime_error( RetCode::CannotOpenFile, "Unable to open/create storage file" );
                 }
 
-                if ( ERROR_ALREADY_EXISTS != ::GetLastError() )
+                if ( !read_only && ERROR_ALREADY_EXISTS != ::GetLastError() )
                 {
                     newly_created_ = true;
 
@@ -93,18 +133,86 @@ namespace jb
                 return file;
             }
 
-            safe_handle create_mapping()
+            /** Creates mapping object of the whole file
+
+            @param [in] size - file size, the file must not be shorter
+            @retval the mapping
+            @throw details::runtime_error, std::bad_alloc
+            */
+            mapping_ptr create_mapping( size_t size )
             {
                 assert( INVALID_HANDLE_VALUE != file_.get() );
 
+                auto result = std::make_shared< mapping >();
+
+                // there is nothing to map in empty file (CreateFileMapping fails on it)
+                if ( !size ) return result;
+
                 // create mapping object
-                safe_handle mapping{ ::CreateFileMappingW( file_.get(), NULL, PAGE_READWRITE, 0, 0, NULL ), close_handle() };
-                if ( !mapping )
+                auto protection = read_only() ? PAGE_READONLY : PAGE_READWRITE;
+                result->handle_ = safe_handle{ ::CreateFileMappingW( file_.get(), NULL, protection, 0, 0, NULL ), close_handle() };
+                if ( !result->handle_ )
                 {
                     throw details::runtime_error( RetCode::IoError, "Unable to create mapping object" );
                 }
 
-                return mapping;
+                result->size_ = size;
+                return result;
+            }
+
+
+            /** Provides mapping covering given range of the file
+
+            A reader process maps the file once and the writer process grows it later, so a reader recreates the
+            mapping as soon as it needs the grown part. The mapping is shared, a thread keeps using the one it has
+            taken while another thread replaces it
+
+            @param [in] end - end of the range
+            @retval the mapping, may be shorter than the range if the file is
+            @throw details::runtime_error, std::bad_alloc
+            */
+            mapping_ptr get_mapping( size_t end )
+            {
+                auto current = std::atomic_load( &mapping_ );
+                if ( end <= current->size_ || !read_only() ) return current;
+
+                std::unique_lock lock( resize_guard_ );
+
+                current = std::atomic_load( &mapping_ );
+                if ( end > current->size_ )
+                {
+                    if ( auto size = file_size(); size > current->size_ )
+                    {
+                        current = create_mapping( size );
+                        std::atomic_store( &mapping_, current );
+                    }
+                }
+
+                return current;
+            }
+
+            void map_region()
+            {
+                if ( AccessMode::Exclusive == mode_ ) return;
+
+                // named shared memory is zero-initialized and lives while anybody maps it
+                std::array< wchar_t, 40 > name;
+                swprintf( name.data(), name.size(), L"Local\\jb_shm_%zx", std::filesystem::hash_value( path_ ) );
+
+                auto size = details::coordination_region::size();
+                region_mapping_ = safe_handle{ ::CreateFileMappingW( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, static_cast< DWORD >( size ), name.data() ), close_handle() };
+                if ( !region_mapping_ )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to create coordination region" );
+                }
+
+                region_memory_.reset( ::MapViewOfFile( region_mapping_.get(), FILE_MAP_ALL_ACCESS, 0, 0, size ) );
+                if ( !region_memory_ )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to map coordination region into memory" );
+                }
+
+                region_ = details::coordination_region::attach( region_memory_.get() );
             }
 
         public:
@@ -112,12 +220,43 @@ namespace jb
             api() = delete;
             api( api&& ) = delete;
 
-            explicit api( std::filesystem::path&& path )
+            explicit api( std::filesystem::path&& path, AccessMode mode = AccessMode::Exclusive )
                 : path_( std::move( path ) )
+                , mode_( mode )
                 , interprocess_lock_( get_interprocess_lock() )
                 , file_( open_file() )
-                , mapping_( create_mapping() )
             {
+                mapping_ = create_mapping( file_size() );
+                size_.store( mapping_->size_ );
+                map_region();
+            }
+
+            AccessMode access_mode() const noexcept
+            {
+                return mode_;
+            }
+
+            bool read_only() const noexcept
+            {
+                return AccessMode::Reader == mode_;
+            }
+
+            /** Provides region coordinating writer and reader processes, nullptr in exclusive mode
+            */
+            details::coordination_region* coordination() const noexcept
+            {
+                return region_;
+            }
+
+            static uint64_t process_id() noexcept
+            {
+                return static_cast< uint64_t >( ::GetCurrentProcessId() );
+            }
+
+            static bool process_alive( uint64_t id ) noexcept
+            {
+                safe_handle process{ ::OpenProcess( SYNCHRONIZE, FALSE, static_cast< DWORD >( id ) ), close_handle() };
+                return process && WAIT_TIMEOUT == ::WaitForSingleObject( process.get(), 0 );
             }
 
             static size_t page_size() noexcept
@@ -130,7 +269,17 @@ namespace jb
                 return newly_created_;
             }
 
+            /** Provides file size
+
+            Only we change the size of the file we write, so the size is taken from seqlock, i.e. without a syscall
+            and without a store. A reader process asks the system, cuz the writer process grows the file
+            */
             size_t size() const
+            {
+                return read_only() ? file_size() : size_.load();
+            }
+
+            size_t file_size() const
             {
                 LARGE_INTEGER sz;
                 if ( !::GetFileSizeEx( file_.get(), &sz ) )
@@ -145,12 +294,16 @@ namespace jb
             {
                 assert( INVALID_HANDLE_VALUE != file_.get() );
 
-                details::rare_exclusive_frequent_shared_mutex<>::unique_lock lock( resize_guard_ );
+                if ( read_only() )
                 {
-                    if ( size_ == current_size )
-                    {
-                        mapping_ = std::move( safe_handle{} );
+                    throw details::runtime_error( RetCode::ReadOnly, "The file is opened for reading only" );
+                }
 
+                // growers serialize on the mutex, size readers never touch it
+                std::unique_lock lock( resize_guard_ );
+                {
+                    if ( auto size = size_.load(); size == current_size )
+                    {
                         LARGE_INTEGER inc;
                         inc.QuadPart = static_cast<LONGLONG>( page_size() );
                         if ( !::SetFilePointerEx( file_.get(), inc, NULL, FILE_END ) || !::SetEndOfFile( file_.get() ) )
@@ -158,8 +311,10 @@ namespace jb
                             throw details::runtime_error( RetCode::IoError, "Unable to resize file" );
                         }
 
-                        size_ += page_size();
-                        mapping_ = std::move( create_mapping() );
+                        // a thread that sees the new size must find the mapping covering it, so the mapping goes
+                        // first, threads still using the old one keep it alive
+                        std::atomic_store( &mapping_, create_mapping( size + page_size() ) );
+                        size_.store( size + page_size() );
 
                         return true;
                     }
@@ -172,20 +327,20 @@ namespace jb
 
             safe_mapped_area map_page( size_t offset )
             {
-                assert( mapping_ );
-
                 // check offset
                 if ( offset % page_size() )
                 {
                     throw std::logic_error( "Requested mapping offset conflicts with memory granuarity" );
                 }
-                else if ( offset + page_size() >= size() )
+
+                auto mapping = get_mapping( offset + page_size() );
+                if ( offset + page_size() > mapping->size_ )
                 {
                     throw std::logic_error( "Requested mapping offset exceeds file size" );
                 }
 
                 safe_mapped_area mapped_page{
-                    ::MapViewOfFile( mapping_.get(), FILE_MAP_WRITE, offset / ( 1ULL << 32 ), offset % ( 1ULL << 32 ), page_size() ),
+                    ::MapViewOfFile( mapping->handle_.get(), read_only() ? FILE_MAP_READ : FILE_MAP_WRITE, offset / ( 1ULL << 32 ), offset % ( 1ULL << 32 ), page_size() ),
                     unmap_area{} 
                 };
 
@@ -196,6 +351,127 @@ namespace jb
 
                 return mapped_page;
             }
+
+            void flush( size_t offset, size_t size )
+            {
+                assert( offset % page_size() == 0 );
+
+                // nothing to write back
+                if ( read_only() ) return;
+
+                auto mapping = get_mapping( offset + size );
+                assert( offset + size <= mapping->size_ );
+
+                safe_mapped_area view{
+                    ::MapViewOfFile( mapping->handle_.get(), FILE_MAP_WRITE, offset / ( 1ULL << 32 ), offset % ( 1ULL << 32 ), size ),
+                    unmap_area{}
+                };
+
+                if ( !view || !::FlushViewOfFile( view.get(), size ) )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to flush file range" );
+                }
+            }
+
+            void sync()
+            {
+                assert( INVALID_HANDLE_VALUE != file_.get() );
+
+                if ( read_only() ) return;
+
+                if ( !::FlushFileBuffers( file_.get() ) )
+                {
+                    throw details::runtime_error( RetCode::IoError, "Unable to flush storage file" );
+                }
+            }
+
+
+            /** Append-only file with explicit durability control, used as write-ahead log segment
+            */
+            class log_file
+            {
+                safe_handle file_;
+
+            public:
+
+                log_file() = delete;
+                log_file( log_file&& ) = delete;
+
+                explicit log_file( const std::filesystem::path& path )
+                    : file_( ::CreateFileW( path.c_str(), GENERIC_READ | FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL ), close_handle() )
+                {
+                    if ( INVALID_HANDLE_VALUE == file_.get() )
+                    {
+                        throw details::runtime_error( RetCode::CannotOpenFile, "Unable to open/create log file" );
+                    }
+                }
+
+                size_t size() const
+                {
+                    LARGE_INTEGER sz;
+                    if ( !::GetFileSizeEx( file_.get(), &sz ) )
+                    {
+                        throw details::runtime_error( RetCode::IoError, "Unable to get size of log file" );
+                    }
+
+                    return static_cast<size_t>( sz.QuadPart );
+                }
+
+                void append( const void* data, size_t size )
+                {
+                    auto p = static_cast< const char* >( data );
+
+                    while ( size )
+                    {
+                        DWORD written = 0;
+                        auto chunk = static_cast< DWORD >( std::min< size_t >( size, MAXDWORD ) );
+                        if ( !::WriteFile( file_.get(), p, chunk, &written, NULL ) )
+                        {
+                            throw details::runtime_error( RetCode::IoError, "Unable to write log file" );
+                        }
+
+                        p += written;
+                        size -= written;
+                    }
+                }
+
+                void sync()
+                {
+                    if ( !::FlushFileBuffers( file_.get() ) )
+                    {
+                        throw details::runtime_error( RetCode::IoError, "Unable to flush log file" );
+                    }
+                }
+
+                size_t read( size_t offset, void* buffer, size_t size ) const
+                {
+                    auto p = static_cast< char* >( buffer );
+                    size_t total = 0;
+
+                    while ( total < size )
+                    {
+                        OVERLAPPED overlapped{};
+                        overlapped.Offset = static_cast< DWORD >( ( offset + total ) % ( 1ULL << 32 ) );
+                        overlapped.OffsetHigh = static_cast< DWORD >( ( offset + total ) / ( 1ULL << 32 ) );
+
+                        DWORD got = 0;
+                        auto chunk = static_cast< DWORD >( std::min< size_t >( size - total, MAXDWORD ) );
+                        if ( !::ReadFile( file_.get(), p + total, chunk, &got, &overlapped ) )
+                        {
+                            if ( ERROR_HANDLE_EOF == ::GetLastError() ) break;
+                            throw details::runtime_error( RetCode::IoError, "Unable to read log file" );
+                        }
+                        else if ( !got )
+                        {
+                            break;
+                        }
+
+                        total += got;
+                    }
+
+                    return total;
+                }
+            };
         };
     }
 }
@@ -0,0 +1,397 @@
+#ifndef __JB__WRITE_AHEAD_LOG__H__
+#define __JB__WRITE_AHEAD_LOG__H__
+
+
+#include "ret_codes.h"
+#include "exception.h"
+#include <boost/crc.hpp>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <limits>
+#include <assert.h>
+
+
+namespace jb
+{
+    namespace details
+    {
+        /** Implements append-only write-ahead log of a physical volume with group commit
+
+        The log is a sequence of segment files named <volume path>.wal.<16 hex digits index>. Each record is
+        prefixed with a header holding log sequence number (LSN), payload size and CRC32 over all of that, so a
+        torn tail gets detected on recovery.
+
+        Concurrent commits are coalesced: the first committer not finding a flush in progress becomes the leader,
+        optionally waits up to Policies::wal_group_commit_window for followers to join (or until the batch grows to
+        Policies::wal_group_commit_size), then writes the whole batch and syncs it with a single fdatasync()
+        (FlushFileBuffers() on Windows). Followers just sleep until their LSN becomes durable. Records committed
+        while the leader is flushing form the next batch. Zero window gives the lowest latency, batching then
+        happens naturally under load only; greater window trades commit latency for fewer syncs.
+
+        Sealed segments get deleted by truncate() as soon as a checkpoint makes their records unnecessary
+
+        @tparam Policies - compile-time settings
+        */
+        template < typename Policies >
+        class write_ahead_log
+        {
+            using log_file = typename Policies::api::log_file;
+
+            struct record_header
+            {
+                uint64_t lsn_;
+                uint32_t size_;
+                uint32_t crc_;
+            };
+
+            struct segment
+            {
+                uint64_t index_;
+                uint64_t last_lsn_;
+            };
+
+            std::filesystem::path base_;
+            std::mutex guard_;
+            std::condition_variable cv_;
+            std::deque< segment > sealed_;
+            uint64_t index_ = 0;
+            std::unique_ptr< log_file > file_;
+            size_t file_size_ = 0;
+            std::vector< char > pending_;
+            std::vector< char > batch_;
+            uint64_t last_lsn_ = 0;
+            uint64_t durable_lsn_ = 0;
+            bool flushing_ = false;
+            bool failed_ = false;
+
+
+            /** Calculates record checksum
+
+            @param [in] lsn - record LSN
+            @param [in] size - payload size
+            @param [in] data - payload
+            @retval CRC32
+            @throw nothing
+            */
+            static uint32_t checksum( uint64_t lsn, uint32_t size, const void* data ) noexcept
+            {
+                boost::crc_32_type crc;
+                crc.process_bytes( &lsn, sizeof( lsn ) );
+                crc.process_bytes( &size, sizeof( size ) );
+                crc.process_bytes( data, size );
+                return crc.checksum();
+            }
+
+
+            /** Makes up path of segment file
+
+            @param [in] index - segment index
+            @retval segment path
+            @throw std::bad_alloc
+            */
+            std::filesystem::path segment_path( uint64_t index ) const
+            {
+                char suffix[ 18 ];
+                snprintf( suffix, sizeof( suffix ), ".%016llx", static_cast< unsigned long long >( index ) );
+
+                auto path = base_;
+                path += suffix;
+                return path;
+            }
+
+
+            /** Reads valid records of a segment
+
+            @param [in] index - segment index
+            @param [in] fn - callable( lsn, data, size ) invoked for each valid record
+            @retval size of valid part of the segment
+            @throw details::runtime_error
+            */
+            template < typename Fn >
+            size_t scan( uint64_t index, Fn&& fn ) const
+            {
+                log_file file( segment_path( index ) );
+                auto size = file.size();
+
+                std::vector< char > payload;
+                size_t offset = 0;
+
+                while ( offset + sizeof( record_header ) <= size )
+                {
+                    record_header header;
+                    if ( file.read( offset, &header, sizeof( header ) ) != sizeof( header ) ) break;
+                    if ( offset + sizeof( header ) + header.size_ > size ) break;
+
+                    payload.resize( header.size_ );
+                    if ( file.read( offset + sizeof( header ), payload.data(), header.size_ ) != header.size_ ) break;
+                    if ( checksum( header.lsn_, header.size_, payload.data() ) != header.crc_ ) break;
+
+                    fn( header.lsn_, static_cast< const void* >( payload.data() ), static_cast< size_t >( header.size_ ) );
+                    offset += sizeof( header ) + header.size_;
+                }
+
+                return offset;
+            }
+
+
+            /** Seals current segment and starts new one, must be called under the guard
+
+            @throw details::runtime_error
+            */
+            void seal()
+            {
+                auto file = std::make_unique< log_file >( segment_path( index_ + 1 ) );
+                sealed_.push_back( segment{ index_++, durable_lsn_ } );
+                file_ = std::move( file );
+                file_size_ = 0;
+            }
+
+
+            /** Flushes pending records as the batch leader
+
+            @param [in/out] lock - taken lock over the guard, gets temporary released for I/O
+            @throw details::runtime_error
+            */
+            void lead( std::unique_lock< std::mutex >& lock )
+            {
+                assert( !flushing_ );
+                flushing_ = true;
+
+                // let followers join the batch
+                if ( Policies::wal_group_commit_window.count() )
+                {
+                    cv_.wait_for( lock, Policies::wal_group_commit_window, [&] { return pending_.size() >= Policies::wal_group_commit_size; } );
+                }
+
+                batch_.swap( pending_ );
+                auto batch_lsn = last_lsn_;
+
+                lock.unlock();
+                try
+                {
+                    file_->append( batch_.data(), batch_.size() );
+                    file_->sync();
+                }
+                catch ( ... )
+                {
+                    lock.lock();
+                    failed_ = true;
+                    flushing_ = false;
+                    cv_.notify_all();
+                    throw;
+                }
+                lock.lock();
+
+                file_size_ += batch_.size();
+                batch_.clear();
+                durable_lsn_ = batch_lsn;
+                flushing_ = false;
+
+                // if new segment cannot be started keep appending to current one, next batch will retry
+                if ( file_size_ >= Policies::wal_segment_size ) try { seal(); } catch ( ... ) {}
+
+                cv_.notify_all();
+            }
+
+        public:
+
+            write_ahead_log() = delete;
+            write_ahead_log( write_ahead_log&& ) = delete;
+
+
+            /** Opens log of a physical volume
+
+            Restores LSN sequence from existing segments. A torn record at the end of the last segment is left as
+            is and the new segment gets started, so the garbage never gets followed by valid records
+
+            @param [in] volume_path - path to physical volume file
+            @throw details::runtime_error, std::bad_alloc
+            */
+            explicit write_ahead_log( const std::filesystem::path& volume_path ) try
+                : base_( std::filesystem::absolute( volume_path ) )
+            {
+                base_ += ".wal";
+
+                // collect existing segments
+                std::vector< uint64_t > indices;
+                auto prefix = base_.filename().string() + ".";
+                for ( auto& entry : std::filesystem::directory_iterator( base_.parent_path() ) )
+                {
+                    auto name = entry.path().filename().string();
+                    if ( name.size() == prefix.size() + 16 && !name.compare( 0, prefix.size(), prefix ) )
+                    {
+                        indices.push_back( std::stoull( name.substr( prefix.size() ), nullptr, 16 ) );
+                    }
+                }
+                std::sort( indices.begin(), indices.end() );
+
+                // restore LSN sequence
+                for ( auto index : indices )
+                {
+                    scan( index, [&]( uint64_t lsn, const void*, size_t ) { last_lsn_ = lsn; } );
+                    sealed_.push_back( segment{ index, last_lsn_ } );
+                    index_ = index;
+                }
+                durable_lsn_ = last_lsn_;
+
+                // start new segment
+                file_ = std::make_unique< log_file >( segment_path( ++index_ ) );
+                file_size_ = 0;
+            }
+            catch ( const std::filesystem::filesystem_error& )
+            {
+                throw runtime_error( RetCode::InvalidFilePath, "Invalid log path" );
+            }
+            catch ( const std::invalid_argument& )
+            {
+                throw runtime_error( RetCode::IoError, "Invalid log segment name" );
+            }
+
+
+            /** Provides the greatest LSN known to be durable
+
+            @throw nothing
+            */
+            uint64_t durable() noexcept
+            {
+                std::unique_lock lock( guard_ );
+                return durable_lsn_;
+            }
+
+
+            /** Appends a record and waits until it becomes durable
+
+            @param [in] data - record payload
+            @param [in] size - payload size
+            @retval LSN assigned to the record
+            @throw details::runtime_error if I/O failed (the log stays failed), std::bad_alloc
+            */
+            uint64_t commit( const void* data, size_t size )
+            {
+                assert( data || !size );
+
+                if ( size > std::numeric_limits< uint32_t >::max() )
+                {
+                    throw runtime_error( RetCode::UnknownError, "Log record is too large" );
+                }
+
+                std::unique_lock lock( guard_ );
+
+                if ( failed_ )
+                {
+                    throw runtime_error( RetCode::IoError, "Write-ahead log failed" );
+                }
+
+                // append the record to pending batch
+                record_header header{ ++last_lsn_, static_cast< uint32_t >( size ), 0 };
+                header.crc_ = checksum( header.lsn_, header.size_, data );
+
+                auto offset = pending_.size();
+                pending_.resize( offset + sizeof( header ) + size );
+                std::memcpy( pending_.data() + offset, &header, sizeof( header ) );
+                std::memcpy( pending_.data() + offset + sizeof( header ), data, size );
+
+                // wake up the leader waiting for the batch to grow
+                if ( pending_.size() >= Policies::wal_group_commit_size ) cv_.notify_all();
+
+                // wait until the record gets durable, lead the flush if nobody does
+                while ( durable_lsn_ < header.lsn_ )
+                {
+                    if ( failed_ )
+                    {
+                        throw runtime_error( RetCode::IoError, "Write-ahead log failed" );
+                    }
+                    else if ( !flushing_ )
+                    {
+                        lead( lock );
+                    }
+                    else
+                    {
+                        cv_.wait( lock );
+                    }
+                }
+
+                return header.lsn_;
+            }
+
+
+            /** Replays the log
+
+            Must be called before any commit
+
+            @param [in] from - records with LSN not greater than given one are skipped
+            @param [in] fn - callable( lsn, data, size ) invoked for each record
+            @throw details::runtime_error, std::bad_alloc, whatever fn throws
+            */
+            template < typename Fn >
+            void replay( uint64_t from, Fn&& fn )
+            {
+                std::unique_lock lock( guard_ );
+
+                for ( const auto& s : sealed_ )
+                {
+                    if ( s.last_lsn_ <= from ) continue;
+
+                    scan( s.index_, [&]( uint64_t lsn, const void* data, size_t size ) {
+                        if ( lsn > from ) fn( lsn, data, size );
+                    } );
+                }
+            }
+
+
+            /** Seals current segment, so all durable records get into sealed segments
+
+            Used by checkpoint: take LSN returned by rotate(), flush all the pages modified up to the moment, and
+            then truncate() the log up to the LSN
+
+            @retval the greatest LSN in sealed segments
+            @throw details::runtime_error, std::bad_alloc
+            */
+            uint64_t rotate()
+            {
+                std::unique_lock lock( guard_ );
+
+                cv_.wait( lock, [&] { return !flushing_; } );
+                if ( file_size_ ) seal();
+
+                // pending records, if any, need a new leader
+                cv_.notify_all();
+
+                return durable_lsn_;
+            }
+
+
+            /** Deletes sealed segments containing no records with LSN greater than given one
+
+            @param [in] lsn - the greatest LSN not needed for recovery anymore
+            @retval number of deleted segments
+            @throw std::bad_alloc
+            */
+            size_t truncate( uint64_t lsn )
+            {
+                std::unique_lock lock( guard_ );
+
+                size_t count = 0;
+                while ( !sealed_.empty() && sealed_.front().last_lsn_ <= lsn )
+                {
+                    std::error_code ec;
+                    std::filesystem::remove( segment_path( sealed_.front().index_ ), ec );
+                    sealed_.pop_front();
+                    ++count;
+                }
+
+                return count;
+            }
+        };
+    }
+}
+
+#endif
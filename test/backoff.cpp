@@ -0,0 +1,29 @@
+#include <gtest/gtest.h>
+#include <jb/backoff.h>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        TEST( backoff, stages )
+        {
+            details::backoff< 8, 2, 1 > backoff;
+
+            // pause 1, 2, 4, 8 times
+            for ( size_t i = 0; i < 4; ++i )
+            {
+                EXPECT_TRUE( backoff.spinning() );
+                backoff();
+            }
+            EXPECT_FALSE( backoff.spinning() );
+
+            // yield, then sleep
+            for ( size_t i = 0; i < 4; ++i ) backoff();
+            EXPECT_FALSE( backoff.spinning() );
+
+            backoff.reset();
+            EXPECT_TRUE( backoff.spinning() );
+        }
+    }
+}
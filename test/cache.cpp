@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+#include <jb/storage.h>
+#include <jb/storage_file.h>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        struct cache_test : public ::testing::Test
+        {
+            using storage_file = jb::details::storage_file< jb::default_policies >;
+
+            virtual void TearDown() override
+            {
+                std::filesystem::remove( "./foo.jb" );
+            }
+        };
+
+
+        TEST_F( cache_test, get_release_recycle )
+        {
+            storage_file f( "./foo.jb" );
+
+            auto p1 = f.get_page( 0 );
+            auto p2 = f.get_page( 0 );
+            ASSERT_TRUE( p1 );
+            EXPECT_EQ( p1, p2 );
+            EXPECT_EQ( 0, p1->offset() );
+
+            auto p3 = f.get_page( storage_file::page_size() );
+            EXPECT_NE( p1, p3 );
+            EXPECT_EQ( storage_file::page_size(), p3->offset() );
+
+            // released page gets recycled for another offset once a batch of retired pages got reclaimed
+            auto released = p3.get();
+            p3.reset();
+
+            storage_file::mapped_page_ptr p4;
+            for ( size_t offset = 2; offset < 1000 && p4.get() != released; ++offset )
+            {
+                p4 = f.get_page( offset * storage_file::page_size() );
+            }
+            ASSERT_EQ( released, p4.get() );
+            EXPECT_NE( storage_file::page_size(), p4->offset() );
+
+            // the page still referred is not recycled
+            EXPECT_EQ( p1, f.get_page( 0 ) );
+        }
+
+
+        TEST_F( cache_test, lock_unlock )
+        {
+            storage_file f( "./foo.jb" );
+
+            auto p1 = f.get_page( 0 );
+            EXPECT_EQ( nullptr, p1->data() );
+
+            p1->lock();
+            p1->lock();
+            ASSERT_NE( nullptr, p1->data() );
+            static_cast< char* >( p1->data() )[ 0 ] = 'x';
+            p1->unlock();
+            EXPECT_NE( nullptr, p1->data() );
+            p1->unlock();
+            EXPECT_EQ( nullptr, p1->data() );
+
+            p1->lock();
+            EXPECT_EQ( 'x', static_cast< char* >( p1->data() )[ 0 ] );
+            p1->unlock();
+        }
+
+
+        TEST_F( cache_test, churn )
+        {
+            storage_file f( "./foo.jb" );
+
+            static constexpr size_t page_count = 64;
+            static constexpr size_t iterations = 20000;
+
+            std::atomic< size_t > failures = 0;
+            std::vector< std::thread > threads;
+
+            for ( unsigned t = 0; t < 4; ++t )
+            {
+                threads.emplace_back( [&, t] {
+                    std::mt19937 rng( t );
+                    for ( size_t i = 0; i < iterations; ++i )
+                    {
+                        auto offset = ( rng() % page_count ) * storage_file::page_size();
+                        auto page = f.get_page( offset );
+
+                        // a page must never be seen recycled for another offset while it is referred
+                        if ( page->offset() != offset ) ++failures;
+                        std::this_thread::yield();
+                        if ( page->offset() != offset ) ++failures;
+                    }
+                } );
+            }
+
+            for ( auto& t : threads ) t.join();
+
+            EXPECT_EQ( 0, failures );
+        }
+
+
+        TEST_F( cache_test, numa_topology )
+        {
+            EXPECT_LE( 1, details::numa::node_count() );
+
+            // threads from any node look pages up in their own shard
+            std::vector< std::thread > threads;
+            for ( size_t i = 0; i < 4; ++i )
+            {
+                threads.emplace_back( [] { EXPECT_GT( details::numa::node_count(), details::numa::current_node() ); } );
+            }
+            for ( auto& t : threads ) t.join();
+        }
+
+
+        TEST_F( cache_test, thread_cache )
+        {
+            {
+                storage_file f( "./foo.jb" );
+
+                // a hit gives the page while somebody keeps it cached
+                auto holder = f.get_page( 0 );
+                auto page = f.get_cached_page( 0 ).get();
+                EXPECT_EQ( holder.get(), page );
+                EXPECT_EQ( page, f.get_cached_page( 0 ).get() );
+
+                // another page falling into the same entry replaces it
+                auto offset = jb::default_policies::thread_page_cache_size * storage_file::page_size();
+                auto another = f.get_cached_page( offset );
+                EXPECT_EQ( offset, another->offset() );
+                EXPECT_EQ( another.get(), f.get_cached_page( offset ).get() );
+
+                // a thread exits while the file is alive
+                std::thread( [&] { EXPECT_EQ( another.get(), f.get_cached_page( offset ).get() ); } ).join();
+            }
+
+            {
+                storage_file f( "./foo.jb" );
+
+                // the thread cache does not keep pages
+                f.get_cached_page( 0 ).get();
+                auto holder = f.get_page( 0 );
+                auto page = f.get_cached_page( 0 );
+                ASSERT_TRUE( page );
+                EXPECT_EQ( 0, page->offset() );
+                EXPECT_EQ( holder.get(), page.get() );
+
+                // the last reference gone, the page leaves the cache and the entry gets stale
+                holder.reset();
+                page = storage_file::cached_page();
+
+                page = f.get_cached_page( 0 );
+                ASSERT_TRUE( page );
+                EXPECT_EQ( 0, page->offset() );
+                EXPECT_EQ( page.get(), f.get_page( 0 ).get() );
+            }
+
+            // entries of the destroyed file get forgotten
+            storage_file f( "./foo.jb" );
+            auto page = f.get_cached_page( 0 );
+            ASSERT_TRUE( page );
+            EXPECT_EQ( 0, page->offset() );
+            EXPECT_EQ( page.get(), f.get_page( 0 ).get() );
+        }
+
+
+        TEST_F( cache_test, layout )
+        {
+            struct compact_policies : public default_policies
+            {
+                using layout = details::compact_layout;
+            };
+            using compact_file = details::storage_file< compact_policies >;
+
+            constexpr auto line = std::hardware_destructive_interference_size;
+            EXPECT_EQ( 3 * line, sizeof( storage_file::mapped_page_ptr::element_type ) );
+            EXPECT_EQ( line, sizeof( compact_file::mapped_page_ptr::element_type ) );
+
+            compact_file f( "./foo.jb" );
+
+            auto p1 = f.get_page( 0 );
+            auto p2 = f.get_page( compact_file::page_size() );
+            EXPECT_NE( p1, p2 );
+            EXPECT_EQ( p1, f.get_page( 0 ) );
+            EXPECT_EQ( 0, reinterpret_cast< uintptr_t >( p1.get() ) % line );
+            EXPECT_EQ( 0, reinterpret_cast< uintptr_t >( p2.get() ) % line );
+
+            p1->lock();
+            ASSERT_NE( nullptr, p1->data() );
+            static_cast< char* >( p1->data() )[ 0 ] = 'x';
+            p1->unlock();
+
+            p1->lock();
+            EXPECT_EQ( 'x', static_cast< char* >( p1->data() )[ 0 ] );
+            p1->unlock();
+        }
+    }
+}
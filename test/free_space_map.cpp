@@ -0,0 +1,240 @@
+#include <gtest/gtest.h>
+#include <jb/storage.h>
+#include <jb/storage_file.h>
+#include <algorithm>
+#include <future>
+#include <set>
+#include <vector>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        struct free_space_map_test : public ::testing::Test
+        {
+            using storage_file = jb::details::storage_file< jb::default_policies >;
+
+            static size_t page_size() noexcept { return storage_file::page_size(); }
+
+            virtual void TearDown() override
+            {
+                for ( auto& file : std::filesystem::directory_iterator( "." ) )
+                {
+                    auto path = file.path();
+                    if ( path.extension() == ".jb" )
+                    {
+                        std::filesystem::remove( file.path() );
+                    }
+                }
+            }
+        };
+
+
+        TEST_F( free_space_map_test, allocate_deallocate )
+        {
+            storage_file f( "./foo.jb" );
+
+            // single pages come from a run reserved for the thread
+            auto first = f.allocate();
+            EXPECT_LT( 0, first );
+            for ( size_t i = 1; i < default_policies::free_space_run; ++i )
+            {
+                EXPECT_EQ( first + i * page_size(), f.allocate() );
+            }
+
+            auto run = f.allocate( 4 );
+            EXPECT_LE( run + 4 * page_size(), f.size() );
+            EXPECT_NE( first, run );
+
+            // freed run is found again
+            f.deallocate( run, 4 );
+            EXPECT_EQ( run, f.allocate( 4 ) );
+
+            // as well as a hole the run fits into
+            f.deallocate( first + page_size(), 3 );
+            EXPECT_EQ( first + page_size(), f.allocate( 3 ) );
+
+            EXPECT_THROW( f.deallocate( f.size(), 1 ), std::logic_error );
+        }
+
+
+        TEST_F( free_space_map_test, reserved_pages )
+        {
+            storage_file f( "./foo.jb" );
+            auto first = f.allocate();
+
+            // neither the superblock nor the pages of the map can be returned, alone or as a part of a run
+            auto root = f.superblock().current().free_space_;
+            auto bitmap = static_cast< const uint64_t* >( f.map_page( root ).get() )[ 2 ];
+            EXPECT_NE( 0, bitmap );
+
+            EXPECT_THROW( f.deallocate( 0 ), std::logic_error );
+            EXPECT_THROW( f.deallocate( root ), std::logic_error );
+            EXPECT_THROW( f.deallocate( bitmap ), std::logic_error );
+            EXPECT_THROW( f.deallocate( 0, first / page_size() + 1 ), std::logic_error );
+
+            // so they are never given out
+            std::set< size_t > taken;
+            for ( size_t i = 0; i < 1000; ++i ) taken.insert( f.allocate() );
+            EXPECT_EQ( 0, taken.count( 0 ) );
+            EXPECT_EQ( 0, taken.count( root ) );
+            EXPECT_EQ( 0, taken.count( bitmap ) );
+
+            // the ordinary pages still can be returned
+            f.deallocate( first );
+        }
+
+
+        TEST_F( free_space_map_test, persistence )
+        {
+            std::vector< size_t > kept, freed;
+            {
+                storage_file f( "./foo.jb" );
+                for ( size_t i = 0; i < 8; ++i ) kept.push_back( f.allocate( 2 ) );
+                for ( size_t i = 0; i < 8; ++i ) freed.push_back( f.allocate( 2 ) );
+
+                // the rest of the run cached for the thread is returned on close
+                kept.push_back( f.allocate() );
+
+                for ( auto offset : freed ) f.deallocate( offset, 2 );
+            }
+            {
+                storage_file f( "./foo.jb" );
+                EXPECT_TRUE( f.clean_shutdown() );
+                EXPECT_NE( 0, f.superblock().current().free_space_ );
+
+                auto size = f.size();
+                std::set< size_t > taken;
+                for ( size_t i = 0; i < freed.size(); ++i ) taken.insert( f.allocate( 2 ) );
+
+                // the freed pages are reused without growing the file and the kept ones are not given out
+                EXPECT_EQ( size, f.size() );
+                for ( auto offset : kept ) EXPECT_EQ( 0, taken.count( offset ) );
+                for ( auto offset : freed ) EXPECT_EQ( 1, taken.count( offset ) );
+            }
+        }
+
+
+        TEST_F( free_space_map_test, unclean_shutdown )
+        {
+            std::vector< size_t > freed;
+            size_t root = 0;
+            {
+                storage_file f( "./foo.jb" );
+                for ( size_t i = 0; i < 8; ++i ) freed.push_back( f.allocate( 2 ) );
+                for ( auto offset : freed ) f.deallocate( offset, 2 );
+                root = f.superblock().current().free_space_;
+            }
+
+            // emulate a writer that crashed, its bitmaps may be stale
+            {
+                default_policies::api file( "./foo.jb" );
+                details::superblock< default_policies::api > sb( file );
+                sb.commit( []( auto& h ) { h.clean_ = 0; } );
+            }
+            {
+                storage_file f( "./foo.jb" );
+                EXPECT_FALSE( f.clean_shutdown() );
+
+                // the map is started over, the pages it had as free are taken as used and the file grows instead
+                auto size = f.size();
+                std::set< size_t > taken;
+                for ( size_t i = 0; i < freed.size(); ++i ) taken.insert( f.allocate( 2 ) );
+
+                EXPECT_LT( size, f.size() );
+                for ( auto offset : freed ) EXPECT_EQ( 0, taken.count( offset ) );
+                EXPECT_NE( root, f.superblock().current().free_space_ );
+            }
+            {
+                // a clean close makes the new map trusted again
+                storage_file f( "./foo.jb" );
+                EXPECT_TRUE( f.clean_shutdown() );
+            }
+        }
+
+
+        TEST_F( free_space_map_test, untracked_pages )
+        {
+            {
+                storage_file f( "./foo.jb" );
+                f.allocate( 2 );
+            }
+            {
+                storage_file f( "./foo.jb" );
+
+                // pages grown not through the map are taken as used
+                auto grown = f.size();
+                EXPECT_TRUE( f.grow( grown ) );
+
+                for ( size_t i = 0; i < 64; ++i ) EXPECT_NE( grown, f.allocate() );
+            }
+        }
+
+
+        TEST_F( free_space_map_test, many_groups )
+        {
+            storage_file f( "./foo.jb" );
+
+            // a run spanning bitmap groups stays contiguous
+            auto group = page_size() * 8;
+            auto run = f.allocate( group + 3 );
+            auto next = f.allocate( 2 );
+            EXPECT_TRUE( next + 2 * page_size() <= run || run + ( group + 3 ) * page_size() <= next );
+
+            f.deallocate( run, group + 3 );
+            EXPECT_EQ( run, f.allocate( group + 3 ) );
+        }
+
+
+        TEST_F( free_space_map_test, read_only )
+        {
+            {
+                storage_file f( "./foo.jb" );
+            }
+
+            storage_file f( "./foo.jb", AccessMode::Reader );
+            try
+            {
+                f.allocate();
+                FAIL();
+            }
+            catch ( const details::runtime_error& e )
+            {
+                EXPECT_EQ( RetCode::ReadOnly, e.error_code() );
+            }
+        }
+
+
+        TEST_F( free_space_map_test, multithreading )
+        {
+            static constexpr size_t thread_count = 4;
+            static constexpr size_t page_count = 1000;
+
+            storage_file f( "./foo.jb" );
+
+            auto worker = [&] {
+                std::vector< size_t > pages;
+                for ( size_t i = 0; i < page_count; ++i ) pages.push_back( i % 10 ? f.allocate() : f.allocate( 3 ) );
+
+                // return half of them, so the others reuse the holes
+                for ( size_t i = 0; i < page_count; i += 2 ) f.deallocate( pages[ i ], i % 10 ? 1 : 3 );
+                for ( size_t i = 0; i < page_count; i += 2 ) pages[ i ] = f.allocate();
+
+                return pages;
+            };
+
+            std::vector< std::future< std::vector< size_t > > > threads;
+            for ( size_t i = 0; i < thread_count; ++i ) threads.push_back( std::async( std::launch::async, worker ) );
+
+            std::set< size_t > taken;
+            for ( auto& thread : threads )
+            {
+                for ( auto page : thread.get() ) EXPECT_TRUE( taken.insert( page ).second );
+            }
+
+            EXPECT_EQ( thread_count * page_count, taken.size() );
+            EXPECT_EQ( 0, taken.count( 0 ) );
+        }
+    }
+}
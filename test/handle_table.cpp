@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <jb/handle_table.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        struct handle_table_test : public ::testing::Test
+        {
+            struct object
+            {
+                int value_;
+                std::atomic< int >& alive_;
+
+                object( int value, std::atomic< int >& alive ) : value_( value ), alive_( alive ) { ++alive_; }
+                ~object() { --alive_; }
+            };
+
+            using table_t = details::handle_table< object >;
+        };
+
+
+        TEST_F( handle_table_test, insert_resolve_erase )
+        {
+            std::atomic< int > alive = 0;
+            table_t table;
+
+            auto h1 = table.insert( std::make_shared< object >( 1, alive ) );
+            auto h2 = table.insert( std::make_shared< object >( 2, alive ) );
+            EXPECT_NE( 0, h1.id() );
+            EXPECT_NE( h1, h2 );
+            EXPECT_EQ( 1, h1.lock()->value_ );
+            EXPECT_EQ( 2, h2.lock()->value_ );
+            EXPECT_TRUE( details::handle< object >().expired() );
+
+            // erased object stays alive and reachable while in use
+            {
+                auto p = h1.lock();
+                EXPECT_TRUE( table.erase( h1 ) );
+                EXPECT_FALSE( table.erase( h1 ) );
+                EXPECT_FALSE( h1.expired() );
+                EXPECT_EQ( 1, h1.lock()->value_ );
+                EXPECT_EQ( 1, p->value_ );
+                EXPECT_EQ( 2, alive );
+            }
+            EXPECT_EQ( 1, alive );
+            EXPECT_TRUE( h1.expired() );
+
+            // the slot gets reused with another generation
+            auto h3 = table.insert( std::make_shared< object >( 3, alive ) );
+            EXPECT_EQ( h1.id() & 0xffffffff, h3.id() & 0xffffffff );
+            EXPECT_NE( h1.id(), h3.id() );
+            EXPECT_TRUE( h1.expired() );
+            EXPECT_EQ( 3, h3.lock()->value_ );
+
+            // shared ownership outlives the table entry and keeps the handle valid
+            auto shared = h2.lock().shared();
+            table.clear();
+            EXPECT_FALSE( h2.expired() );
+            EXPECT_TRUE( h3.expired() );
+            EXPECT_EQ( 1, alive );
+            shared.reset();
+            EXPECT_TRUE( h2.expired() );
+            EXPECT_EQ( 0, alive );
+        }
+
+
+        TEST_F( handle_table_test, concurrent_resolve )
+        {
+            std::atomic< int > alive = 0;
+            std::atomic< bool > stop = false;
+            table_t table;
+
+            std::vector< details::handle< object > > handles;
+            for ( int i = 0; i < 16; ++i ) handles.push_back( table.insert( std::make_shared< object >( i, alive ) ) );
+
+            std::vector< std::thread > readers;
+            for ( int t = 0; t < 4; ++t )
+            {
+                readers.emplace_back( [&] {
+                    while ( !stop )
+                    {
+                        for ( int i = 0; i < 16; ++i )
+                        {
+                            if ( auto p = handles[ i ].lock() )
+                            {
+                                EXPECT_EQ( i, p->value_ );
+                            }
+                        }
+                    }
+                } );
+            }
+
+            for ( int i = 0; i < 16; ++i ) EXPECT_TRUE( table.erase( handles[ i ] ) );
+
+            stop = true;
+            for ( auto& r : readers ) r.join();
+
+            // the last unpin reclaimed everything
+            table.insert( std::make_shared< object >( 0, alive ) );
+            EXPECT_EQ( 1, alive );
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+#include <jb/magazine_depot.h>
+#include <set>
+#include <thread>
+#include <vector>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        TEST( magazine_depot, allocate_free )
+        {
+            details::magazine_depot< int, 4, 1 > depot;
+            EXPECT_EQ( nullptr, depot.allocate() );
+
+            // overflow both magazines, so one goes to the depot
+            std::vector< int > items( 10 );
+            for ( auto& i : items ) depot.free( &i );
+
+            size_t count = 0;
+            depot.for_each( [&]( int* ) { ++count; } );
+            EXPECT_EQ( items.size(), count );
+
+            // LIFO order within the thread
+            EXPECT_EQ( &items.back(), depot.allocate() );
+
+            std::set< int* > taken{ &items.back() };
+            while ( auto p = depot.allocate() ) EXPECT_TRUE( taken.insert( p ).second );
+            EXPECT_EQ( items.size(), taken.size() );
+        }
+
+
+        TEST( magazine_depot, exchange_between_threads )
+        {
+            details::magazine_depot< int, 4 > depot;
+
+            std::vector< int > items( 64 );
+            std::thread( [&] { for ( auto& i : items ) depot.free( &i ); } ).join();
+
+            // a thread mapped to another slot gets full magazines from the depot
+            std::set< int* > taken;
+            std::thread( [&] { while ( auto p = depot.allocate() ) taken.insert( p ); } ).join();
+            EXPECT_LE( items.size() - 8, taken.size() );
+        }
+    }
+}
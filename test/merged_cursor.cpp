@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <jb/merged_cursor.h>
+#include <map>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        struct merged_cursor_test : public ::testing::Test
+        {
+            struct policies
+            {
+                using key_char_t = char;
+                using key_traits_t = std::char_traits< key_char_t >;
+            };
+
+            using key_t = std::string;
+
+            /** Ordered in-memory stream, an empty value stands for deletion mark
+            */
+            struct source
+            {
+                using container_t = std::map< key_t, key_t >;
+                
+                const container_t* keys_ = nullptr;
+                container_t::const_iterator it_;
+
+                source( const container_t& keys, const key_t& from ) : keys_( &keys ), it_( keys.lower_bound( from ) ) {}
+
+                bool valid() const noexcept { return it_ != keys_->end(); }
+                const key_t& key() const noexcept { return it_->first; }
+                bool deleted() const noexcept { return it_->second.empty(); }
+                const key_t& value() const noexcept { return it_->second; }
+                void next() noexcept { ++it_; }
+            };
+
+            using cursor_t = details::merged_cursor< policies, source >;
+
+            static std::vector< std::pair< key_t, key_t > > collect( cursor_t& cursor )
+            {
+                std::vector< std::pair< key_t, key_t > > result;
+                for ( cursor.start(); cursor.valid(); cursor.next() )
+                {
+                    result.emplace_back( cursor.key(), cursor.value() );
+                }
+                return result;
+            }
+        };
+
+
+        TEST_F( merged_cursor_test, empty )
+        {
+            cursor_t cursor;
+            cursor.start();
+            EXPECT_FALSE( cursor.valid() );
+
+            source::container_t keys;
+            cursor.add_lane( source( keys, "" ), "", "", "/", 0 );
+            cursor.start();
+            EXPECT_FALSE( cursor.valid() );
+        }
+
+
+        TEST_F( merged_cursor_test, translate )
+        {
+            source::container_t keys{ { "/a/0", "-" }, { "/p/1", "1" }, { "/p/2", "2" }, { "/q/3", "-" } };
+
+            cursor_t cursor;
+            cursor.add_lane( source( keys, "/p" ), "/p", "/p", "/x/y", 0 );
+
+            std::vector< std::pair< key_t, key_t > > expected{ { "/x/y/1", "1" }, { "/x/y/2", "2" } };
+            EXPECT_EQ( expected, collect( cursor ) );
+        }
+
+
+        TEST_F( merged_cursor_test, merge_and_shadow )
+        {
+            source::container_t low{ { "/a", "low-a" }, { "/c", "low-c" }, { "/e", "low-e" }, { "/g", "low-g" } };
+            source::container_t high{ { "/b", "high-b" }, { "/c", "high-c" }, { "/e", "" }, { "/f", "" } };
+            source::container_t mid{ { "/m/c", "mid-c" }, { "/m/d", "mid-d" }, { "/m/g", "mid-g" } };
+
+            cursor_t cursor;
+            cursor.add_lane( source( low, "" ), "", "", "", 1 );
+            cursor.add_lane( source( high, "" ), "", "", "", 3 );
+            cursor.add_lane( source( mid, "/m" ), "/m", "/m", "", 2 );
+
+            std::vector< std::pair< key_t, key_t > > expected{
+                { "/a", "low-a" },
+                { "/b", "high-b" },
+                { "/c", "high-c" },
+                { "/d", "mid-d" },
+                { "/g", "mid-g" }
+            };
+            EXPECT_EQ( expected, collect( cursor ) );
+        }
+
+
+        TEST_F( merged_cursor_test, equal_priority )
+        {
+            source::container_t first{ { "/a", "first" } };
+            source::container_t second{ { "/a", "second" }, { "/b", "second" } };
+
+            cursor_t cursor;
+            cursor.add_lane( source( first, "" ), "", "", "", 0 );
+            cursor.add_lane( source( second, "" ), "", "", "", 0 );
+
+            std::vector< std::pair< key_t, key_t > > expected{ { "/a", "first" }, { "/b", "second" } };
+            EXPECT_EQ( expected, collect( cursor ) );
+        }
+
+
+        TEST_F( merged_cursor_test, many_lanes )
+        {
+            constexpr size_t lane_count = 13;
+            constexpr size_t key_count = 1000;
+
+            std::vector< source::container_t > lanes( lane_count );
+            for ( size_t key = 0; key < key_count; ++key )
+            {
+                char buffer[ 16 ];
+                snprintf( buffer, sizeof( buffer ), "/%04zu", key );
+                lanes[ key % lane_count ].emplace( buffer, std::to_string( key ) );
+                lanes[ ( key * 7 ) % lane_count ].emplace( buffer, std::to_string( key ) );
+            }
+
+            cursor_t cursor;
+            for ( auto& keys : lanes )
+            {
+                cursor.add_lane( source( keys, "" ), "", "", "", 0 );
+            }
+
+            auto result = collect( cursor );
+            ASSERT_EQ( key_count, result.size() );
+            for ( size_t key = 0; key < key_count; ++key )
+            {
+                EXPECT_EQ( std::to_string( key ), result[ key ].second );
+            }
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <jb/storage.h>
+#include <jb/histogram.h>
+#include <jb/metrics.h>
+#include <thread>
+#include <vector>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        /** Each thread's clock ticks 100 times per reading, a tick lasts 2ns
+        */
+        struct fake_clock
+        {
+            static inline thread_local uint64_t now_ = 0;
+            static uint64_t now() noexcept { return now_ += 100; }
+            static double ns_per_tick() noexcept { return 2; }
+        };
+
+
+        TEST( metrics, histogram_precision )
+        {
+            using layout = details::histogram_layout<>;
+
+            for ( uint64_t value : { 0ull, 1ull, 31ull, 32ull, 33ull, 1000ull, 123456789ull, 1ull << 43 } )
+            {
+                auto bucket = layout::bucket( value );
+                EXPECT_LE( value, layout::highest( bucket ) );
+                EXPECT_LE( layout::highest( bucket ) - value, value / layout::sub_count );
+                if ( bucket )
+                {
+                    EXPECT_GT( value, layout::highest( bucket - 1 ) );
+                }
+            }
+
+            // values out of range fall into the last bucket
+            EXPECT_EQ( layout::bucket_count - 1, layout::bucket( ~0ull ) );
+        }
+
+
+        TEST( metrics, histogram_percentiles )
+        {
+            details::histogram<> h;
+            for ( uint64_t i = 1; i <= 10000; ++i ) h.record( i );
+
+            details::histogram_snapshot<> s;
+            h.merge_to( s );
+
+            EXPECT_EQ( 10000, s.count() );
+            EXPECT_EQ( 1, s.min() );
+            EXPECT_EQ( 10000, s.max() );
+            EXPECT_NEAR( 5000.5, s.mean(), 0.01 );
+            EXPECT_NEAR( 5000, s.percentile( 50 ), 5000 / 32 );
+            EXPECT_NEAR( 9900, s.percentile( 99 ), 9900 / 32 );
+            EXPECT_EQ( 10000, s.percentile( 100 ) );
+
+            details::histogram_snapshot<> twice;
+            twice += s;
+            twice += s;
+            EXPECT_EQ( 20000, twice.count() );
+            EXPECT_EQ( s.percentile( 50 ), twice.percentile( 50 ) );
+        }
+
+
+        TEST( metrics, merge_over_threads )
+        {
+            using metrics_t = details::latency_metrics< fake_clock >;
+
+            std::vector< std::thread > threads;
+            for ( size_t t = 0; t < 4; ++t )
+            {
+                threads.emplace_back( [] {
+                    for ( size_t i = 0; i < 1000; ++i ) metrics_t::scope measure( details::operation::scan );
+                } );
+            }
+
+            // the histograms of live and exited threads both count
+            metrics_t::scope measure( details::operation::scan );
+            for ( auto& t : threads ) t.join();
+
+            auto s = metrics_t::snapshot( details::operation::scan );
+            EXPECT_EQ( 4000, s.count() );
+            EXPECT_EQ( 200, s.min() );
+            EXPECT_EQ( 200, s.max() );
+            EXPECT_EQ( 0, metrics_t::snapshot( details::operation::mount ).count() );
+        }
+
+
+        TEST( metrics, storage_operations )
+        {
+            auto count = []( details::operation op ) { return storage<>::latency( op ).count(); };
+            auto opens = count( details::operation::open_physical_volume );
+            auto mounts = count( details::operation::mount );
+            auto unmounts = count( details::operation::unmount );
+
+            {
+                auto [ rc_1, virtual_volume ] = storage<>::open_virtual_volume();
+                ASSERT_EQ( RetCode::Ok, rc_1 );
+                auto [ rc_2, physical_volume ] = storage<>::open_physical_volume( "./foo.jb" );
+                ASSERT_EQ( RetCode::Ok, rc_2 );
+
+                auto [ rc_3, mp ] = virtual_volume.lock()->mount( physical_volume, "/", "/" );
+                ASSERT_EQ( RetCode::Ok, rc_3 );
+                EXPECT_EQ( RetCode::Ok, virtual_volume.lock()->unmount( mp ) );
+            }
+
+            storage<>::close_all();
+
+            EXPECT_EQ( opens + 1, count( details::operation::open_physical_volume ) );
+            EXPECT_EQ( mounts + 1, count( details::operation::mount ) );
+            EXPECT_EQ( unmounts + 1, count( details::operation::unmount ) );
+            EXPECT_LT( 0, storage<>::latency( details::operation::mount ).max() );
+        }
+    }
+}
@@ -30,7 +30,7 @@ namespace jb
             key_t physical_path = "/aaa/bbb/ccc";
             key_t logical_path = "/ddd/eee/fff";
             auto mp_1 = std::make_shared< private_construction >( 
-                physical_volume_handle.lock(), 
+                physical_volume_handle.lock().shared(), 
                 std::forward< key_t >( physical_path ), 
                 mount_point_ptr(), 
                 std::forward< key_t >( logical_path ) );
@@ -41,7 +41,7 @@ namespace jb
             EXPECT_TRUE( logical_path.empty() );
 
             // validate passed parameters
-            EXPECT_EQ( physical_volume_handle.lock(), mp_1->physical_volume() );
+            EXPECT_EQ( physical_volume_handle.lock().shared(), mp_1->physical_volume() );
             EXPECT_EQ( "/aaa/bbb/ccc", mp_1->physical_path() );
             EXPECT_EQ( mount_point_ptr(), mp_1->parent() );
             EXPECT_EQ( "/ddd/eee/fff", mp_1->logical_path() );
@@ -49,7 +49,7 @@ namespace jb
 
             // create 2nd mount pointer parented to the 1st
             auto mp_2 = std::make_shared< private_construction >(
-                physical_volume_handle.lock(),
+                physical_volume_handle.lock().shared(),
                 std::forward< key_t >( physical_path ),
                 mp_1,
                 std::forward< key_t >( logical_path ) );
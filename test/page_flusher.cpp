@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include <jb/dirty_page_map.h>
+#include <jb/page_flusher.h>
+#include <vector>
+#include <mutex>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        struct page_flusher_test : public ::testing::Test
+        {
+            struct policies
+            {
+                static constexpr size_t flush_rate = 1 << 30;
+                static constexpr std::chrono::milliseconds flush_interval{ 10 };
+                static constexpr size_t flush_max_run = 4;
+            };
+
+            struct target
+            {
+                std::mutex guard_;
+                std::vector< std::pair< size_t, size_t > > flushed_;
+                size_t syncs_ = 0;
+                bool read_only_ = false;
+
+                static size_t page_size() noexcept { return 0x1000; }
+                bool read_only() const noexcept { return read_only_; }
+
+                void flush( size_t offset, size_t size )
+                {
+                    std::unique_lock lock( guard_ );
+                    flushed_.emplace_back( offset, size );
+                }
+
+                void sync()
+                {
+                    std::unique_lock lock( guard_ );
+                    ++syncs_;
+                }
+
+                size_t flushed_bytes()
+                {
+                    std::unique_lock lock( guard_ );
+                    size_t total = 0;
+                    for ( auto& [ offset, size ] : flushed_ ) total += size;
+                    return total;
+                }
+            };
+
+            using runs_t = std::vector< std::pair< size_t, size_t > >;
+            using flusher_t = details::page_flusher< policies, target >;
+        };
+
+
+        TEST_F( page_flusher_test, collect_runs )
+        {
+            details::dirty_page_map dirty;
+            EXPECT_EQ( 0, dirty.count() );
+
+            for ( size_t page : { 1, 2, 3, 5, 63, 64, 65, 100, 101, 102, 103, 104, 105, 1 << 20 } )
+            {
+                dirty.mark( page );
+            }
+            dirty.mark( 2 );
+            EXPECT_EQ( 14, dirty.count() );
+
+            runs_t runs;
+            auto collected = dirty.collect( 4, dirty.capacity(), [&]( size_t first, size_t count ) { runs.emplace_back( first, count ); } );
+            EXPECT_EQ( 14, collected );
+            EXPECT_EQ( 0, dirty.count() );
+
+            runs_t expected{ { 1, 3 }, { 5, 1 }, { 63, 3 }, { 100, 4 }, { 104, 2 }, { 1 << 20, 1 } };
+            EXPECT_EQ( expected, runs );
+
+            // the map is clean now
+            runs.clear();
+            EXPECT_EQ( 0, dirty.collect( 4, dirty.capacity(), [&]( size_t first, size_t count ) { runs.emplace_back( first, count ); } ) );
+            EXPECT_TRUE( runs.empty() );
+
+            EXPECT_THROW( dirty.mark( dirty.capacity() ), std::logic_error );
+        }
+
+
+        TEST_F( page_flusher_test, collect_limit )
+        {
+            details::dirty_page_map dirty;
+            for ( size_t page = 0; page < 256; ++page ) dirty.mark( page );
+
+            size_t pages = 0;
+            auto collected = dirty.collect( 1000, 10, [&]( size_t, size_t count ) { pages += count; } );
+            EXPECT_EQ( 64, collected );
+            EXPECT_EQ( 64, pages );
+            EXPECT_EQ( 192, dirty.count() );
+        }
+
+
+        TEST_F( page_flusher_test, checkpoint )
+        {
+            details::dirty_page_map dirty;
+            target t;
+            {
+                flusher_t flusher( t, dirty );
+
+                dirty.mark( 7 );
+                dirty.mark( 8 );
+                dirty.mark( 10 );
+                flusher.checkpoint();
+
+                EXPECT_EQ( 0, dirty.count() );
+                EXPECT_EQ( 3 * target::page_size(), t.flushed_bytes() );
+                EXPECT_EQ( 1, t.syncs_ );
+            }
+        }
+
+
+        TEST_F( page_flusher_test, background )
+        {
+            details::dirty_page_map dirty;
+            target t;
+            {
+                flusher_t flusher( t, dirty );
+
+                for ( size_t page = 0; page < 100; ++page ) dirty.mark( page * 2 );
+
+                for ( size_t i = 0; i < 500 && t.flushed_bytes() < 100 * target::page_size(); ++i )
+                {
+                    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+                }
+
+                EXPECT_EQ( 100 * target::page_size(), t.flushed_bytes() );
+                EXPECT_EQ( 0, dirty.count() );
+            }
+            EXPECT_EQ( 0, t.syncs_ );
+        }
+
+
+        TEST_F( page_flusher_test, read_only )
+        {
+            details::dirty_page_map dirty;
+            target t;
+            t.read_only_ = true;
+            {
+                // no background thread, so the pages stay dirty until checkpoint
+                flusher_t flusher( t, dirty );
+
+                dirty.mark( 1 );
+                std::this_thread::sleep_for( 5 * policies::flush_interval );
+                EXPECT_EQ( 0, t.flushed_bytes() );
+                EXPECT_EQ( 1, dirty.count() );
+
+                flusher.checkpoint();
+                EXPECT_EQ( target::page_size(), t.flushed_bytes() );
+            }
+        }
+    }
+}
@@ -18,6 +18,12 @@ namespace jb
             EXPECT_EQ( RetCode::Ok, rc_2 );
             EXPECT_EQ( std::filesystem::absolute( "./boo.jb" ), physical_volume_handle_2.lock()->path() );
             EXPECT_EQ( 111, physical_volume_handle_2.lock()->priority() );
+            //
+            auto version = physical_volume_handle_2.lock()->version();
+            physical_volume_handle_2.lock()->set_priority( 222 );
+            EXPECT_EQ( 222, physical_volume_handle_2.lock()->priority() );
+            EXPECT_EQ( 222, physical_volume_handle_2.lock()->info().priority_ );
+            EXPECT_EQ( version + 1, physical_volume_handle_2.lock()->version() );
         }
     }
 }
\ No newline at end of file
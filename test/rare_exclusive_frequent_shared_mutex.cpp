@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include <jb/rare_exclusive_frequent_shared_mutex.h>
 #include <future>
+#include <vector>
 
 namespace jb
 {
@@ -194,5 +195,118 @@ namespace jb
             lock_6 = shared_lock{};
             EXPECT_FALSE( std::async( std::launch::async, check_shared_lock ).get() );
         }
+
+
+        TEST_F( rare_exclusive_frequent_shared_mutex_test, per_cpu )
+        {
+            using per_cpu_mutex = details::rare_exclusive_frequent_shared_mutex< 0 >;
+
+            EXPECT_EQ( std::max< size_t >( std::thread::hardware_concurrency(), 1 ), per_cpu_mutex::shared_lock_count() );
+
+            per_cpu_mutex mtx;
+            for ( size_t id = 0; id < per_cpu_mutex::shared_lock_count(); ++id )
+            {
+                EXPECT_TRUE( mtx.try_lock_shared( id ) );
+                mtx.unlock_shared( id );
+            }
+
+            auto check_shared_lock = [&]() noexcept {
+                if ( mtx.try_lock() )
+                {
+                    mtx.unlock();
+                    return false;
+                }
+                else
+                {
+                    return true;
+                }
+            };
+
+            {
+                per_cpu_mutex::shared_lock lock( mtx, 0 );
+                EXPECT_TRUE( std::async( std::launch::async, check_shared_lock ).get() );
+
+                lock.unlock();
+                EXPECT_FALSE( std::async( std::launch::async, check_shared_lock ).get() );
+
+                lock.lock();
+                EXPECT_TRUE( std::async( std::launch::async, check_shared_lock ).get() );
+            }
+            EXPECT_FALSE( std::async( std::launch::async, check_shared_lock ).get() );
+        }
+
+
+        TEST_F( rare_exclusive_frequent_shared_mutex_test, compact_layout )
+        {
+            using compact_mutex = details::rare_exclusive_frequent_shared_mutex< 31, details::backoff<>, details::null_tracer, details::compact_layout >;
+
+            // the atomics get packed into adjacent words
+            EXPECT_LT( sizeof( compact_mutex ), sizeof( shared_mutex ) );
+            EXPECT_EQ( 33 * details::compact_layout::group_alignment, sizeof( compact_mutex ) );
+
+            compact_mutex mtx;
+            std::atomic< size_t > value = 0;
+
+            auto worker = [&] {
+                for ( size_t i = 0; i < 1000; ++i )
+                {
+                    if ( i % 10 )
+                    {
+                        compact_mutex::shared_lock lock( mtx, std::this_thread::get_id() );
+                        EXPECT_EQ( 0, value.load( std::memory_order_relaxed ) % 2 );
+                    }
+                    else
+                    {
+                        std::unique_lock lock( mtx );
+                        value.fetch_add( 1, std::memory_order_relaxed );
+                        value.fetch_add( 1, std::memory_order_relaxed );
+                    }
+                }
+            };
+
+            std::vector< std::future< void > > threads;
+            for ( size_t i = 0; i < 4; ++i ) threads.push_back( std::async( std::launch::async, worker ) );
+            for ( auto& t : threads ) t.get();
+
+            EXPECT_EQ( 4 * 100 * 2, value.load() );
+        }
+
+
+        TEST_F( rare_exclusive_frequent_shared_mutex_test, writer_under_saturated_reads )
+        {
+            shared_mutex mtx;
+            std::atomic< bool > stop = false;
+            std::atomic< size_t > value = 0;
+
+            // readers keep the mutex shared-locked all the time
+            std::vector< std::future< void > > readers;
+            for ( size_t i = 0; i < 4; ++i )
+            {
+                readers.push_back( std::async( std::launch::async, [&] {
+                    while ( !stop.load( std::memory_order_acquire ) )
+                    {
+                        shared_lock lock( mtx, std::this_thread::get_id() );
+                        EXPECT_EQ( 0, value.load( std::memory_order_relaxed ) % 2 );
+                    }
+                } ) );
+            }
+
+            // writers must get through
+            auto writer = std::async( std::launch::async, [&] {
+                for ( size_t i = 0; i < 1000; ++i )
+                {
+                    unique_lock lock( mtx );
+                    value.fetch_add( 1, std::memory_order_relaxed );
+                    value.fetch_add( 1, std::memory_order_relaxed );
+                }
+            } );
+
+            EXPECT_EQ( std::future_status::ready, writer.wait_for( std::chrono::seconds( 30 ) ) );
+            stop.store( true, std::memory_order_release );
+
+            writer.get();
+            for ( auto& reader : readers ) reader.get();
+            EXPECT_EQ( 2000, value.load() );
+        }
     }
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+#include <jb/seqlock.h>
+#include <atomic>
+#include <future>
+#include <vector>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        TEST( seqlock, load_store_update )
+        {
+            struct value
+            {
+                int a_;
+                double b_;
+            };
+
+            details::seqlock< value > v( value{ 1, 2.0 } );
+            EXPECT_EQ( 1, v.load().a_ );
+            EXPECT_EQ( 2.0, v.load().b_ );
+            EXPECT_EQ( 0, v.version() );
+
+            v.store( value{ 3, 4.0 } );
+            EXPECT_EQ( 3, v.load().a_ );
+            EXPECT_EQ( 1, v.version() );
+
+            EXPECT_TRUE( v.update( []( value& x ) noexcept { x.a_ += 1; return true; } ) );
+            EXPECT_EQ( 4, v.load().a_ );
+            EXPECT_EQ( 4.0, v.load().b_ );
+            EXPECT_EQ( 2, v.version() );
+        }
+
+
+        TEST( seqlock, consistent_snapshots )
+        {
+            struct pair
+            {
+                size_t first_;
+                size_t second_;
+            };
+
+            details::seqlock< pair > v;
+            std::atomic< bool > stop = false;
+
+            // readers never see a torn value
+            std::vector< std::future< void > > readers;
+            for ( size_t i = 0; i < 3; ++i )
+            {
+                readers.push_back( std::async( std::launch::async, [&] {
+                    while ( !stop.load( std::memory_order_acquire ) )
+                    {
+                        auto p = v.load();
+                        ASSERT_EQ( p.first_, p.second_ );
+                    }
+                } ) );
+            }
+
+            // writers serialize
+            std::vector< std::future< void > > writers;
+            for ( size_t i = 0; i < 2; ++i )
+            {
+                writers.push_back( std::async( std::launch::async, [&] {
+                    for ( size_t j = 0; j < 10000; ++j )
+                    {
+                        v.update( []( pair& p ) noexcept { ++p.first_; ++p.second_; } );
+                    }
+                } ) );
+            }
+
+            for ( auto& w : writers ) w.get();
+            stop.store( true, std::memory_order_release );
+            for ( auto& r : readers ) r.get();
+
+            EXPECT_EQ( 20000, v.load().first_ );
+            EXPECT_EQ( 20000, v.version() );
+        }
+    }
+}
@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+#include <jb/storage.h>
+#include <jb/storage_file.h>
+#include <jb/shadow_pager.h>
+#include <filesystem>
+#include <cstring>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        struct shadow_pager_test : public ::testing::Test
+        {
+            using api = default_policies::api;
+            using storage_file = details::storage_file< default_policies >;
+            using shadow_pager = details::shadow_pager< storage_file >;
+
+            static constexpr const char* path_ = "foo.jb.shadow";
+
+            static std::string read( shadow_pager& pager, size_t page )
+            {
+                auto p = pager.read( page );
+                return p ? std::string( static_cast< const char* >( p.get() ) ) : std::string();
+            }
+
+            static void write( shadow_pager& pager, size_t page, const char* s )
+            {
+                auto p = pager.write( page );
+                std::strcpy( static_cast< char* >( p.get() ), s );
+            }
+
+            virtual void SetUp() override
+            {
+                std::filesystem::remove( path_ );
+            }
+
+            virtual void TearDown() override
+            {
+                std::filesystem::remove( path_ );
+            }
+        };
+
+
+        TEST_F( shadow_pager_test, commit )
+        {
+            {
+                storage_file file( path_ );
+                shadow_pager pager( file );
+                EXPECT_EQ( "", read( pager, 0 ) );
+
+                // the file marks itself not closed cleanly by the 1st commit
+                EXPECT_EQ( 1, pager.sequence() );
+
+                write( pager, 0, "foo" );
+                write( pager, 1000, "bar" );
+                EXPECT_EQ( "foo", read( pager, 0 ) );
+
+                // the free-space map commits its root on the first allocation
+                auto sequence = pager.sequence();
+                EXPECT_EQ( 2, sequence );
+
+                pager.commit();
+                EXPECT_EQ( sequence + 1, pager.sequence() );
+                EXPECT_EQ( 0, pager.recycle() );
+
+                write( pager, 0, "baz" );
+                pager.commit();
+                EXPECT_EQ( sequence + 2, pager.sequence() );
+
+                // old data page, old table page and old directory
+                EXPECT_EQ( 3, pager.recycle() );
+
+                // the page table shares the superblock with the other structures of the file
+                EXPECT_EQ( 0, file.superblock().current().clean_ );
+            }
+            {
+                storage_file file( path_ );
+                shadow_pager pager( file );
+                EXPECT_TRUE( file.clean_shutdown() );
+                EXPECT_EQ( "baz", read( pager, 0 ) );
+                EXPECT_EQ( "bar", read( pager, 1000 ) );
+                EXPECT_EQ( "", read( pager, 1 ) );
+            }
+        }
+
+
+        TEST_F( shadow_pager_test, uncommitted_batch_is_lost )
+        {
+            {
+                storage_file file( path_ );
+                shadow_pager pager( file );
+
+                write( pager, 5, "foo" );
+                pager.commit();
+
+                // crash in the middle of batch
+                write( pager, 5, "bar" );
+                write( pager, 6, "baz" );
+            }
+            {
+                storage_file file( path_ );
+                shadow_pager pager( file );
+                EXPECT_EQ( "foo", read( pager, 5 ) );
+                EXPECT_EQ( "", read( pager, 6 ) );
+            }
+        }
+
+
+        TEST_F( shadow_pager_test, rollback )
+        {
+            storage_file file( path_ );
+            shadow_pager pager( file );
+
+            write( pager, 1, "foo" );
+            pager.commit();
+
+            write( pager, 1, "bar" );
+            EXPECT_EQ( "bar", read( pager, 1 ) );
+
+            pager.rollback();
+            EXPECT_EQ( "foo", read( pager, 1 ) );
+            EXPECT_EQ( 1, pager.recycle() );
+
+            EXPECT_THROW( pager.write( shadow_pager::capacity() ), std::logic_error );
+        }
+
+
+        TEST_F( shadow_pager_test, recycle )
+        {
+            storage_file file( path_ );
+            shadow_pager pager( file );
+
+            write( pager, 0, "foo" );
+            pager.commit();
+
+            // superseded pages are reused, so rewriting a page does not grow the file
+            auto size = file.size();
+            for ( size_t i = 0; i < 100; ++i )
+            {
+                write( pager, 0, "bar" );
+                pager.commit();
+                EXPECT_EQ( 3, pager.recycle() );
+            }
+            EXPECT_EQ( size, file.size() );
+            EXPECT_EQ( "bar", read( pager, 0 ) );
+
+            // a recycled page comes zeroed to a page never written before
+            EXPECT_EQ( "", std::string( static_cast< const char* >( pager.write( 1 ).get() ) ) );
+        }
+
+
+        TEST_F( shadow_pager_test, torn_superblock )
+        {
+            {
+                storage_file file( path_ );
+                shadow_pager pager( file );
+
+                write( pager, 1, "foo" );
+                pager.commit();
+                write( pager, 1, "bar" );
+                pager.commit();
+            }
+            {
+                // damage the slot of the last commit, the 5th one marking the file closed cleanly
+                api file( path_ );
+                auto page = file.map_page( 0 );
+                static_cast< char* >( page.get() )[ 0 ] ^= 0xff;
+            }
+            {
+                storage_file file( path_ );
+                shadow_pager pager( file );
+                EXPECT_FALSE( file.clean_shutdown() );
+                EXPECT_EQ( 4, pager.sequence() );
+                EXPECT_EQ( "bar", read( pager, 1 ) );
+            }
+        }
+
+
+        TEST_F( shadow_pager_test, writer_and_readers )
+        {
+            {
+                storage_file writer_file( path_, AccessMode::Writer );
+                shadow_pager writer( writer_file );
+
+                // the only writer, no exclusive owner
+                EXPECT_THROW( ( api{ path_, AccessMode::Writer } ), details::runtime_error );
+                EXPECT_THROW( api{ path_ }, details::runtime_error );
+
+                write( writer, 0, "foo" );
+                writer.commit();
+                EXPECT_EQ( writer.sequence(), writer_file.coordination()->published() );
+
+                storage_file reader_file( path_, AccessMode::Reader );
+                shadow_pager reader( reader_file );
+                EXPECT_EQ( writer.sequence(), reader.sequence() );
+                EXPECT_EQ( "foo", read( reader, 0 ) );
+                EXPECT_THROW( reader.write( 0 ), details::runtime_error );
+
+                // the reader still could read superseded pages
+                write( writer, 0, "bar" );
+                writer.commit();
+                EXPECT_EQ( "foo", read( reader, 0 ) );
+                EXPECT_EQ( 0, writer.recycle() );
+
+                // the reader moves to the last commit and lets the pages go
+                reader.refresh();
+                EXPECT_EQ( writer.sequence(), reader.sequence() );
+                EXPECT_EQ( "bar", read( reader, 0 ) );
+                EXPECT_EQ( 3, writer.recycle() );
+            }
+
+            std::filesystem::remove( std::string( path_ ) + ".shm" );
+        }
+    }
+}
@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include <jb/snapshot.h>
+#include <jb/version_chain.h>
+#include <future>
+#include <stdexcept>
+#include <string>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        struct snapshot_test : public ::testing::Test
+        {
+            using registry_t = details::snapshot_registry< 4 >;
+            using snapshot_t = typename registry_t::snapshot;
+            using chain_t = details::version_chain< std::string >;
+        };
+
+
+        TEST_F( snapshot_test, open_release )
+        {
+            registry_t registry;
+
+            std::vector< snapshot_t > snapshots;
+            for ( size_t i = 0; i < 4; ++i )
+            {
+                auto s = registry.open( 0 );
+                ASSERT_TRUE( s );
+                EXPECT_EQ( registry.committed(), s.sequence() );
+                snapshots.push_back( std::move( s ) );
+            }
+
+            // all slots are busy
+            EXPECT_FALSE( registry.open( 0 ) );
+
+            snapshots[ 2 ].release();
+            EXPECT_TRUE( registry.open( 0 ) );
+        }
+
+
+        TEST_F( snapshot_test, oldest )
+        {
+            registry_t registry;
+            auto initial = registry.committed();
+
+            auto s1 = registry.open( 0 );
+            ASSERT_TRUE( s1 );
+
+            auto commit = registry.begin_commit();
+            auto seq = commit.sequence();
+            commit.publish();
+            EXPECT_FALSE( commit );
+            EXPECT_EQ( seq, registry.committed() );
+            EXPECT_EQ( initial, registry.oldest() );
+
+            auto s2 = registry.open( 0 );
+            ASSERT_TRUE( s2 );
+            EXPECT_EQ( seq, s2.sequence() );
+
+            s1 = snapshot_t{};
+            EXPECT_EQ( seq, registry.oldest() );
+
+            s2.release();
+            EXPECT_EQ( registry.committed(), registry.oldest() );
+        }
+
+
+        TEST_F( snapshot_test, ordered_publication )
+        {
+            registry_t registry;
+
+            auto commit_1 = registry.begin_commit();
+            auto commit_2 = registry.begin_commit();
+            auto seq_1 = commit_1.sequence();
+            auto seq_2 = commit_2.sequence();
+            ASSERT_LT( seq_1, seq_2 );
+
+            // the 2nd commit cannot be published until the 1st one is
+            auto f = std::async( std::launch::async, [&]() noexcept { commit_2.publish(); } );
+            EXPECT_EQ( std::future_status::timeout, f.wait_for( std::chrono::milliseconds( 50 ) ) );
+            EXPECT_EQ( seq_1 - 1, registry.committed() );
+
+            commit_1.publish();
+            f.get();
+            EXPECT_EQ( seq_2, registry.committed() );
+        }
+
+
+        TEST_F( snapshot_test, abandoned_commit )
+        {
+            registry_t registry;
+
+            // a dropped ticket gets published, so the following commits do not stall
+            auto seq = [&] { auto commit = registry.begin_commit(); return commit.sequence(); }();
+            EXPECT_EQ( seq, registry.committed() );
+
+            try
+            {
+                auto commit = registry.begin_commit();
+                throw std::runtime_error( "failed commit" );
+            }
+            catch ( const std::runtime_error& )
+            {
+            }
+
+            auto commit = registry.begin_commit();
+            auto moved = std::move( commit );
+            EXPECT_FALSE( commit );
+            moved.publish();
+            EXPECT_EQ( seq + 2, registry.committed() );
+        }
+
+
+        TEST_F( snapshot_test, version_chain )
+        {
+            chain_t chain;
+            EXPECT_EQ( nullptr, chain.get( 100 ) );
+
+            chain.put( 10, "a" );
+            chain.put( 20, "b" );
+            chain.erase( 30 );
+            chain.put( 40, "c" );
+
+            EXPECT_EQ( nullptr, chain.get( 9 ) );
+            EXPECT_EQ( "a", *chain.get( 10 ) );
+            EXPECT_EQ( "a", *chain.get( 19 ) );
+            EXPECT_EQ( "b", *chain.get( 25 ) );
+            EXPECT_EQ( nullptr, chain.get( 35 ) );
+            EXPECT_EQ( "c", *chain.get( 45 ) );
+
+            // versions older than the one visible from sequence 25 are unreachable
+            EXPECT_EQ( 1, chain.collect( 25 ) );
+            EXPECT_EQ( "b", *chain.get( 25 ) );
+            EXPECT_EQ( "c", *chain.get( 40 ) );
+            EXPECT_FALSE( chain.dead( 25 ) );
+
+            EXPECT_EQ( 2, chain.collect( 45 ) );
+            EXPECT_EQ( "c", *chain.get( 45 ) );
+
+            chain.erase( 50 );
+            EXPECT_FALSE( chain.dead( 45 ) );
+            EXPECT_TRUE( chain.dead( 50 ) );
+        }
+
+
+        TEST_F( snapshot_test, long_read_does_not_block_writer )
+        {
+            registry_t registry;
+            chain_t chain;
+
+            {
+                auto commit = registry.begin_commit();
+                chain.put( commit.sequence(), "0" );
+            }
+
+            auto reader = registry.open( 0 );
+            ASSERT_TRUE( reader );
+
+            for ( size_t i = 1; i <= 1000; ++i )
+            {
+                {
+                    auto commit = registry.begin_commit();
+                    chain.put( commit.sequence(), std::to_string( i ) );
+                }
+                chain.collect( registry.oldest() );
+            }
+
+            // reader still sees its version while the writer made progress
+            EXPECT_EQ( "0", *chain.get( reader.sequence() ) );
+            EXPECT_EQ( "1000", *chain.get( registry.committed() ) );
+
+            reader.release();
+            EXPECT_EQ( 1000, chain.collect( registry.oldest() ) );
+        }
+    }
+}
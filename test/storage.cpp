@@ -17,6 +17,8 @@ namespace jb {
 
             // lock the volume for using
             auto virtual_volume = virtual_volume_handle.lock();
+            auto copy = virtual_volume_handle;
+            EXPECT_EQ( virtual_volume.get(), copy.lock().get() );
 
             // close volume
             EXPECT_EQ( RetCode::Ok, s.close( virtual_volume_handle ) );
@@ -24,10 +26,21 @@ namespace jb {
 
             // check that in-use volume still alive
             EXPECT_FALSE( virtual_volume_handle.expired() );
+            EXPECT_FALSE( copy.expired() );
+            EXPECT_NO_THROW( virtual_volume->snapshot() );
 
             // release volume and check that it dies
             virtual_volume.reset();
             EXPECT_TRUE( virtual_volume_handle.expired() );
+            EXPECT_TRUE( copy.expired() );
+
+            // reopened volume gets another handle
+            auto [rc_2, another_handle] = s.open_virtual_volume();
+            EXPECT_EQ( RetCode::Ok, rc_2 );
+            EXPECT_NE( virtual_volume_handle, another_handle );
+            EXPECT_TRUE( virtual_volume_handle.expired() );
+            EXPECT_FALSE( another_handle.expired() );
+            EXPECT_EQ( RetCode::Ok, s.close( another_handle ) );
         }
 
         TEST( storage, physical_volume_open_close )
@@ -55,8 +68,14 @@ namespace jb {
             EXPECT_EQ( RetCode::Ok, s.close( physical_volume_handle_2 ) );
             EXPECT_EQ( RetCode::InvalidHandle, s.close( physical_volume_handle_2 ) );
             EXPECT_FALSE( physical_volume_handle_2.expired() );
+            EXPECT_EQ( 1, physical_volume_2->priority() );
             physical_volume_2.reset();
             EXPECT_TRUE( physical_volume_handle_2.expired() );
+
+            // the same path can be opened again
+            auto [rc3, physical_volume_handle_3] = s.open_physical_volume( "./boo.jb", 1 );
+            EXPECT_EQ( RetCode::Ok, rc3 );
+            EXPECT_EQ( RetCode::Ok, s.close( physical_volume_handle_3 ) );
         }
 
         TEST( storage, close_all )
@@ -85,6 +104,7 @@ namespace jb {
             EXPECT_FALSE( physical_volume_handle_1.expired() );
 
             // release the volume
+            EXPECT_EQ( 0, physical_volume_1->priority() );
             physical_volume_1.reset();
             EXPECT_TRUE( physical_volume_handle_1.expired() );
         }
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include <jb/storage.h>
 #include <jb/storage_file.h>
+#include <boost/crc.hpp>
+#include <cstring>
 #include <future>
 
 
@@ -193,5 +195,89 @@ namespace jb
                 }
             }
         }
+
+
+        TEST_F( storage_file_test, superblock )
+        {
+            auto page_size = storage_file::page_size();
+
+            {
+                storage_file f( "./foo.jb" );
+                EXPECT_TRUE( f.clean_shutdown() );
+
+                // the writer keeps the file marked as not closed cleanly
+                auto h = f.superblock().current();
+                EXPECT_EQ( 1, h.sequence_ );
+                EXPECT_EQ( 0, h.clean_ );
+
+                f.superblock().commit( [&]( auto& h ) {
+                    h.free_space_ = 3 * page_size;
+                    h.roots_[ 0 ] = 4 * page_size;
+                } );
+            }
+            {
+                storage_file f( "./foo.jb" );
+                EXPECT_TRUE( f.clean_shutdown() );
+                EXPECT_EQ( 3 * page_size, f.superblock().current().free_space_ );
+                EXPECT_EQ( 4 * page_size, f.superblock().current().roots_[ 0 ] );
+            }
+
+            // emulate a writer that crashed
+            {
+                default_policies::api file( "./foo.jb" );
+                details::superblock< default_policies::api > sb( file );
+                EXPECT_EQ( 1, sb.current().clean_ );
+
+                sb.commit( []( auto& h ) { h.clean_ = 0; } );
+            }
+            {
+                storage_file f( "./foo.jb" );
+                EXPECT_FALSE( f.clean_shutdown() );
+                EXPECT_EQ( 4 * page_size, f.superblock().current().roots_[ 0 ] );
+            }
+            {
+                storage_file f( "./foo.jb" );
+                EXPECT_TRUE( f.clean_shutdown() );
+            }
+        }
+
+
+        TEST_F( storage_file_test, superblock_format )
+        {
+            using api = default_policies::api;
+            using header = details::superblock< api >::header;
+
+            static constexpr uint64_t magic = 0x4b434f4c4250424aULL;
+            auto page_size = storage_file::page_size();
+
+            // a file of newer format is refused
+            {
+                struct
+                {
+                    uint64_t magic_;
+                    uint32_t version_, page_size_;
+                    header header_;
+                    uint32_t crc_;
+                } s{ magic, details::superblock< api >::version + 1, static_cast< uint32_t >( page_size ), header{}, 0 };
+                s.header_.sequence_ = 1;
+
+                boost::crc_32_type crc;
+                crc.process_bytes( &s, offsetof( decltype( s ), crc_ ) );
+                s.crc_ = crc.checksum();
+
+                api file( "./foo.jb" );
+                auto page = file.map_page( 0 );
+                std::memcpy( page.get(), &s, sizeof( s ) );
+            }
+            try
+            {
+                storage_file f( "./foo.jb" );
+                FAIL();
+            }
+            catch ( const details::runtime_error& e )
+            {
+                EXPECT_EQ( RetCode::IncompatibleFile, e.error_code() );
+            }
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <jb/storage.h>
+#include <jb/storage_file.h>
+#include <jb/tracer.h>
+#include <jb/rare_exclusive_frequent_shared_mutex.h>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <thread>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        struct tracer_test : public ::testing::Test
+        {
+            using tracer_t = details::ring_tracer< 1024 >;
+
+            struct policies : public default_policies
+            {
+                using tracer = tracer_t;
+            };
+
+            using storage_file = details::storage_file< policies >;
+
+            static std::string read( const char* path )
+            {
+                std::ifstream in( path );
+                std::stringstream content;
+                content << in.rdbuf();
+                return content.str();
+            }
+
+            virtual void SetUp() override
+            {
+                tracer_t::clear();
+            }
+
+            virtual void TearDown() override
+            {
+                std::filesystem::remove( "./foo.jb" );
+                std::filesystem::remove( "./foo.json" );
+            }
+        };
+
+
+        TEST_F( tracer_test, null_tracer_is_empty )
+        {
+            EXPECT_TRUE( std::is_empty_v< details::null_tracer::scope > );
+            EXPECT_TRUE( std::is_trivially_destructible_v< details::null_tracer::scope > );
+        }
+
+
+        TEST_F( tracer_test, storage_events )
+        {
+            {
+                storage_file f( "./foo.jb" );
+                f.grow( f.size() );
+
+                auto page = f.get_page( storage_file::page_size() );
+                page->lock();
+                page->unlock();
+            }
+
+            EXPECT_LT( 0, tracer_t::dump( "./foo.json" ) );
+
+            auto trace = read( "./foo.json" );
+            EXPECT_EQ( 0, trace.find( "{\"traceEvents\":[" ) );
+            EXPECT_NE( std::string::npos, trace.find( "\"name\":\"grow\"" ) );
+            EXPECT_NE( std::string::npos, trace.find( "\"name\":\"cache_miss\"" ) );
+            EXPECT_NE( std::string::npos, trace.find( "\"name\":\"page_lock\"" ) );
+            EXPECT_NE( std::string::npos, trace.find( "\"name\":\"map_page\"" ) );
+            EXPECT_NE( std::string::npos, trace.find( "\"ph\":\"X\"" ) );
+        }
+
+
+        TEST_F( tracer_test, lock_wait )
+        {
+            using mutex_t = details::rare_exclusive_frequent_shared_mutex< 31, details::backoff<>, tracer_t >;
+            mutex_t mtx;
+
+            {
+                mutex_t::unique_lock lock( mtx );
+
+                auto reader = std::async( std::launch::async, [&] {
+                    mutex_t::shared_lock lock( mtx, std::this_thread::get_id() );
+                } );
+
+                std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+                lock.unlock();
+                reader.get();
+            }
+
+            tracer_t::instant( details::trace_event::map_page, 42 );
+
+            EXPECT_EQ( 2, tracer_t::dump( "./foo.json" ) );
+
+            auto trace = read( "./foo.json" );
+            EXPECT_NE( std::string::npos, trace.find( "\"name\":\"shared_lock_wait\"" ) );
+            EXPECT_NE( std::string::npos, trace.find( "\"ph\":\"i\"" ) );
+            EXPECT_NE( std::string::npos, trace.find( "\"arg\":42" ) );
+        }
+
+
+        TEST_F( tracer_test, ring_overwrite )
+        {
+            for ( size_t i = 0; i < 3000; ++i ) tracer_t::instant( details::trace_event::grow, i );
+
+            EXPECT_EQ( 1024, tracer_t::dump( "./foo.json" ) );
+
+            auto trace = read( "./foo.json" );
+            EXPECT_EQ( std::string::npos, trace.find( "\"arg\":1975}" ) );
+            EXPECT_NE( std::string::npos, trace.find( "\"arg\":1976}" ) );
+            EXPECT_NE( std::string::npos, trace.find( "\"arg\":2999}" ) );
+        }
+    }
+}
@@ -1,11 +1,144 @@
-
-
 #include <gtest/gtest.h>
 #include <jb/storage.h>
+#include <map>
 
 namespace jb
 {
     namespace regression
     {
+        struct virtual_volume_test : public ::testing::Test
+        {
+            using key_t = typename storage<>::key_t;
+            using mount_point_t = typename storage<>::mount_point_t;
+            using physical_volume_t = typename storage<>::physical_volume_t;
+            using content_t = std::map< key_t, key_t >;
+
+            /** Ordered in-memory stream emulating content of a physical volume, empty value means deletion mark
+            */
+            struct source
+            {
+                const content_t* content_ = nullptr;
+                content_t::const_iterator it_;
+
+                source( const content_t& content, const key_t& from ) : content_( &content ), it_( content.lower_bound( from ) ) {}
+
+                bool valid() const noexcept { return it_ != content_->end(); }
+                const key_t& key() const noexcept { return it_->first; }
+                bool deleted() const noexcept { return it_->second.empty(); }
+                const key_t& value() const noexcept { return it_->second; }
+                void next() noexcept { ++it_; }
+            };
+
+            virtual void TearDown() override
+            {
+                storage<>::close_all();
+            }
+        };
+
+
+        TEST_F( virtual_volume_test, mount_unmount )
+        {
+            storage<> s;
+
+            auto [rc_1, virtual_volume_handle] = s.open_virtual_volume();
+            ASSERT_EQ( RetCode::Ok, rc_1 );
+            auto [rc_2, physical_volume_handle] = s.open_physical_volume( "./foo.jb" );
+            ASSERT_EQ( RetCode::Ok, rc_2 );
+
+            auto virtual_volume = virtual_volume_handle.lock();
+
+            auto [rc_3, mp_1] = virtual_volume->mount( physical_volume_handle, "/a", "/x" );
+            ASSERT_EQ( RetCode::Ok, rc_3 );
+            EXPECT_EQ( nullptr, mp_1.lock()->parent() );
+
+            auto [rc_4, mp_2] = virtual_volume->mount( physical_volume_handle, "/b", "/x/y" );
+            ASSERT_EQ( RetCode::Ok, rc_4 );
+            EXPECT_EQ( mp_1.lock(), mp_2.lock()->parent() );
+
+            EXPECT_EQ( RetCode::Ok, virtual_volume->unmount( mp_2 ) );
+            EXPECT_EQ( RetCode::InvalidHandle, virtual_volume->unmount( mp_2 ) );
+            EXPECT_EQ( RetCode::Ok, virtual_volume->unmount( mp_1 ) );
+
+            auto [rc_5, mp_3] = virtual_volume->mount( details::handle< physical_volume_t >(), "/a", "/x" );
+            EXPECT_EQ( RetCode::InvalidHandle, rc_5 );
+        }
+
+
+        TEST_F( virtual_volume_test, list )
+        {
+            storage<> s;
+
+            auto [rc_1, virtual_volume_handle] = s.open_virtual_volume();
+            ASSERT_EQ( RetCode::Ok, rc_1 );
+            auto [rc_2, low_handle] = s.open_physical_volume( "./foo.jb", 1 );
+            ASSERT_EQ( RetCode::Ok, rc_2 );
+            auto [rc_3, high_handle] = s.open_physical_volume( "./boo.jb", 2 );
+            ASSERT_EQ( RetCode::Ok, rc_3 );
+
+            std::map< const physical_volume_t*, content_t > contents;
+            contents[ low_handle.lock().get() ] = { { "/a/1", "low-1" }, { "/a/2", "low-2" }, { "/a/3", "low-3" }, { "/b/1", "-" } };
+            contents[ high_handle.lock().get() ] = { { "/c/2", "high-2" }, { "/c/3", "" }, { "/c/4", "high-4" } };
+
+            auto virtual_volume = virtual_volume_handle.lock();
+            ASSERT_EQ( RetCode::Ok, std::get< RetCode >( virtual_volume->mount( low_handle, "/a", "/x" ) ) );
+            ASSERT_EQ( RetCode::Ok, std::get< RetCode >( virtual_volume->mount( high_handle, "/c", "/x" ) ) );
+
+            auto factory = [&]( const mount_point_t& mp, const key_t& physical_prefix ) {
+                return source( contents[ mp.physical_volume().get() ], physical_prefix );
+            };
+
+            {
+                auto [rc, cursor] = virtual_volume->list( "/x", factory );
+                ASSERT_EQ( RetCode::Ok, rc );
+
+                std::vector< std::pair< key_t, key_t > > result;
+                for ( ; cursor.valid(); cursor.next() ) result.emplace_back( cursor.key(), cursor.value() );
+
+                std::vector< std::pair< key_t, key_t > > expected{ { "/x/1", "low-1" }, { "/x/2", "high-2" }, { "/x/4", "high-4" } };
+                EXPECT_EQ( expected, result );
+            }
+
+            {
+                auto [rc, cursor] = virtual_volume->list( "/x/2", factory );
+                ASSERT_EQ( RetCode::Ok, rc );
+                ASSERT_TRUE( cursor.valid() );
+                EXPECT_EQ( "/x/2", cursor.key() );
+                EXPECT_EQ( "high-2", cursor.value() );
+                cursor.next();
+                EXPECT_FALSE( cursor.valid() );
+            }
+
+            {
+                auto [rc, cursor] = virtual_volume->list( "/y", factory );
+                ASSERT_EQ( RetCode::Ok, rc );
+                EXPECT_FALSE( cursor.valid() );
+            }
+        }
+
+
+        TEST_F( virtual_volume_test, snapshot )
+        {
+            storage<> s;
+
+            auto [rc_1, virtual_volume_handle] = s.open_virtual_volume();
+            ASSERT_EQ( RetCode::Ok, rc_1 );
+            auto virtual_volume = virtual_volume_handle.lock();
+
+            std::vector< typename storage<>::virtual_volume_t::snapshot_t > snapshots;
+            for ( size_t i = 0; i < default_policies::snapshot_slot_count; ++i )
+            {
+                auto [rc, snapshot] = virtual_volume->snapshot();
+                ASSERT_EQ( RetCode::Ok, rc );
+                ASSERT_TRUE( snapshot );
+                snapshots.push_back( std::move( snapshot ) );
+            }
+
+            auto [rc_2, snapshot] = virtual_volume->snapshot();
+            EXPECT_EQ( RetCode::Overloaded, rc_2 );
+            EXPECT_FALSE( snapshot );
+
+            snapshots.pop_back();
+            EXPECT_EQ( RetCode::Ok, std::get< RetCode >( virtual_volume->snapshot() ) );
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include <jb/storage.h>
+#include <jb/write_ahead_log.h>
+#include <future>
+#include <string>
+
+
+namespace jb
+{
+    namespace regression
+    {
+        struct write_ahead_log_test : public ::testing::Test
+        {
+            using write_ahead_log = details::write_ahead_log< default_policies >;
+
+            static std::vector< std::pair< uint64_t, std::string > > replay( write_ahead_log& log, uint64_t from = 0 )
+            {
+                std::vector< std::pair< uint64_t, std::string > > records;
+                log.replay( from, [&]( uint64_t lsn, const void* data, size_t size ) {
+                    records.emplace_back( lsn, std::string( static_cast< const char* >( data ), size ) );
+                } );
+                return records;
+            }
+
+            virtual void TearDown() override
+            {
+                for ( auto& file : std::filesystem::directory_iterator( "." ) )
+                {
+                    if ( file.path().filename().string().find( "foo.jb.wal." ) == 0 )
+                    {
+                        std::filesystem::remove( file.path() );
+                    }
+                }
+            }
+        };
+
+
+        TEST_F( write_ahead_log_test, commit_replay )
+        {
+            {
+                write_ahead_log log( "./foo.jb" );
+                EXPECT_EQ( 0, log.durable() );
+                EXPECT_EQ( 1, log.commit( "aaa", 3 ) );
+                EXPECT_EQ( 2, log.commit( "bb", 2 ) );
+                EXPECT_EQ( 3, log.commit( "", 0 ) );
+                EXPECT_EQ( 3, log.durable() );
+            }
+            {
+                write_ahead_log log( "./foo.jb" );
+                EXPECT_EQ( 3, log.durable() );
+
+                std::vector< std::pair< uint64_t, std::string > > expected{ { 1, "aaa" }, { 2, "bb" }, { 3, "" } };
+                EXPECT_EQ( expected, replay( log ) );
+
+                expected.erase( expected.begin() );
+                EXPECT_EQ( expected, replay( log, 1 ) );
+
+                EXPECT_EQ( 4, log.commit( "c", 1 ) );
+            }
+            {
+                write_ahead_log log( "./foo.jb" );
+                EXPECT_EQ( 4, replay( log ).size() );
+            }
+        }
+
+
+        TEST_F( write_ahead_log_test, torn_tail )
+        {
+            {
+                write_ahead_log log( "./foo.jb" );
+                log.commit( "aaa", 3 );
+                log.commit( "bbb", 3 );
+            }
+
+            // damage the last record
+            for ( auto& file : std::filesystem::directory_iterator( "." ) )
+            {
+                if ( file.path().filename().string().find( "foo.jb.wal." ) == 0 && std::filesystem::file_size( file.path() ) )
+                {
+                    std::filesystem::resize_file( file.path(), std::filesystem::file_size( file.path() ) - 1 );
+                }
+            }
+
+            {
+                write_ahead_log log( "./foo.jb" );
+                EXPECT_EQ( 1, log.durable() );
+                EXPECT_EQ( 2, log.commit( "ccc", 3 ) );
+            }
+            {
+                write_ahead_log log( "./foo.jb" );
+                std::vector< std::pair< uint64_t, std::string > > expected{ { 1, "aaa" }, { 2, "ccc" } };
+                EXPECT_EQ( expected, replay( log ) );
+            }
+        }
+
+
+        TEST_F( write_ahead_log_test, rotate_truncate )
+        {
+            write_ahead_log log( "./foo.jb" );
+            log.commit( "a", 1 );
+            log.commit( "b", 1 );
+
+            auto lsn = log.rotate();
+            EXPECT_EQ( 2, lsn );
+            log.commit( "c", 1 );
+
+            EXPECT_EQ( 1, log.truncate( lsn ) );
+            EXPECT_EQ( 0, log.truncate( lsn ) );
+
+            log.rotate();
+            std::vector< std::pair< uint64_t, std::string > > expected{ { 3, "c" } };
+            EXPECT_EQ( expected, replay( log ) );
+        }
+
+
+        TEST_F( write_ahead_log_test, group_commit )
+        {
+            auto thread_number = std::max( 2u, std::thread::hardware_concurrency() );
+            constexpr size_t commits_per_thread = 1000;
+
+            {
+                write_ahead_log log( "./foo.jb" );
+
+                std::vector< std::future< void > > futures;
+                for ( size_t t = 0; t < thread_number; ++t )
+                {
+                    futures.push_back( std::async( std::launch::async, [&, t] {
+                        for ( size_t i = 0; i < commits_per_thread; ++i )
+                        {
+                            auto record = std::to_string( t ) + ":" + std::to_string( i );
+                            auto lsn = log.commit( record.data(), record.size() );
+                            EXPECT_LE( lsn, log.durable() );
+                        }
+                    } ) );
+                }
+
+                for ( auto& f : futures ) f.get();
+                EXPECT_EQ( thread_number * commits_per_thread, log.durable() );
+            }
+
+            write_ahead_log log( "./foo.jb" );
+            auto records = replay( log );
+            ASSERT_EQ( thread_number * commits_per_thread, records.size() );
+            for ( size_t i = 0; i < records.size(); ++i )
+            {
+                EXPECT_EQ( i + 1, records[ i ].first );
+            }
+        }
+    }
+}